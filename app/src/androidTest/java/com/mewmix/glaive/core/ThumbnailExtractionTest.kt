@@ -0,0 +1,94 @@
+package com.mewmix.glaive.core
+
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import androidx.test.platform.app.InstrumentationRegistry
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertNotNull
+import org.junit.Assert.assertTrue
+import org.junit.Before
+import org.junit.Test
+import org.junit.runner.RunWith
+import java.io.File
+
+/** Embedded thumbnail extraction (THUMBNAILS in glaive_core.c), fed well-formed and hostile JPEG heads. */
+@RunWith(AndroidJUnit4::class)
+class ThumbnailExtractionTest {
+    private lateinit var dir: File
+
+    @Before
+    fun setUp() {
+        val context = InstrumentationRegistry.getInstrumentation().targetContext
+        assertTrue(NativeCore.nativeThumbOpen(File(context.cacheDir, "thumbnails.bin").path))
+        dir = File(context.cacheDir, "thumbnail-test").apply {
+            deleteRecursively()
+            mkdirs()
+        }
+    }
+
+    @Test
+    fun testExifThumbnailAndOrientation() {
+        val thumbnail = byteArrayOf(0xFF.toByte(), 0xD8.toByte()) + ByteArray(60) { it.toByte() } +
+            byteArrayOf(0xFF.toByte(), 0xD9.toByte())
+        val entry = extract(write("photo.jpg", exifJpeg(ifd1 = true, thumbnail = thumbnail)))
+        assertEquals("JPEG entry", 1, entry[0].toInt())
+        assertEquals("Exif orientation", 6, entry[1].toInt())
+        assertTrue(thumbnail.contentEquals(entry.copyOfRange(4, entry.size)))
+    }
+
+    @Test
+    fun testNoEmbeddedThumbnail() {
+        val entry = extract(write("plain.jpg", exifJpeg(ifd1 = false, thumbnail = ByteArray(0))))
+        assertEquals("Left to the platform decoder", 0, entry[0].toInt())
+    }
+
+    @Test
+    fun testHostileExifIsRejected() {
+        // IFD0 offset 2 bytes before the end of the TIFF block: its count and link do not fit
+        val tiff = byteArrayOf('I'.code.toByte(), 'I'.code.toByte(), 42, 0, 14, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1, -1)
+        val hostile = byteArrayOf(0xFF.toByte(), 0xD8.toByte(), 0xFF.toByte(), 0xE1.toByte(), 0, 24) +
+            "Exif\u0000\u0000".toByteArray() + tiff
+        assertEquals(0, extract(write("hostile.jpg", hostile))[0].toInt())
+
+        // Every truncation of a valid file, down to the bare SOI
+        val valid = exifJpeg(ifd1 = true, thumbnail = byteArrayOf(0xFF.toByte(), 0xD8.toByte(), 1, 2, 0xFF.toByte(), 0xD9.toByte()))
+        for (length in 2 until valid.size step 7) {
+            assertNotNull(extract(write("cut$length.jpg", valid.copyOf(length))))
+        }
+    }
+
+    private fun write(name: String, bytes: ByteArray): File = File(dir, name).apply { writeBytes(bytes) }
+
+    private fun extract(file: File): ByteArray {
+        val mtime = file.lastModified() / 1000
+        val seen = NativeCore.nativeThumbVersion()
+        assertTrue(NativeCore.nativeThumbRequest(file.path, mtime, file.length(), Int.MAX_VALUE) >= 0)
+        val deadline = System.currentTimeMillis() + 5_000
+        while (System.currentTimeMillis() < deadline) {
+            NativeCore.nativeThumbGet(file.path, mtime, file.length())?.let { return it }
+            if (NativeCore.nativeThumbVersion() == seen) Thread.sleep(5)
+        }
+        throw AssertionError("No cache entry for ${file.name}")
+    }
+
+    /** SOI, an Exif APP1 with IFD0 (orientation 6) and optionally IFD1 pointing at [thumbnail], then SOS. */
+    private fun exifJpeg(ifd1: Boolean, thumbnail: ByteArray): ByteArray {
+        val tiff = java.nio.ByteBuffer.allocate(64 + thumbnail.size).order(java.nio.ByteOrder.LITTLE_ENDIAN)
+        tiff.put('I'.code.toByte()).put('I'.code.toByte()).putShort(42).putInt(8)
+        tiff.putShort(1).putShort(0x0112).putShort(3).putInt(1).putShort(6).putShort(0)
+        val ifd1Offset = 8 + 2 + 12 + 4
+        tiff.putInt(if (ifd1) ifd1Offset else 0)
+        if (ifd1) {
+            val thumbnailOffset = ifd1Offset + 2 + 2 * 12 + 4
+            tiff.putShort(2)
+            tiff.putShort(0x0201).putShort(4).putInt(1).putInt(thumbnailOffset)
+            tiff.putShort(0x0202).putShort(4).putInt(1).putInt(thumbnail.size)
+            tiff.putInt(0)
+            tiff.put(thumbnail)
+        }
+        val tiffBytes = tiff.array().copyOf(tiff.position())
+        val segment = 2 + 6 + tiffBytes.size
+        return byteArrayOf(0xFF.toByte(), 0xD8.toByte(), 0xFF.toByte(), 0xE1.toByte(), (segment shr 8).toByte(), segment.toByte()) +
+            "Exif\u0000\u0000".toByteArray() + tiffBytes +
+            byteArrayOf(0xFF.toByte(), 0xDA.toByte(), 0, 2) + ByteArray(64) { 0x55 }
+    }
+}
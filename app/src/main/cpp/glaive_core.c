@@ -1,6 +1,8 @@
 #include <jni.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/syscall.h>
@@ -12,6 +14,7 @@
 #include <stdint.h>
 #include <arm_neon.h>
 #include <android/log.h>
+#include <android/api-level.h>
 #include <limits.h>
 #include <time.h>
 #include <pthread.h>
@@ -41,23 +44,488 @@ typedef enum {
     TYPE_VID = 3,
     TYPE_APK = 4,
     TYPE_DOC = 5,
-    TYPE_FILE = 6
+    TYPE_FILE = 6,
+    TYPE_AUDIO = 7,
+    TYPE_ARCHIVE = 8,
+    TYPE_CODE = 9,
+    TYPE_EBOOK = 10
 } FileType;
 
 // ==========================================
 // GLOBALS & SYNC
 // ==========================================
-static volatile atomic_int g_cancel_search = 0;
 static volatile atomic_long g_stat_calls = 0;
+// Foreground listings in flight; background (prefetch) listings yield to them
+static atomic_int g_foreground_listings = 0;
+
+// ==========================================
+// TRACE LOG
+// ==========================================
+// Process-wide binary log shared by native code and DebugLogger. Writers claim
+// slots of a lock-free ring with one atomic add and store a record: monotonic
+// timestamp, level, interned message id, up to GLOG_MAX_ARGS integers and an
+// optional text tail spilling into the following slots. A background thread
+// formats the records and appends them to a rotating file in batches, so a
+// log line never takes a lock, formats a date or touches the file on the
+// calling thread.
+//
+// Each slot carries a sequence word, (position << 2) | head | writing, that
+// readers check before and after copying a record. A writer lapped by the
+// ring only loses its own record; the drain notes how many slots it skipped.
+//
+// Native code logs with GLOG(level, GLOG_MSG_*, args...). While the log is off
+// those calls go straight to logcat, as LOGE did.
+#define GLOG_DEBUG ANDROID_LOG_DEBUG
+#define GLOG_INFO  ANDROID_LOG_INFO
+#define GLOG_WARN  ANDROID_LOG_WARN
+#define GLOG_ERROR ANDROID_LOG_ERROR
+
+#define GLOG_SLOTS 8192                 // power of two; 1MB of ring
+#define GLOG_SLOT_SIZE 128
+#define GLOG_MAX_ARGS 8
+#define GLOG_MAX_RECORD_SLOTS 64        // longer texts are cut
+#define GLOG_DRAIN_INTERVAL_MS 50
+#define GLOG_LINE_MAX 8192
+#define GLOG_TAG "GlaiveDebug"
+
+#define GLOG_SEQ_WRITING 1
+#define GLOG_SEQ_HEAD    2
+
+// Interned messages. %s takes the record text, %d the next integer argument.
+// DebugLogger mirrors the first four ids.
+enum {
+    GLOG_MSG_TEXT = 0,
+    GLOG_MSG_STARTING,
+    GLOG_MSG_FINISHED,
+    GLOG_MSG_FAILED,
+    GLOG_MSG_LIST_TIMINGS,
+    GLOG_MSG_SEARCH_TIMINGS,
+    GLOG_MSG_DELETE_TIMINGS,
+    GLOG_MSG_SYNC_COMPARE,
+    GLOG_MSG_SYNC_COPY,
+    GLOG_MSG_THUMB,
+    GLOG_MSG_COUNT
+};
+
+static const char* const g_glog_formats[GLOG_MSG_COUNT] = {
+    [GLOG_MSG_TEXT] = "%s",
+    [GLOG_MSG_STARTING] = "%s: Starting",
+    [GLOG_MSG_FINISHED] = "%s: Finished",
+    [GLOG_MSG_FAILED] = "%s: Failed",
+    [GLOG_MSG_LIST_TIMINGS] = "LIST timings: read=%dms stat=%dms sort=%dms out=%dms entries=%d stat_calls=%d bytes=%d%s",
+    [GLOG_MSG_SEARCH_TIMINGS] = "SEARCH timings: total=%dms results=%d status=%d bytes=%d",
+    [GLOG_MSG_DELETE_TIMINGS] = "DELETE timings: total=%dms removed=%d failed=%d cancelled=%d",
+    [GLOG_MSG_SYNC_COMPARE] = "SYNC compare: total=%dms entries=%d diffs=%d threads=%d cancelled=%d",
+    [GLOG_MSG_SYNC_COPY] = "SYNC copy: total=%dms entries=%d bytes=%d failed=%d cancelled=%d",
+    [GLOG_MSG_THUMB] = "THUMB extract: embedded=%d time=%dus %s",
+};
+
+typedef struct {
+    atomic_uint_least64_t seq;
+    int64_t t_ns;                       // CLOCK_MONOTONIC
+    uint16_t msg;
+    uint8_t level;
+    uint8_t slots;                      // slots taken by the whole record
+    uint16_t text_len;
+    uint8_t argc;
+    uint8_t reserved;
+    int64_t args[GLOG_MAX_ARGS];
+    char text[GLOG_SLOT_SIZE - 88];
+} GlogHead;
+
+typedef struct {
+    atomic_uint_least64_t seq;
+    char text[GLOG_SLOT_SIZE - 8];
+} GlogTail;
+
+typedef union {
+    GlogHead head;
+    GlogTail tail;
+    unsigned char raw[GLOG_SLOT_SIZE];
+} GlogSlot;
+
+_Static_assert(sizeof(GlogSlot) == GLOG_SLOT_SIZE, "log slot layout");
+
+#define GLOG_HEAD_TEXT ((int)sizeof(((GlogHead*)0)->text))
+#define GLOG_TAIL_TEXT ((int)sizeof(((GlogTail*)0)->text))
+#define GLOG_MAX_TEXT (GLOG_HEAD_TEXT + (GLOG_MAX_RECORD_SLOTS - 1) * GLOG_TAIL_TEXT)
+
+typedef struct {
+    atomic_int enabled;
+    atomic_uint_least64_t head;         // next free position
+    uint64_t tail;                      // next position to drain, file_lock
+    uint64_t skipped;                   // slots lost since the last report, file_lock
+
+    pthread_mutex_t file_lock;          // the consumer side: tail, fd, rotation
+    pthread_mutex_t control_lock;       // serializes start and stop
+    pthread_mutex_t wake_lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    int thread_running;
+    int fd;
+    int64_t file_size;
+    int64_t max_file_bytes;
+    int64_t realtime_offset_ns;         // CLOCK_REALTIME - CLOCK_MONOTONIC
+    char path[PATH_MAX];
+    char out[GLOG_LINE_MAX * 2];
+    int out_len;
+} GlogState;
+
+// The ring lives in .bss, so its pages are only touched once logging is on
+static GlogSlot g_glog_ring[GLOG_SLOTS];
+static GlogState g_glog = {
+    .file_lock = PTHREAD_MUTEX_INITIALIZER,
+    .control_lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake_lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .fd = -1
+};
+
+static inline int64_t glog_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Expands an interned message into out; returns its length.
+static int glog_format(char* out, int cap, int msg, const int64_t* args, int argc, const char* text, int text_len) {
+    const char* f = (msg >= 0 && msg < GLOG_MSG_COUNT) ? g_glog_formats[msg] : NULL;
+    int n = 0;
+    int arg = 0;
+    if (!f) {
+        n = snprintf(out, cap, "#%d ", msg);
+        f = "%s";
+    }
+    for (; *f && n < cap - 1; f++) {
+        if (f[0] == '%' && f[1] == 's') {
+            int len = text_len < cap - 1 - n ? text_len : cap - 1 - n;
+            memcpy(out + n, text, len);
+            n += len;
+            f++;
+        } else if (f[0] == '%' && f[1] == 'd') {
+            int len = snprintf(out + n, cap - n, "%lld", (long long)(arg < argc ? args[arg] : 0));
+            arg++;
+            n += len < cap - n ? len : cap - 1 - n;
+            f++;
+        } else {
+            out[n++] = *f;
+        }
+    }
+    out[n] = 0;
+    return n;
+}
+
+static void glog_write(int level, int msg, const int64_t* args, int argc, const char* text, int text_len) {
+    if (argc > GLOG_MAX_ARGS) argc = GLOG_MAX_ARGS;
+    if (text_len > GLOG_MAX_TEXT) text_len = GLOG_MAX_TEXT;
+    int slots = 1;
+    if (text_len > GLOG_HEAD_TEXT) slots += (text_len - GLOG_HEAD_TEXT + GLOG_TAIL_TEXT - 1) / GLOG_TAIL_TEXT;
+
+    uint64_t pos = atomic_fetch_add_explicit(&g_glog.head, slots, memory_order_relaxed);
+    for (int i = 0; i < slots; i++) {
+        GlogSlot* slot = &g_glog_ring[(pos + i) & (GLOG_SLOTS - 1)];
+        atomic_store_explicit(&slot->head.seq, ((pos + i) << 2) | GLOG_SEQ_WRITING, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+
+    GlogHead* h = &g_glog_ring[pos & (GLOG_SLOTS - 1)].head;
+    h->t_ns = glog_now_ns();
+    h->msg = (uint16_t)msg;
+    h->level = (uint8_t)level;
+    h->slots = (uint8_t)slots;
+    h->text_len = (uint16_t)text_len;
+    h->argc = (uint8_t)argc;
+    if (argc) memcpy(h->args, args, argc * sizeof(int64_t));
+    int copied = text_len < GLOG_HEAD_TEXT ? text_len : GLOG_HEAD_TEXT;
+    memcpy(h->text, text, copied);
+    for (int i = 1; i < slots; i++) {
+        GlogTail* t = &g_glog_ring[(pos + i) & (GLOG_SLOTS - 1)].tail;
+        int len = text_len - copied < GLOG_TAIL_TEXT ? text_len - copied : GLOG_TAIL_TEXT;
+        memcpy(t->text, text + copied, len);
+        copied += len;
+    }
+
+    for (int i = 0; i < slots; i++) {
+        GlogSlot* slot = &g_glog_ring[(pos + i) & (GLOG_SLOTS - 1)];
+        atomic_store_explicit(&slot->head.seq, ((pos + i) << 2) | (i == 0 ? GLOG_SEQ_HEAD : 0), memory_order_release);
+    }
+}
+
+// Logs an interned message. Arguments are integers, passed as int64_t.
+static void glog_event(int level, int msg, const int64_t* args, int argc, const char* text) {
+    int text_len = text ? (int)strlen(text) : 0;
+    if (atomic_load_explicit(&g_glog.enabled, memory_order_relaxed)) {
+        glog_write(level, msg, args, argc, text, text_len);
+        return;
+    }
+    char line[1024];
+    glog_format(line, sizeof(line), msg, args, argc, text ? text : "", text_len);
+    __android_log_write(level, LOG_TAG, line);
+}
+
+#define GLOG_WITH_TEXT(level, msg, text, ...) do { \
+        const int64_t glog_args_[] = { __VA_ARGS__ }; \
+        glog_event(level, msg, glog_args_, (int)(sizeof(glog_args_) / sizeof(int64_t)), text); \
+    } while (0)
+#define GLOG(level, msg, ...) GLOG_WITH_TEXT(level, msg, NULL, __VA_ARGS__)
+
+// file_lock held.
+static void glog_flush_out(void) {
+    if (g_glog.out_len == 0 || g_glog.fd < 0) {
+        g_glog.out_len = 0;
+        return;
+    }
+    if (g_glog.max_file_bytes > 0 && g_glog.file_size > 0 && g_glog.file_size + g_glog.out_len > g_glog.max_file_bytes) {
+        // Keep one older generation next to the live file
+        char old_path[PATH_MAX + 2];
+        snprintf(old_path, sizeof(old_path), "%s.1", g_glog.path);
+        close(g_glog.fd);
+        rename(g_glog.path, old_path);
+        g_glog.fd = open(g_glog.path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+        g_glog.file_size = 0;
+        if (g_glog.fd < 0) {
+            g_glog.out_len = 0;
+            return;
+        }
+    }
+    int off = 0;
+    while (off < g_glog.out_len) {
+        ssize_t w = write(g_glog.fd, g_glog.out + off, g_glog.out_len - off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;
+        off += (int)w;
+    }
+    g_glog.file_size += off;
+    g_glog.out_len = 0;
+}
+
+// file_lock held. Formats one line into the output batch and echoes it to logcat.
+static void glog_emit(int level, int64_t t_ns, const char* message) {
+    if (g_glog.out_len > (int)sizeof(g_glog.out) - GLOG_LINE_MAX - 64) glog_flush_out();
+
+    int64_t wall_ns = t_ns + g_glog.realtime_offset_ns;
+    time_t sec = (time_t)(wall_ns / 1000000000LL);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char* out = g_glog.out + g_glog.out_len;
+    int n = (int)strftime(out, 32, "%Y-%m-%d %H:%M:%S", &tm);
+    n += snprintf(out + n, GLOG_LINE_MAX + 64 - n, ".%03d: %s\n", (int)((wall_ns / 1000000LL) % 1000), message);
+    g_glog.out_len += n;
+    __android_log_write(level, GLOG_TAG, message);
+}
+
+// file_lock held. Drains every complete record; returns the records written.
+static int glog_drain_locked(void) {
+    static char text[GLOG_MAX_TEXT];
+    static char line[GLOG_LINE_MAX];
+    int drained = 0;
+
+    for (;;) {
+        uint64_t head = atomic_load_explicit(&g_glog.head, memory_order_acquire);
+        if (g_glog.tail >= head) break;
+        if (head - g_glog.tail > GLOG_SLOTS) {
+            // Lapped: everything older than one ring is gone
+            g_glog.skipped += head - GLOG_SLOTS - g_glog.tail;
+            g_glog.tail = head - GLOG_SLOTS;
+        }
+
+        uint64_t pos = g_glog.tail;
+        GlogHead* h = &g_glog_ring[pos & (GLOG_SLOTS - 1)].head;
+        uint64_t seq = atomic_load_explicit(&h->seq, memory_order_acquire);
+        if ((seq >> 2) < pos || ((seq >> 2) == pos && (seq & GLOG_SEQ_WRITING))) break;   // still being written
+        if ((seq >> 2) > pos || !(seq & GLOG_SEQ_HEAD)) {
+            // Overwritten, or the middle of a record whose head was lost
+            g_glog.skipped++;
+            g_glog.tail++;
+            continue;
+        }
+
+        GlogHead copy;
+        memcpy(&copy, h, sizeof(copy));
+        int slots = copy.slots;
+        int text_len = copy.text_len;
+        if (slots < 1 || slots > GLOG_MAX_RECORD_SLOTS || text_len > GLOG_MAX_TEXT || copy.argc > GLOG_MAX_ARGS) {
+            g_glog.skipped++;
+            g_glog.tail++;
+            continue;
+        }
+        int pending = 0;
+        int lost = 0;
+        int copied = text_len < GLOG_HEAD_TEXT ? text_len : GLOG_HEAD_TEXT;
+        memcpy(text, copy.text, copied);
+        for (int i = 1; i < slots; i++) {
+            GlogTail* t = &g_glog_ring[(pos + i) & (GLOG_SLOTS - 1)].tail;
+            uint64_t tseq = atomic_load_explicit(&t->seq, memory_order_acquire);
+            if (tseq != (pos + i) << 2) {
+                // Its writer is still finishing the record, or a later one took the slot
+                if ((tseq >> 2) < pos + i || tseq == (((pos + i) << 2) | GLOG_SEQ_WRITING)) pending = 1;
+                else lost = 1;
+                break;
+            }
+            int len = text_len - copied < GLOG_TAIL_TEXT ? text_len - copied : GLOG_TAIL_TEXT;
+            memcpy(text + copied, t->text, len);
+            copied += len;
+        }
+        if (pending) break;
+        if (lost) {
+            g_glog.skipped++;
+            g_glog.tail++;
+            continue;
+        }
+        // The record must not have been reused while it was copied
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&h->seq, memory_order_relaxed) != seq) {
+            g_glog.skipped++;
+            g_glog.tail++;
+            continue;
+        }
+        g_glog.tail += slots;
+
+        if (g_glog.skipped) {
+            snprintf(line, sizeof(line), "(log overflow: %llu entries lost)", (unsigned long long)g_glog.skipped);
+            g_glog.skipped = 0;
+            glog_emit(GLOG_WARN, copy.t_ns, line);
+        }
+        glog_format(line, sizeof(line), copy.msg, copy.args, copy.argc, text, text_len);
+        glog_emit(copy.level, copy.t_ns, line);
+        drained++;
+    }
+    glog_flush_out();
+    return drained;
+}
+
+static void* glog_drain_thread(void* arg) {
+    pthread_mutex_lock(&g_glog.wake_lock);
+    while (atomic_load(&g_glog.enabled)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_nsec += GLOG_DRAIN_INTERVAL_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&g_glog.wake, &g_glog.wake_lock, &ts);
+        pthread_mutex_unlock(&g_glog.wake_lock);
+
+        pthread_mutex_lock(&g_glog.file_lock);
+        glog_drain_locked();
+        pthread_mutex_unlock(&g_glog.file_lock);
+
+        pthread_mutex_lock(&g_glog.wake_lock);
+    }
+    pthread_mutex_unlock(&g_glog.wake_lock);
+    return NULL;
+}
+
+// Starts logging to path, rotating it at maxFileBytes (0 = never). Returns
+// false when the file cannot be opened.
+JNIEXPORT jboolean JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeLogStart(JNIEnv *env, jobject clazz, jstring jPath, jlong maxFileBytes) {
+    const char* path = (*env)->GetStringUTFChars(env, jPath, NULL);
+    if (!path) return JNI_FALSE;
+    jboolean ok = JNI_FALSE;
+
+    pthread_mutex_lock(&g_glog.control_lock);
+    pthread_mutex_lock(&g_glog.file_lock);
+    if (g_glog.fd < 0 || strcmp(g_glog.path, path) != 0) {
+        if (g_glog.fd >= 0) close(g_glog.fd);
+        snprintf(g_glog.path, sizeof(g_glog.path), "%s", path);
+        g_glog.fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        struct stat st;
+        g_glog.file_size = (g_glog.fd >= 0 && fstat(g_glog.fd, &st) == 0) ? (int64_t)st.st_size : 0;
+    }
+    g_glog.max_file_bytes = maxFileBytes > 0 ? maxFileBytes : 0;
+    struct timespec rt;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    g_glog.realtime_offset_ns = (int64_t)rt.tv_sec * 1000000000LL + rt.tv_nsec - glog_now_ns();
+    ok = g_glog.fd >= 0;
+    // Records left in the ring while the log was off are stale
+    if (ok && !g_glog.thread_running) g_glog.tail = atomic_load(&g_glog.head);
+    pthread_mutex_unlock(&g_glog.file_lock);
+
+    if (ok && !g_glog.thread_running) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_destroy(&g_glog.wake);
+        pthread_cond_init(&g_glog.wake, &attr);
+        pthread_condattr_destroy(&attr);
+
+        atomic_store(&g_glog.enabled, 1);
+        if (pthread_create(&g_glog.thread, NULL, glog_drain_thread, NULL) == 0) {
+            g_glog.thread_running = 1;
+        } else {
+            atomic_store(&g_glog.enabled, 0);
+            ok = JNI_FALSE;
+        }
+    }
+    pthread_mutex_unlock(&g_glog.control_lock);
+    (*env)->ReleaseStringUTFChars(env, jPath, path);
+    return ok;
+}
+
+// Stops logging after writing out what is already in the ring.
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeLogStop(JNIEnv *env, jobject clazz) {
+    pthread_mutex_lock(&g_glog.control_lock);
+    pthread_mutex_lock(&g_glog.wake_lock);
+    atomic_store(&g_glog.enabled, 0);
+    pthread_cond_signal(&g_glog.wake);
+    pthread_mutex_unlock(&g_glog.wake_lock);
+    if (g_glog.thread_running) pthread_join(g_glog.thread, NULL);
+    g_glog.thread_running = 0;
+
+    pthread_mutex_lock(&g_glog.file_lock);
+    glog_drain_locked();
+    if (g_glog.fd >= 0) close(g_glog.fd);
+    g_glog.fd = -1;
+    pthread_mutex_unlock(&g_glog.file_lock);
+    pthread_mutex_unlock(&g_glog.control_lock);
+}
 
 JNIEXPORT void JNICALL
-Java_com_mewmix_glaive_core_NativeCore_nativeCancelSearch(JNIEnv *env, jobject clazz) {
-    atomic_store(&g_cancel_search, 1);
+Java_com_mewmix_glaive_core_NativeCore_nativeLogWrite(JNIEnv *env, jobject clazz, jint level, jint msg, jstring jText) {
+    if (!atomic_load_explicit(&g_glog.enabled, memory_order_relaxed)) return;
+    char text[2048];
+    if (!jText) {
+        glog_write(level, msg, NULL, 0, NULL, 0);
+        return;
+    }
+    jsize utf_len = (*env)->GetStringUTFLength(env, jText);
+    if (utf_len < (jsize)sizeof(text)) {
+        // Straight into the stack buffer, no JNI copy to release
+        (*env)->GetStringUTFRegion(env, jText, 0, (*env)->GetStringLength(env, jText), text);
+        glog_write(level, msg, NULL, 0, text, utf_len);
+        return;
+    }
+    const char* chars = (*env)->GetStringUTFChars(env, jText, NULL);
+    if (!chars) return;
+    glog_write(level, msg, NULL, 0, chars, utf_len);
+    (*env)->ReleaseStringUTFChars(env, jText, chars);
+}
+
+// Writes out everything logged so far before returning.
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeLogFlush(JNIEnv *env, jobject clazz) {
+    pthread_mutex_lock(&g_glog.file_lock);
+    glog_drain_locked();
+    pthread_mutex_unlock(&g_glog.file_lock);
 }
 
+// Drops pending records and empties the log file and its older generation.
 JNIEXPORT void JNICALL
-Java_com_mewmix_glaive_core_NativeCore_nativeResetSearch(JNIEnv *env, jobject clazz) {
-    atomic_store(&g_cancel_search, 0);
+Java_com_mewmix_glaive_core_NativeCore_nativeLogClear(JNIEnv *env, jobject clazz) {
+    pthread_mutex_lock(&g_glog.file_lock);
+    g_glog.tail = atomic_load(&g_glog.head);
+    g_glog.skipped = 0;
+    g_glog.out_len = 0;
+    if (g_glog.path[0]) {
+        char old_path[PATH_MAX + 2];
+        snprintf(old_path, sizeof(old_path), "%s.1", g_glog.path);
+        unlink(old_path);
+        if (g_glog.fd >= 0 && ftruncate(g_glog.fd, 0) == 0) g_glog.file_size = 0;
+    }
+    pthread_mutex_unlock(&g_glog.file_lock);
 }
 
 // ==========================================
@@ -85,97 +553,11 @@ typedef struct {
 typedef struct WorkItem {
     char* path;
     size_t len;
+    int depth;              // 0 = search root
+    int prio;               // frontier order, lower first
     struct WorkItem* next;
 } WorkItem;
 
-typedef struct {
-    WorkItem* head;
-    WorkItem* tail;
-    int count;
-    int active_workers;
-    int shutdown;
-    pthread_mutex_t lock;
-    pthread_cond_t cond;
-} WorkQueue;
-
-static void queue_init(WorkQueue* q) {
-    q->head = q->tail = NULL;
-    q->count = 0;
-    q->active_workers = 0;
-    q->shutdown = 0;
-    pthread_mutex_init(&q->lock, NULL);
-    pthread_cond_init(&q->cond, NULL);
-}
-
-static void queue_push(WorkQueue* q, char* path, size_t len) {
-    WorkItem* item = (WorkItem*)malloc(sizeof(WorkItem));
-    item->path = path;
-    item->len = len;
-    item->next = NULL;
-
-    pthread_mutex_lock(&q->lock);
-    if (q->tail) {
-        q->tail->next = item;
-        q->tail = item;
-    } else {
-        q->head = q->tail = item;
-    }
-    q->count++;
-    pthread_cond_signal(&q->cond);
-    pthread_mutex_unlock(&q->lock);
-}
-
-static WorkItem* queue_pop(WorkQueue* q) {
-    pthread_mutex_lock(&q->lock);
-    while (q->count == 0 && !q->shutdown) {
-        if (q->active_workers == 0) {
-            // No work left and no workers active -> Done
-            q->shutdown = 1;
-            pthread_cond_broadcast(&q->cond);
-            pthread_mutex_unlock(&q->lock);
-            return NULL;
-        }
-        pthread_cond_wait(&q->cond, &q->lock);
-    }
-
-    if (q->shutdown) {
-        pthread_mutex_unlock(&q->lock);
-        return NULL;
-    }
-
-    WorkItem* item = q->head;
-    if (item) {
-        q->head = item->next;
-        if (!q->head) q->tail = NULL;
-        q->count--;
-        q->active_workers++;
-    }
-    pthread_mutex_unlock(&q->lock);
-    return item;
-}
-
-static void queue_worker_done(WorkQueue* q) {
-    pthread_mutex_lock(&q->lock);
-    q->active_workers--;
-    if (q->count == 0 && q->active_workers == 0) {
-        q->shutdown = 1;
-        pthread_cond_broadcast(&q->cond);
-    }
-    pthread_mutex_unlock(&q->lock);
-}
-
-static void queue_destroy(WorkQueue* q) {
-    pthread_mutex_destroy(&q->lock);
-    pthread_cond_destroy(&q->cond);
-    WorkItem* curr = q->head;
-    while(curr) {
-        WorkItem* next = curr->next;
-        free(curr->path);
-        free(curr);
-        curr = next;
-    }
-}
-
 // ==========================================
 // RESULT BUFFER
 // ==========================================
@@ -195,19 +577,322 @@ static void gbuf_init(GlobalBuffer* gb, unsigned char* buf, int cap, size_t base
     pthread_mutex_init(&gb->lock, NULL);
 }
 
-static void gbuf_write(GlobalBuffer* gb, const unsigned char* data, size_t len) {
+static int gbuf_write(GlobalBuffer* gb, const unsigned char* data, size_t len) {
+    int written = 0;
     pthread_mutex_lock(&gb->lock);
     if (gb->current + len <= gb->end) {
         memcpy(gb->current, data, len);
         gb->current += len;
+        written = 1;
     }
     pthread_mutex_unlock(&gb->lock);
+    return written;
 }
 
 static void gbuf_destroy(GlobalBuffer* gb) {
     pthread_mutex_destroy(&gb->lock);
 }
 
+// ==========================================
+// SEARCH SESSIONS
+// ==========================================
+// Every nativeSearch runs inside a session with its own cancellation token,
+// optional time budget and result cap. Sessions share one process-wide worker
+// pool, and workers take one directory per turn from the running sessions in
+// round-robin order, so concurrent searches progress side by side.
+//
+// Each session walks its own frontier as a priority queue: shallow directories
+// first and, for ranked sessions, recently modified ones first within a depth.
+// Ranked sessions score every match and keep only the best top_k in a min-heap,
+// emitted best-first when the walk ends.
+//
+// Scan sessions are ranked sessions without a query: every file that passes the
+// filter is keyed by its mtime (SEARCH_SCAN_RECENT) or size (SEARCH_SCAN_LARGEST)
+// and the walk covers the whole tree. nativeSearchSnapshot lets callers show the
+// heap while it is still filling.
+#define SEARCH_STATUS_CANCELLED 1
+#define SEARCH_STATUS_DEADLINE  2
+#define SEARCH_STATUS_CAPPED    4
+
+#define SEARCH_SCAN_RECENT  1
+#define SEARCH_SCAN_LARGEST 2
+
+#define SEARCH_DEFAULT_TOP_K 2000
+#define SEARCH_MAX_TOP_K 20000
+
+#define SEARCH_SCORE_EXACT 1000     // whole name
+#define SEARCH_SCORE_STEM 900       // name without its extension
+#define SEARCH_SCORE_PREFIX 700
+#define SEARCH_SCORE_WORD 500       // starts at a word boundary
+#define SEARCH_SCORE_GLOB 500
+#define SEARCH_SCORE_SUBSTRING 300
+#define SEARCH_SCORE_RECENCY 60     // per recency bucket, see recency_bucket()
+#define SEARCH_RECENCY_BUCKETS 3
+#define SEARCH_DEPTH_PENALTY 40     // per directory level below the root
+
+// Best score any match inside a directory at this depth can reach
+#define search_score_bound(depth) \
+    (SEARCH_SCORE_EXACT + SEARCH_RECENCY_BUCKETS * SEARCH_SCORE_RECENCY - (depth) * SEARCH_DEPTH_PENALTY)
+
+typedef struct {
+    int64_t score;              // name score, or the mtime / size key of a scan
+    int len;
+    unsigned char* rec;         // encoded result record
+} SearchHit;
+
+typedef struct PruneRules PruneRules;
+
+typedef struct SearchSession {
+    atomic_int status;          // SEARCH_STATUS_* bits; any bit stops the walk
+    atomic_int results;
+    int64_t budget_ms;          // 0 = no time budget
+    int64_t deadline_ns;        // CLOCK_MONOTONIC, set when the search starts
+    int max_results;            // 0 = unlimited; unranked sessions only
+    pthread_cond_t done;
+
+    // Ranking; top_k == 0 streams matches in walk order instead
+    int top_k;
+    int scan_order;             // SEARCH_SCAN_*, 0 = match the query
+    int64_t now_sec;            // wall clock at start, for recency
+    pthread_mutex_t hits_lock;
+    SearchHit* hits;            // min-heap, weakest by hit_before() at the root
+    int hit_count;
+    atomic_llong hit_floor;     // weakest kept score once the heap is full, else 0
+    atomic_int hit_version;     // bumped whenever the heap changes
+
+    // Per-run state, guarded by the pool lock
+    const SearchContext* ctx;
+    const PruneRules* prune;
+    dev_t root_dev;
+    GlobalBuffer* gbuf;
+    WorkItem** frontier;        // min-heap on WorkItem.prio
+    int frontier_cap;
+    int queued;
+    int active;
+    int running;
+    struct SearchSession* next;
+} SearchSession;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    SearchSession* sessions;    // running sessions
+    SearchSession* cursor;      // last session served
+    int threads;
+} SearchPool;
+
+static SearchPool g_search_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .sessions = NULL,
+    .cursor = NULL,
+    .threads = 0
+};
+
+static inline int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int session_should_stop(SearchSession* s) {
+    if (atomic_load(&s->status)) return 1;
+    if (s->deadline_ns && monotonic_ns() >= s->deadline_ns) {
+        atomic_fetch_or(&s->status, SEARCH_STATUS_DEADLINE);
+        return 1;
+    }
+    return 0;
+}
+
+static void free_work_items(WorkItem* item) {
+    while (item) {
+        WorkItem* next = item->next;
+        free(item->path);
+        free(item);
+        item = next;
+    }
+}
+
+// Pool lock held. Adds a chain of directories to the frontier in one go.
+static void session_push_locked(SearchSession* s, WorkItem* chain) {
+    int pushed = 0;
+    while (chain) {
+        WorkItem* item = chain;
+        chain = chain->next;
+        item->next = NULL;
+
+        if (s->queued == s->frontier_cap) {
+            int cap = s->frontier_cap ? s->frontier_cap * 2 : 64;
+            WorkItem** grown = (WorkItem**)realloc(s->frontier, cap * sizeof(WorkItem*));
+            if (!grown) {
+                free_work_items(item);
+                continue;
+            }
+            s->frontier = grown;
+            s->frontier_cap = cap;
+        }
+
+        int i = s->queued++;
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (s->frontier[parent]->prio <= item->prio) break;
+            s->frontier[i] = s->frontier[parent];
+            i = parent;
+        }
+        s->frontier[i] = item;
+        pushed++;
+    }
+    if (pushed > 1) pthread_cond_broadcast(&g_search_pool.work);
+    else if (pushed == 1) pthread_cond_signal(&g_search_pool.work);
+}
+
+// Pool lock held.
+static void session_drop_queue_locked(SearchSession* s) {
+    for (int i = 0; i < s->queued; i++) free_work_items(s->frontier[i]);
+    s->queued = 0;
+}
+
+// Pool lock held. Drops the queue of a stopped session and retires the
+// session once no worker is inside it any more.
+static void session_settle_locked(SearchSession* s) {
+    if (!s->running) return;
+    if (atomic_load(&s->status)) session_drop_queue_locked(s);
+    if (s->queued > 0 || s->active > 0) return;
+
+    SearchPool* p = &g_search_pool;
+    SearchSession** link = &p->sessions;
+    while (*link && *link != s) link = &(*link)->next;
+    if (*link) *link = s->next;
+    if (p->cursor == s) p->cursor = NULL;
+    s->next = NULL;
+    s->running = 0;
+    pthread_cond_broadcast(&s->done);
+}
+
+// Pool lock held. Next session with queued work after the cursor.
+static SearchSession* pool_next_session_locked(void) {
+    SearchPool* p = &g_search_pool;
+    if (!p->sessions) return NULL;
+    SearchSession* start = (p->cursor && p->cursor->next) ? p->cursor->next : p->sessions;
+    SearchSession* s = start;
+    do {
+        if (s->queued > 0) {
+            p->cursor = s;
+            return s;
+        }
+        s = s->next ? s->next : p->sessions;
+    } while (s != start);
+    return NULL;
+}
+
+// Pool lock held. Takes the best frontier directory on behalf of a worker.
+static WorkItem* session_take_locked(SearchSession* s) {
+    WorkItem* item = s->frontier[0];
+    WorkItem* last = s->frontier[--s->queued];
+    int n = s->queued;
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= n) break;
+        if (child + 1 < n && s->frontier[child + 1]->prio < s->frontier[child]->prio) child++;
+        if (last->prio <= s->frontier[child]->prio) break;
+        s->frontier[i] = s->frontier[child];
+        i = child;
+    }
+    if (n > 0) s->frontier[i] = last;
+    s->active++;
+    return item;
+}
+
+// A full ranked session stops descending once nothing at this depth can beat
+// its weakest kept match. The frontier pops shallowest first, so everything
+// still queued is at least as deep.
+static inline int session_depth_exhausted(SearchSession* s, int depth) {
+    if (!s->top_k || s->scan_order) return 0;
+    int64_t floor = atomic_load(&s->hit_floor);
+    // Strict: a deeper match that ties the floor may still win on its path
+    return floor > 0 && floor > search_score_bound(depth);
+}
+
+// Total order on hits: higher score first, then the record path bytewise. Ties
+// never depend on which worker found a match first, so the kept top-K and its
+// order are the same on every run over the same tree.
+static int hit_before(const SearchHit* a, const SearchHit* b) {
+    if (a->score != b->score) return a->score > b->score;
+    int alen = a->rec[1], blen = b->rec[1];
+    int c = memcmp(a->rec + 2, b->rec + 2, alen < blen ? alen : blen);
+    if (c != 0) return c < 0;
+    return alen < blen;
+}
+
+static void session_offer_hit(SearchSession* s, int64_t score, const unsigned char* rec, int len) {
+    if (score < atomic_load(&s->hit_floor)) return;
+
+    pthread_mutex_lock(&s->hits_lock);
+    SearchHit* h = s->hits;
+    int n = s->hit_count;
+    SearchHit hit = { score, len, (unsigned char*)rec };
+    if (n == s->top_k && !hit_before(&hit, &h[0])) {
+        pthread_mutex_unlock(&s->hits_lock);
+        return;
+    }
+    unsigned char* copy = (unsigned char*)malloc(len);
+    if (!copy) {
+        pthread_mutex_unlock(&s->hits_lock);
+        return;
+    }
+    memcpy(copy, rec, len);
+    hit.rec = copy;
+
+    if (n < s->top_k) {
+        int i = s->hit_count++;
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (!hit_before(&h[parent], &hit)) break;
+            h[i] = h[parent];
+            i = parent;
+        }
+        h[i] = hit;
+    } else {
+        free(h[0].rec);
+        int i = 0;
+        for (;;) {
+            int child = 2 * i + 1;
+            if (child >= n) break;
+            if (child + 1 < n && hit_before(&h[child], &h[child + 1])) child++;
+            if (!hit_before(&hit, &h[child])) break;
+            h[i] = h[child];
+            i = child;
+        }
+        h[i] = hit;
+    }
+    if (s->hit_count == s->top_k) atomic_store(&s->hit_floor, h[0].score);
+    atomic_fetch_add(&s->hit_version, 1);
+    pthread_mutex_unlock(&s->hits_lock);
+}
+
+static int compare_hits_desc(const void* a, const void* b) {
+    const SearchHit* x = (const SearchHit*)a;
+    const SearchHit* y = (const SearchHit*)b;
+    if (hit_before(x, y)) return -1;
+    return hit_before(y, x) ? 1 : 0;
+}
+
+// Writes the kept matches best-first into the result buffer and releases them.
+static void session_flush_hits(SearchSession* s) {
+    pthread_mutex_lock(&s->hits_lock);
+    qsort(s->hits, s->hit_count, sizeof(SearchHit), compare_hits_desc);
+    for (int i = 0; i < s->hit_count; i++) {
+        if (!(atomic_load(&s->status) & SEARCH_STATUS_CAPPED) && !gbuf_write(s->gbuf, s->hits[i].rec, s->hits[i].len)) {
+            atomic_fetch_or(&s->status, SEARCH_STATUS_CAPPED);
+        }
+        free(s->hits[i].rec);
+    }
+    s->hit_count = 0;
+    atomic_store(&s->hit_floor, 0);
+    pthread_mutex_unlock(&s->hits_lock);
+}
+
 // ==========================================
 // HELPERS
 // ==========================================
@@ -317,6 +1002,7 @@ static inline int strcasecmp_fast(const char* a, const char* b) {
 #endif
 }
 
+// Returns 1 + the offset of the first occurrence, or 0 when there is none.
 static int optimized_neon_contains(const char *haystack, int h_len, const SearchContext* ctx) {
     if (h_len < ctx->qlen) return 0;
     size_t n_len = ctx->qlen;
@@ -340,7 +1026,7 @@ static int optimized_neon_contains(const char *haystack, int h_len, const Search
             if (vgetq_lane_u64(fold, 0) | vgetq_lane_u64(fold, 1)) {
                 for (int k = 0; k < 16; k++) {
                     if (tolower(haystack[i + k]) == first && tolower(haystack[i + k + 1]) == second) {
-                        if (strncasecmp(haystack + i + k, needle, n_len) == 0) return 1;
+                        if (strncasecmp(haystack + i + k, needle, n_len) == 0) return (int)(i + k) + 1;
                     }
                 }
             }
@@ -355,7 +1041,7 @@ static int optimized_neon_contains(const char *haystack, int h_len, const Search
             if (vgetq_lane_u64(fold, 0) | vgetq_lane_u64(fold, 1)) {
                 for (int k = 0; k < 16; k++) {
                     if (tolower(haystack[i + k]) == first) {
-                        if (strncasecmp(haystack + i + k, needle, n_len) == 0) return 1;
+                        if (strncasecmp(haystack + i + k, needle, n_len) == 0) return (int)(i + k) + 1;
                     }
                 }
             }
@@ -363,7 +1049,7 @@ static int optimized_neon_contains(const char *haystack, int h_len, const Search
     }
     for (; i < h_len; i++) {
         if (tolower(haystack[i]) == first) {
-            if (strncasecmp(haystack + i, needle, n_len) == 0) return 1;
+            if (strncasecmp(haystack + i, needle, n_len) == 0) return (int)i + 1;
         }
     }
     return 0;
@@ -392,75 +1078,467 @@ static int glob_match_ci(const char *text, const char *pattern) {
     return *p == '\0';
 }
 
+// Non-zero on a match; for substring queries it is 1 + the match offset.
 static inline int optimized_matches_query(const char *name, int name_len, const SearchContext* ctx) {
     return ctx->glob_mode ? glob_match_ci(name, ctx->query) : optimized_neon_contains(name, name_len, ctx);
 }
 
-static inline unsigned char fast_get_type(const char *name, int name_len) {
-    if (name_len < 4) return TYPE_FILE;
-    const char *ext = name + name_len - 1;
-    int i = 0;
-    while (i < 6 && ext > name) {
-        if (*ext == '.') break;
-        ext--; i++;
-    }
-    if (*ext != '.') return TYPE_FILE;
-    char e1 = tolower(ext[1]);
-    char e2 = tolower(ext[2]);
-    char e3 = tolower(ext[3]);
-    char e4 = (i >= 4) ? tolower(ext[4]) : 0;
+static inline int is_word_start(const char *name, int i) {
+    if (i == 0) return 1;
+    unsigned char prev = (unsigned char)name[i - 1];
+    unsigned char cur = (unsigned char)name[i];
+    if (!isalnum(prev)) return 1;
+    return islower(prev) && isupper(cur);  // camelCase
+}
 
-    if (e1 == 'p') {
-        if (e2 == 'n' && e3 == 'g') return TYPE_IMG;
-        if (e2 == 'd' && e3 == 'f') return TYPE_DOC;
-        if (e2 == 'p' && e3 == 't') return TYPE_DOC;
+// Name part of a match score. [match] is the optimized_matches_query() result.
+static int search_name_score(const char *name, int name_len, int match, const SearchContext* ctx) {
+    if (ctx->glob_mode) return SEARCH_SCORE_GLOB;
+    int qlen = (int)ctx->qlen;
+    int pos = match - 1;
+    if (pos == 0) {
+        if (qlen == name_len) return SEARCH_SCORE_EXACT;
+        if (name[qlen] == '.' && !memchr(name + qlen + 1, '.', name_len - qlen - 1)) return SEARCH_SCORE_STEM;
+        return SEARCH_SCORE_PREFIX;
     }
-    if (e1 == 'j') {
-        if (e2 == 'p' && e3 == 'g') return TYPE_IMG;
-        if (e2 == 'p' && e3 == 'e' && e4 == 'g') return TYPE_IMG;
+    for (int i = pos; i + qlen <= name_len; i++) {
+        if (is_word_start(name, i) && strncasecmp(name + i, ctx->query, qlen) == 0) return SEARCH_SCORE_WORD;
+    }
+    return SEARCH_SCORE_SUBSTRING;
+}
+
+// 0..SEARCH_RECENCY_BUCKETS, higher = modified more recently
+static inline int recency_bucket(int64_t mtime, int64_t now) {
+    int64_t age = now - mtime;
+    if (age < 86400) return 3;
+    if (age < 7 * 86400) return 2;
+    if (age < 30 * 86400) return 1;
+    return 0;
+}
+
+// Cheap stat for walks that need one or two fields. statx() lets the caller
+// name the fields it needs, so FUSE-backed storage can answer from its
+// attribute cache instead of a full getattr. Bionic only wraps statx from API
+// 30 and older app seccomp policies trap the syscall, so below that, or on a
+// kernel without it, this is a plain fstatat. Fields the kernel did not
+// return read as 0.
+#define STAT_WANT_TYPE  0x001U      // STATX_TYPE
+#define STAT_WANT_MTIME 0x040U      // STATX_MTIME
+#define STAT_WANT_SIZE  0x200U      // STATX_SIZE
+#define STAT_DONT_SYNC  0x4000      // AT_STATX_DONT_SYNC
+
+typedef struct {
+    int is_dir;
+    int64_t size;
+    int64_t mtime;
+} LiteStat;
+
+// struct statx as the kernel lays it out; declared here because the platform
+// headers only expose it from API 30
+typedef struct {
+    uint32_t mask;
+    uint32_t blksize;
+    uint64_t attributes;
+    uint32_t nlink;
+    uint32_t uid;
+    uint32_t gid;
+    uint16_t mode;
+    uint16_t spare0;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t blocks;
+    uint64_t attributes_mask;
+    struct { int64_t sec; uint32_t nsec; int32_t reserved; } atime, btime, ctime, mtime;
+    uint64_t spare[16];
+} KernelStatx;
+
+_Static_assert(sizeof(KernelStatx) == 256, "struct statx layout");
+
+static atomic_int g_statx_mode = 0;    // 0 = undecided, 1 = statx, -1 = fstatat
+
+static int lite_stat(int dirfd, const char* name, unsigned int want, LiteStat* out) {
+#ifdef __NR_statx
+    int mode = atomic_load(&g_statx_mode);
+    if (mode == 0) {
+        mode = android_get_device_api_level() >= 30 ? 1 : -1;
+        atomic_store(&g_statx_mode, mode);
     }
-    if (e1 == 'm') {
-        if (e2 == 'p' && e3 == '4') return TYPE_VID;
-        if (e2 == 'k' && e3 == 'v') return TYPE_VID;
-        if (e2 == 'o' && e3 == 'v') return TYPE_VID;
+    if (mode > 0) {
+        KernelStatx stx;
+        if (syscall(__NR_statx, dirfd, name, AT_SYMLINK_NOFOLLOW | STAT_DONT_SYNC, want, &stx) == 0) {
+            out->is_dir = (stx.mask & STAT_WANT_TYPE) && S_ISDIR(stx.mode);
+            out->size = (stx.mask & STAT_WANT_SIZE) ? (int64_t)stx.size : 0;
+            out->mtime = (stx.mask & STAT_WANT_MTIME) ? stx.mtime.sec : 0;
+            return 0;
+        }
+        if (errno != ENOSYS) return -1;
+        atomic_store(&g_statx_mode, -1);
     }
-    if (e1 == 'a') {
-        if (e2 == 'p' && e3 == 'k') return TYPE_APK;
-        if (e2 == 'v' && e3 == 'i') return TYPE_VID;
+#endif
+    struct stat st;
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return -1;
+    out->is_dir = S_ISDIR(st.st_mode);
+    out->size = (int64_t)st.st_size;
+    out->mtime = (int64_t)st.st_mtime;
+    return 0;
+}
+
+// File types by extension: a perfect hash over lowercased extensions of up to
+// 8 bytes, packed little-endian into a uint64_t key. The slot of a key is
+// (hash & EXT_SLOT_MASK) ^ g_ext_disp[hash >> 24], with one displacement per
+// bucket picked when the table is laid out at load time, so every listed
+// extension has a slot of its own and a lookup is one hash, two loads and a
+// compare. The hash only uses 32-bit multiplies so ext_classify_batch can run
+// it four keys at a time on NEON.
+#define EXT_MAX_LEN 8
+#define EXT_SLOTS 1024
+#define EXT_SLOT_MASK (EXT_SLOTS - 1)
+#define EXT_BUCKETS 256
+
+typedef struct {
+    const char* exts;           // space separated
+    unsigned char type;
+} ExtGroup;
+
+static const ExtGroup g_ext_groups[] = {
+    { "jpg jpeg jpe jfif png apng gif bmp dib webp heic heif avif jxl tif tiff svg svgz ico cur icns "
+      "dng raw arw cr2 cr3 crw nef nrw orf rw2 raf pef srw x3f erf kdc mrw 3fr psd psb xcf kra ora "
+      "tga dds exr hdr jp2 j2k jpf jpx jpm pcx ppm pgm pbm pnm wbmp emf wmf qoi", TYPE_IMG },
+    { "mp4 m4v mkv mov qt avi webm 3gp 3gpp 3g2 flv f4v wmv asf mpg mpeg mpe m1v m2v ts mts m2ts vob "
+      "ogv rm rmvb divx xvid mxf y4m dv amv h264 h265 hevc", TYPE_VID },
+    { "mp3 aac m4a m4b m4r flac ogg oga opus wav wave aiff aif aifc wma amr awb mid midi kar mka ape "
+      "wv ac3 eac3 dts caf au snd ra spx mpc tta xm mod s3m it dsf dff gsm voc 3ga weba mp2 mpa "
+      "alac cue pls m3u m3u8", TYPE_AUDIO },
+    { "apk apks apkm xapk aab", TYPE_APK },
+    { "pdf doc docx docm dot dotx dotm odt ott fodt rtf txt text md markdown rst adoc tex "
+      "xls xlsx xlsm xlsb xlt xltx ods ots fods csv tsv ppt pptx pptm pps ppsx pot potx odp otp "
+      "key pages numbers log org wpd wps xps oxps msg eml vcf ics one pub", TYPE_DOC },
+    { "zip zipx rar 7z tar gz tgz bz2 tbz tbz2 xz txz lz tlz lzma lz4 zst tzst z cab arj ace lha lzh "
+      "iso img dmg vhd vmdk wim jar war ear cpio rpm deb sit sitx obb pak br", TYPE_ARCHIVE },
+    { "c h cc cpp cxx c++ hpp hh hxx inl m mm java kt kts scala sc groovy gradle py pyw pyi pyx rb "
+      "php phtml pl pm lua js mjs cjs jsx tsx go rs swift dart cs vb fs fsx r jl sh bash zsh fish "
+      "ps1 psm1 bat cmd sql json json5 jsonc yaml yml toml ini cfg conf xml xsd xsl html htm xhtml "
+      "css scss sass less vue svelte asm s proto graphql gql cmake mk diff patch ipynb env hs elm "
+      "erl hrl ex exs clj cljs edn nim zig sol tf hcl nix smali aidl glsl hlsl wgsl cu", TYPE_CODE },
+    { "epub mobi azw azw3 kf8 kfx fb2 djvu djv cbz cbr cb7 cbt lit lrf ibooks", TYPE_EBOOK },
+};
+
+static uint64_t g_ext_keys[EXT_SLOTS];
+static unsigned char g_ext_types[EXT_SLOTS];
+static uint16_t g_ext_disp[EXT_BUCKETS];
+
+static inline uint32_t ext_hash(uint64_t key) {
+    uint32_t h = (uint32_t)key * 0x9E3779B1u ^ (uint32_t)(key >> 32) * 0x85EBCA77u;
+    return h ^ (h >> 15);
+}
+
+static inline unsigned char ext_type_at(uint64_t key, uint32_t h) {
+    uint32_t slot = (h & EXT_SLOT_MASK) ^ g_ext_disp[h >> 24];
+    // Empty slots hold key 0 and TYPE_FILE, which is also the answer for no extension
+    return g_ext_keys[slot] == key ? g_ext_types[slot] : TYPE_FILE;
+}
+
+// Lowercased extension after the last dot, 0 when there is none or it is
+// longer than EXT_MAX_LEN. "|= 0x20" folds ASCII letters and keeps digits.
+static inline uint64_t ext_key(const char* name, int name_len) {
+    int dot = name_len - 1;
+    int stop = name_len - EXT_MAX_LEN - 1;
+    if (stop < 1) stop = 1;
+    while (dot >= stop && name[dot] != '.') dot--;
+    if (dot < stop || dot == name_len - 1) return 0;
+    uint64_t key = 0;
+    for (int i = dot + 1, shift = 0; i < name_len; i++, shift += 8) {
+        key |= (uint64_t)((unsigned char)name[i] | 0x20) << shift;
     }
-    if (e1 == 'g') {
-        if (e2 == 'i' && e3 == 'f') return TYPE_IMG;
+    return key;
+}
+
+static inline unsigned char fast_get_type(const char *name, int name_len) {
+    uint64_t key = ext_key(name, name_len);
+    return ext_type_at(key, ext_hash(key));
+}
+
+// Types for n keys from ext_key().
+static void ext_classify_batch(const uint64_t* keys, int n, unsigned char* types) {
+    int i = 0;
+    uint32_t h[4];
+    for (; i + 4 <= n; i += 4) {
+        uint64x2_t k01 = vld1q_u64(keys + i);
+        uint64x2_t k23 = vld1q_u64(keys + i + 2);
+        uint32x4_t lo = vcombine_u32(vmovn_u64(k01), vmovn_u64(k23));
+        uint32x4_t hi = vcombine_u32(vshrn_n_u64(k01, 32), vshrn_n_u64(k23, 32));
+        uint32x4_t v = veorq_u32(vmulq_n_u32(lo, 0x9E3779B1u), vmulq_n_u32(hi, 0x85EBCA77u));
+        v = veorq_u32(v, vshrq_n_u32(v, 15));
+        vst1q_u32(h, v);
+        types[i] = ext_type_at(keys[i], h[0]);
+        types[i + 1] = ext_type_at(keys[i + 1], h[1]);
+        types[i + 2] = ext_type_at(keys[i + 2], h[2]);
+        types[i + 3] = ext_type_at(keys[i + 3], h[3]);
     }
-    if (e1 == 'w') {
-        if (e2 == 'e' && e3 == 'b') {
-            if (e4 == 'p') return TYPE_IMG;
-            if (e4 == 'm') return TYPE_VID;
+    for (; i < n; i++) types[i] = ext_type_at(keys[i], ext_hash(keys[i]));
+}
+
+// Lays out the table: buckets are placed largest first, each at the first
+// displacement where all of its keys land on free slots.
+__attribute__((constructor))
+static void ext_table_build(void) {
+    static uint64_t keys[EXT_SLOTS / 2];
+    static unsigned char types[EXT_SLOTS / 2];
+    static uint16_t order[EXT_BUCKETS];
+    static int bucket_size[EXT_BUCKETS];
+    int n = 0;
+
+    for (size_t g = 0; g < sizeof(g_ext_groups) / sizeof(g_ext_groups[0]); g++) {
+        const char* p = g_ext_groups[g].exts;
+        while (*p) {
+            while (*p == ' ') p++;
+            const char* start = p;
+            while (*p && *p != ' ') p++;
+            if (p == start) continue;
+            uint64_t key = 0;
+            for (const char* c = start; c < p && c - start < EXT_MAX_LEN; c++) {
+                key |= (uint64_t)((unsigned char)*c | 0x20) << (8 * (c - start));
+            }
+            if (p - start > EXT_MAX_LEN || n == EXT_SLOTS / 2) continue;
+            keys[n] = key;
+            types[n] = g_ext_groups[g].type;
+            n++;
         }
     }
-    if (e1 == 'd') {
-        if (e2 == 'o' && e3 == 'c') return TYPE_DOC;
-    }
-    if (e1 == 'x') {
-        if (e2 == 'l' && e3 == 's') return TYPE_DOC;
+
+    for (int s = 0; s < EXT_SLOTS; s++) g_ext_types[s] = TYPE_FILE;
+    for (int i = 0; i < n; i++) bucket_size[ext_hash(keys[i]) >> 24]++;
+    for (int b = 0; b < EXT_BUCKETS; b++) order[b] = (uint16_t)b;
+    for (int a = 1; a < EXT_BUCKETS; a++) {
+        uint16_t b = order[a];
+        int j = a;
+        while (j > 0 && bucket_size[order[j - 1]] < bucket_size[b]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = b;
     }
-    if (e1 == 't') {
-        if (e2 == 'x' && e3 == 't') return TYPE_DOC;
+
+    int unplaced = 0;
+    for (int o = 0; o < EXT_BUCKETS && bucket_size[order[o]] > 0; o++) {
+        uint16_t b = order[o];
+        int placed = 0;
+        for (uint32_t d = 0; d < EXT_SLOTS && !placed; d++) {
+            uint32_t taken[EXT_MAX_LEN * 4];
+            int count = 0;
+            int fits = 1;
+            for (int i = 0; i < n && fits; i++) {
+                uint32_t h = ext_hash(keys[i]);
+                if ((h >> 24) != b) continue;
+                uint32_t slot = (h & EXT_SLOT_MASK) ^ d;
+                if (g_ext_keys[slot] != 0) fits = 0;
+                for (int t = 0; t < count && fits; t++) fits = taken[t] != slot;
+                if (count == (int)(sizeof(taken) / sizeof(taken[0]))) fits = 0;
+                if (fits) taken[count++] = slot;
+            }
+            if (!fits) continue;
+            g_ext_disp[b] = (uint16_t)d;
+            for (int i = 0; i < n; i++) {
+                uint32_t h = ext_hash(keys[i]);
+                if ((h >> 24) != b) continue;
+                uint32_t slot = (h & EXT_SLOT_MASK) ^ d;
+                g_ext_keys[slot] = keys[i];
+                g_ext_types[slot] = types[i];
+            }
+            placed = 1;
+        }
+        if (!placed) unplaced += bucket_size[b];
     }
-    if (e1 == '3') {
-        if (e2 == 'g' && e3 == 'p') return TYPE_VID;
+    if (unplaced) LOGE("EXT table: %d extensions left unclassified", unplaced);
+}
+
+// Content types for files whose extension says nothing, from their first
+// CONTENT_SNIFF_BYTES. Returns TYPE_FILE when nothing matches.
+#define CONTENT_SNIFF_BYTES 16
+
+static unsigned char sniff_content_type(const unsigned char* b, int n) {
+    if (n < 4) return TYPE_FILE;
+    if (b[0] == 0xFF && b[1] == 0xD8 && b[2] == 0xFF) return TYPE_IMG;
+    if (!memcmp(b, "\x89PNG", 4) || !memcmp(b, "GIF8", 4)) return TYPE_IMG;
+    if (!memcmp(b, "II*\0", 4) || !memcmp(b, "MM\0*", 4)) return TYPE_IMG;
+    if (n >= 12 && !memcmp(b, "RIFF", 4)) {
+        if (!memcmp(b + 8, "WEBP", 4)) return TYPE_IMG;
+        if (!memcmp(b + 8, "WAVE", 4)) return TYPE_AUDIO;
+        if (!memcmp(b + 8, "AVI ", 4)) return TYPE_VID;
+        return TYPE_FILE;
     }
-    if (e1 == 'b') {
-        if (e2 == 'm' && e3 == 'p') return TYPE_IMG;
+    if (n >= 12 && !memcmp(b + 4, "ftyp", 4)) {
+        const unsigned char* brand = b + 8;
+        if (!memcmp(brand, "heic", 4) || !memcmp(brand, "heix", 4) || !memcmp(brand, "mif1", 4) ||
+            !memcmp(brand, "msf1", 4) || !memcmp(brand, "avif", 4)) return TYPE_IMG;
+        if (!memcmp(brand, "M4A ", 4) || !memcmp(brand, "M4B ", 4)) return TYPE_AUDIO;
+        return TYPE_VID;
     }
+    if (!memcmp(b, "\x1A\x45\xDF\xA3", 4) || !memcmp(b, "FLV\x01", 4) || !memcmp(b, "\0\0\1\xBA", 4)) return TYPE_VID;
+    if (!memcmp(b, "ID3", 3) || !memcmp(b, "OggS", 4) || !memcmp(b, "fLaC", 4) ||
+        !memcmp(b, "MThd", 4) || !memcmp(b, "#!AMR", n >= 5 ? 5 : 4)) return TYPE_AUDIO;
+    if (b[0] == 0xFF && (b[1] & 0xF6) == 0xF0) return TYPE_AUDIO;    // AAC ADTS
+    if (b[0] == 0xFF && (b[1] & 0xE0) == 0xE0 && (b[1] & 0x06)) return TYPE_AUDIO;    // MPEG audio frame
+    if (!memcmp(b, "%PDF", 4) || !memcmp(b, "\xD0\xCF\x11\xE0", 4) || !memcmp(b, "{\\rt", 4)) return TYPE_DOC;
+    if (n >= 8 && !memcmp(b, "AT&TFORM", 8)) return TYPE_EBOOK;
+    if (!memcmp(b, "PK\3\4", 4) || !memcmp(b, "Rar!", 4) || !memcmp(b, "7z\xBC\xAF", 4) ||
+        !memcmp(b, "\x28\xB5\x2F\xFD", 4) || !memcmp(b, "BZh", 3) || (b[0] == 0x1F && b[1] == 0x8B)) return TYPE_ARCHIVE;
+    if (n >= 6 && !memcmp(b, "\xFD" "7zXZ\0", 6)) return TYPE_ARCHIVE;
+    if (b[0] == '#' && b[1] == '!') return TYPE_CODE;
+    if (n >= 5 && !memcmp(b, "<?xml", 5)) return TYPE_CODE;
     return TYPE_FILE;
 }
 
+// Reads the head of name (relative to dirfd) and sniffs it.
+static unsigned char sniff_file_type(int dirfd, const char* name) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK);
+    if (fd < 0) return TYPE_FILE;
+    unsigned char head[CONTENT_SNIFF_BYTES];
+    ssize_t n = pread(fd, head, sizeof(head), 0);
+    close(fd);
+    return n > 0 ? sniff_content_type(head, (int)n) : TYPE_FILE;
+}
+
 // ==========================================
-// LISTING (RESTORED)
+// PRUNE RULES
 // ==========================================
+// A rule set is compiled once from Kotlin and shared by search sessions and the
+// size engine. Evaluation only compares against the precompiled strings, so a
+// directory entry is checked without allocating.
+#define PRUNE_SAME_FS        1  // don't descend into other filesystems (st_dev)
+#define PRUNE_INCLUDE_HIDDEN 2  // visit dot-names
+
 typedef struct {
-    char* name;
-    int name_len;
+    const char* str;
+    size_t len;
+    int glob;                   // contains * or ?
+} PrunePattern;
+
+struct PruneRules {
+    PrunePattern* prefixes;     // absolute directory paths, no trailing '/'
+    int prefix_count;
+    PrunePattern* dir_names;    // directory names or globs, case-insensitive
+    int dir_name_count;
+    int max_depth;              // deepest directory visited, root = 0; -1 = unlimited
+    int flags;
+    char* strings;              // backing storage for all patterns
+};
+
+// Used when Kotlin passes no rule set: search skips hidden entries, sizes count everything
+static const PruneRules g_prune_search_default = { .max_depth = -1, .flags = 0 };
+static const PruneRules g_prune_size_default = { .max_depth = -1, .flags = PRUNE_INCLUDE_HIDDEN };
+
+static inline int prune_skip_hidden(const PruneRules* r, const char* name) {
+    return name[0] == '.' && !(r->flags & PRUNE_INCLUDE_HIDDEN);
+}
+
+// Whether to skip the directory parent/name that would sit at depth. Only the
+// directory itself is checked: a pruned directory's subtree is never reached.
+static int prune_skip_dir(const PruneRules* r, const char* parent, size_t parent_len,
+                          const char* name, int name_len, int depth) {
+    if (r->max_depth >= 0 && depth > r->max_depth) return 1;
+
+    for (int i = 0; i < r->dir_name_count; i++) {
+        const PrunePattern* p = &r->dir_names[i];
+        if (p->glob) {
+            if (glob_match_ci(name, p->str)) return 1;
+        } else if (p->len == (size_t)name_len && strncasecmp(name, p->str, name_len) == 0) {
+            return 1;
+        }
+    }
+
+    if (parent) {
+        size_t full_len = parent_len + 1 + name_len;
+        for (int i = 0; i < r->prefix_count; i++) {
+            const PrunePattern* p = &r->prefixes[i];
+            if (p->len != full_len) continue;
+            if (p->str[parent_len] == '/' &&
+                memcmp(p->str, parent, parent_len) == 0 &&
+                memcmp(p->str + parent_len + 1, name, name_len) == 0) return 1;
+        }
+    }
+    return 0;
+}
+
+static void prune_free(PruneRules* r) {
+    if (!r) return;
+    free(r->prefixes);
+    free(r->dir_names);
+    free(r->strings);
+    free(r);
+}
+
+// Copies each Java string of arr into out, backed by the storage at *cursor.
+// Prefixes lose their trailing slashes.
+static int prune_copy_patterns(JNIEnv* env, jobjectArray arr, PrunePattern* out, char** cursor, int is_prefix) {
+    int count = 0;
+    int n = arr ? (*env)->GetArrayLength(env, arr) : 0;
+    for (int i = 0; i < n; i++) {
+        jstring js = (jstring)(*env)->GetObjectArrayElement(env, arr, i);
+        if (!js) continue;
+        const char* str = (*env)->GetStringUTFChars(env, js, NULL);
+        if (str) {
+            size_t len = strlen(str);
+            if (is_prefix) while (len > 1 && str[len - 1] == '/') len--;
+            if (len > 0) {
+                memcpy(*cursor, str, len);
+                (*cursor)[len] = 0;
+                out[count].str = *cursor;
+                out[count].len = len;
+                out[count].glob = !is_prefix && has_glob_tokens(*cursor);
+                *cursor += len + 1;
+                count++;
+            }
+            (*env)->ReleaseStringUTFChars(env, js, str);
+        }
+        (*env)->DeleteLocalRef(env, js);
+    }
+    return count;
+}
+
+static size_t prune_strings_size(JNIEnv* env, jobjectArray arr) {
+    size_t total = 0;
+    int n = arr ? (*env)->GetArrayLength(env, arr) : 0;
+    for (int i = 0; i < n; i++) {
+        jstring js = (jstring)(*env)->GetObjectArrayElement(env, arr, i);
+        if (!js) continue;
+        total += (*env)->GetStringUTFLength(env, js) + 1;
+        (*env)->DeleteLocalRef(env, js);
+    }
+    return total;
+}
+
+// Compiles a rule set; the handle stays valid for the life of the process.
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativePruneCompile(JNIEnv *env, jobject clazz, jobjectArray jPrefixes, jobjectArray jDirNames, jint maxDepth, jint flags) {
+    PruneRules* r = (PruneRules*)calloc(1, sizeof(PruneRules));
+    if (!r) return 0;
+    int prefix_n = jPrefixes ? (*env)->GetArrayLength(env, jPrefixes) : 0;
+    int name_n = jDirNames ? (*env)->GetArrayLength(env, jDirNames) : 0;
+    size_t strings_size = prune_strings_size(env, jPrefixes) + prune_strings_size(env, jDirNames);
+
+    r->prefixes = (PrunePattern*)calloc(prefix_n + 1, sizeof(PrunePattern));
+    r->dir_names = (PrunePattern*)calloc(name_n + 1, sizeof(PrunePattern));
+    r->strings = (char*)malloc(strings_size + 1);
+    if (!r->prefixes || !r->dir_names || !r->strings) {
+        prune_free(r);
+        return 0;
+    }
+
+    char* cursor = r->strings;
+    r->prefix_count = prune_copy_patterns(env, jPrefixes, r->prefixes, &cursor, 1);
+    r->dir_name_count = prune_copy_patterns(env, jDirNames, r->dir_names, &cursor, 0);
+    r->max_depth = maxDepth >= 0 ? maxDepth : -1;
+    r->flags = flags;
+    return (jlong)(intptr_t)r;
+}
+
+// ==========================================
+// LISTING (RESTORED)
+// ==========================================
+typedef struct {
+    char* name;
+    int name_len;
     unsigned char type;
     int64_t size;
     int64_t time;
@@ -471,12 +1549,21 @@ typedef struct {
     GlaiveEntry* entries;
     size_t start_index;
     size_t end_index;
+    int background;
+    int sniff;                  // sniff the content of files with no known extension
 } StatWorkerArgs;
 
+#define LIST_PREEMPTED (-4)
+
+static inline int list_preempted(int background) {
+    return background && atomic_load(&g_foreground_listings) > 0;
+}
+
 void* stat_worker_thread(void* arg) {
     StatWorkerArgs* args = (StatWorkerArgs*)arg;
     struct stat st;
     for (size_t i = args->start_index; i < args->end_index; i++) {
+        if ((i & 63) == 0 && list_preempted(args->background)) break;
         GlaiveEntry* e = &args->entries[i];
         if (fstatat(args->dirfd, e->name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
             e->size = st.st_size;
@@ -485,6 +1572,9 @@ void* stat_worker_thread(void* arg) {
                  if (S_ISDIR(st.st_mode)) e->type = TYPE_DIR;
                  else if (e->type == TYPE_UNKNOWN) e->type = fast_get_type(e->name, e->name_len);
             }
+            if (args->sniff && e->type == TYPE_FILE && S_ISREG(st.st_mode) && st.st_size >= 4) {
+                e->type = sniff_file_type(args->dirfd, e->name);
+            }
             atomic_fetch_add(&g_stat_calls, 1);
         } else {
              if (e->type == TYPE_UNKNOWN) e->type = fast_get_type(e->name, e->name_len);
@@ -493,8 +1583,9 @@ void* stat_worker_thread(void* arg) {
     return NULL;
 }
 
-static int g_sort_mode = 0;
-static int g_sort_asc = 1;
+// Per thread: prefetch listings sort concurrently with foreground ones
+static __thread int g_sort_mode = 0;
+static __thread int g_sort_asc = 1;
 
 int compare_entries(const void* a, const void* b) {
     GlaiveEntry* ea = (GlaiveEntry*)a;
@@ -526,9 +1617,19 @@ int compare_entries(const void* a, const void* b) {
     return g_sort_asc ? result : -result;
 }
 
-JNIEXPORT jint JNICALL
-Java_com_mewmix_glaive_core_NativeCore_nativeFillBuffer(JNIEnv *env, jobject clazz, jstring jPath, jobject jBuffer, jint capacity, jint sortMode, jboolean asc, jint filterMask) {
+static void free_entries(GlaiveEntry* entries, size_t count) {
+    for (size_t i = 0; i < count; i++) free(entries[i].name);
+    free(entries);
+}
+
+// Name/type sorts only stat the entries in [statFrom, statFrom + statCount) of
+// the sorted order, the rows the caller is about to show. A background listing
+// stats on the calling thread only and gives up with LIST_PREEMPTED as soon as
+// a foreground listing is running. With sniff, the stat pass also reads the
+// first bytes of files whose extension is unknown to type them by content.
+static jint fill_buffer(JNIEnv *env, jstring jPath, jobject jBuffer, jint capacity, jint sortMode, jboolean asc, jint filterMask, jint statFrom, jint statCount, int background, int sniff) {
     if (capacity <= 0) return 0;
+    if (list_preempted(background)) return LIST_PREEMPTED;
 
     const char *path = (*env)->GetStringUTFChars(env, jPath, NULL);
     unsigned char *buffer = (*env)->GetDirectBufferAddress(env, jBuffer);
@@ -564,28 +1665,59 @@ Java_com_mewmix_glaive_core_NativeCore_nativeFillBuffer(JNIEnv *env, jobject cla
     struct linux_dirent64 *d;
     int nread;
 
+    // One getdents64 batch of regular files, classified together. A dirent is
+    // at least 24 bytes, which bounds the batch.
+    size_t batch_max = kbuf_size / 24 + 1;
+    struct linux_dirent64** batch = (struct linux_dirent64**)malloc(batch_max * sizeof(*batch));
+    uint64_t* batch_keys = (uint64_t*)malloc(batch_max * sizeof(uint64_t));
+    unsigned char* batch_types = (unsigned char*)malloc(batch_max);
+    if (!batch || !batch_keys || !batch_types) {
+        free(batch);
+        free(batch_keys);
+        free(batch_types);
+        free(kbuf);
+        free(entries);
+        close(fd);
+        (*env)->ReleaseStringUTFChars(env, jPath, path);
+        return -3;
+    }
+
     // Timing helpers
     struct timespec t0, t1, t2, t3, t4;
     clock_gettime(CLOCK_MONOTONIC, &t0);
 
     // PHASE 1: READ ENTRIES (SERIAL)
+    int preempted = 0;
     while ((nread = syscall(__NR_getdents64, fd, kbuf, kbuf_size)) > 0) {
+        if (list_preempted(background)) {
+            preempted = 1;
+            break;
+        }
         int bpos = 0;
+        size_t batch_count = 0;
         while (bpos < nread) {
             d = (struct linux_dirent64 *)(kbuf + bpos);
             bpos += d->d_reclen;
-
             if (d->d_name[0] == '.') continue;
+            batch[batch_count] = d;
+            batch_keys[batch_count] = d->d_type == DT_REG ? ext_key(d->d_name, strnlen(d->d_name, 255)) : 0;
+            batch_count++;
+        }
+        ext_classify_batch(batch_keys, (int)batch_count, batch_types);
+
+        for (size_t b = 0; b < batch_count; b++) {
+            d = batch[b];
 
             int name_len = 0;
             while (d->d_name[name_len] && name_len < 255) name_len++;
 
             unsigned char type = TYPE_UNKNOWN;
             if (d->d_type == DT_DIR) type = TYPE_DIR;
-            else if (d->d_type == DT_REG) type = fast_get_type(d->d_name, name_len);
+            else if (d->d_type == DT_REG) type = batch_types[b];
 
-            // Filter early if type is known
-            if (filterMask != 0 && type != TYPE_UNKNOWN && type != TYPE_DIR) {
+            // Filter early if type is known; with sniff, TYPE_FILE may still turn
+            // into a wanted type once its content is read
+            if (filterMask != 0 && type != TYPE_UNKNOWN && type != TYPE_DIR && !(sniff && type == TYPE_FILE)) {
                 if (!((1 << type) & filterMask)) continue;
             }
 
@@ -604,6 +1736,9 @@ Java_com_mewmix_glaive_core_NativeCore_nativeFillBuffer(JNIEnv *env, jobject cla
             count++;
         }
     }
+    free(batch);
+    free(batch_keys);
+    free(batch_types);
     clock_gettime(CLOCK_MONOTONIC, &t1);
 
     // PHASE 2: STAT (PARALLEL or LAZY)
@@ -616,8 +1751,8 @@ Java_com_mewmix_glaive_core_NativeCore_nativeFillBuffer(JNIEnv *env, jobject cla
         if (num_threads > 6) num_threads = 6; // clamp for stat
         if (num_threads < 2) num_threads = 2;
 
-        if (count < 100 || num_threads == 1) {
-            StatWorkerArgs args = { .dirfd = fd, .entries = entries, .start_index = 0, .end_index = count };
+        if (count < 100 || num_threads == 1 || background) {
+            StatWorkerArgs args = { .dirfd = fd, .entries = entries, .start_index = 0, .end_index = count, .background = background, .sniff = sniff };
             stat_worker_thread(&args);
         } else {
             pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * num_threads);
@@ -630,6 +1765,8 @@ Java_com_mewmix_glaive_core_NativeCore_nativeFillBuffer(JNIEnv *env, jobject cla
                 args[i].entries = entries;
                 args[i].start_index = i * chunk;
                 args[i].end_index = (i == num_threads - 1) ? count : (i + 1) * chunk;
+                args[i].background = 0;
+                args[i].sniff = sniff;
                 if (pthread_create(&threads[i], NULL, stat_worker_thread, &args[i]) == 0) {
                     created[i] = 1;
                 } else {
@@ -644,10 +1781,28 @@ Java_com_mewmix_glaive_core_NativeCore_nativeFillBuffer(JNIEnv *env, jobject cla
             free(created);
             free(args);
         }
+    } else if (count > 0 && filterMask != 0) {
+        // The filter below needs the final type of every entry left open by
+        // phase 1, not just of the stat window
+        StatWorkerArgs one = { .dirfd = fd, .entries = entries, .background = background, .sniff = sniff };
+        for (size_t k = 0; k < count; k++) {
+            if (entries[k].type != TYPE_UNKNOWN && !(sniff && entries[k].type == TYPE_FILE)) continue;
+            one.start_index = k;
+            one.end_index = k + 1;
+            stat_worker_thread(&one);
+        }
     }
 
     clock_gettime(CLOCK_MONOTONIC, &t2);
 
+    if (preempted || list_preempted(background)) {
+        free_entries(entries, count);
+        free(kbuf);
+        close(fd);
+        (*env)->ReleaseStringUTFChars(env, jPath, path);
+        return LIST_PREEMPTED;
+    }
+
     // PHASE 3: SORT & OUTPUT (SERIAL)
     g_sort_mode = sortMode;
     g_sort_asc = asc;
@@ -655,10 +1810,12 @@ Java_com_mewmix_glaive_core_NativeCore_nativeFillBuffer(JNIEnv *env, jobject cla
     clock_gettime(CLOCK_MONOTONIC, &t3);
 
     // If we skipped full stat (name/type sort), populate metadata for the visible window
-    if (count > 0 && !need_full_stat) {
-        size_t window = count < 200 ? count : 200;
-        if (window > 0) {
-            StatWorkerArgs argsw = { .dirfd = fd, .entries = entries, .start_index = 0, .end_index = window };
+    if (count > 0 && !need_full_stat && statCount > 0) {
+        size_t from = statFrom > 0 ? (size_t)statFrom : 0;
+        if (from > count) from = count;
+        size_t to = (count - from < (size_t)statCount) ? count : from + statCount;
+        if (to > from) {
+            StatWorkerArgs argsw = { .dirfd = fd, .entries = entries, .start_index = from, .end_index = to, .background = background, .sniff = sniff };
             stat_worker_thread(&argsw);
         }
     }
@@ -702,217 +1859,2509 @@ Java_com_mewmix_glaive_core_NativeCore_nativeFillBuffer(JNIEnv *env, jobject cla
     long out_ms  = (t4.tv_sec - t3.tv_sec) * 1000 + (t4.tv_nsec - t3.tv_nsec) / 1000000;
     int bytes = (int)(head - buffer);
     long stats = atomic_load(&g_stat_calls);
-    LOGE("LIST timings: read=%ldms stat=%ldms sort=%ldms out=%ldms entries=%zu stat_calls=%ld bytes=%d", read_ms, stat_ms, sort_ms, out_ms, count, stats, bytes);
+    GLOG_WITH_TEXT(GLOG_INFO, GLOG_MSG_LIST_TIMINGS, background ? " (background)" : "", read_ms, stat_ms, sort_ms, out_ms, (int64_t)count, stats, bytes);
+    return bytes;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeFillBuffer(JNIEnv *env, jobject clazz, jstring jPath, jobject jBuffer, jint capacity, jint sortMode, jboolean asc, jint filterMask, jint statFrom, jint statCount, jboolean background, jboolean sniffContent) {
+    if (background) {
+        return fill_buffer(env, jPath, jBuffer, capacity, sortMode, asc, filterMask, statFrom, statCount, 1, sniffContent);
+    }
+    atomic_fetch_add(&g_foreground_listings, 1);
+    jint bytes = fill_buffer(env, jPath, jBuffer, capacity, sortMode, asc, filterMask, statFrom, statCount, 0, sniffContent);
+    atomic_fetch_sub(&g_foreground_listings, 1);
     return bytes;
 }
 
+// Types names[i] the way listings do: by extension, and with sniff by the
+// content of files[i] under dir when the extension says nothing. For entries
+// that live under another name, such as Recycle Bin items.
+JNIEXPORT jbyteArray JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeFileTypes(JNIEnv *env, jobject clazz, jstring jDir, jobjectArray jFiles, jobjectArray jNames, jboolean sniff) {
+    jsize count = (*env)->GetArrayLength(env, jNames);
+    if ((*env)->GetArrayLength(env, jFiles) != count) return NULL;
+    unsigned char* types = (unsigned char*)malloc(count > 0 ? count : 1);
+    if (!types) return NULL;
+
+    const char* dir = (*env)->GetStringUTFChars(env, jDir, NULL);
+    int dirfd = dir ? open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+    if (dir) (*env)->ReleaseStringUTFChars(env, jDir, dir);
+
+    struct stat st;
+    for (jsize i = 0; i < count; i++) {
+        jstring jName = (jstring)(*env)->GetObjectArrayElement(env, jNames, i);
+        const char* name = jName ? (*env)->GetStringUTFChars(env, jName, NULL) : NULL;
+        types[i] = name ? fast_get_type(name, (int)strlen(name)) : TYPE_FILE;
+        if (name) (*env)->ReleaseStringUTFChars(env, jName, name);
+        if (jName) (*env)->DeleteLocalRef(env, jName);
+        if (!sniff || types[i] != TYPE_FILE || dirfd < 0) continue;
+
+        jstring jFile = (jstring)(*env)->GetObjectArrayElement(env, jFiles, i);
+        const char* file = jFile ? (*env)->GetStringUTFChars(env, jFile, NULL) : NULL;
+        if (file && fstatat(dirfd, file, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(st.st_mode) && st.st_size >= 4) {
+            types[i] = sniff_file_type(dirfd, file);
+        }
+        if (file) (*env)->ReleaseStringUTFChars(env, jFile, file);
+        if (jFile) (*env)->DeleteLocalRef(env, jFile);
+    }
+    if (dirfd >= 0) close(dirfd);
+
+    jbyteArray out = (*env)->NewByteArray(env, count);
+    if (out && count > 0) (*env)->SetByteArrayRegion(env, out, 0, count, (const jbyte*)types);
+    free(types);
+    return out;
+}
+
 // ==========================================
-// WORKER
+// THUMBNAILS
 // ==========================================
+// Thumbnails of JPEGs come from the Exif IFD1 (or JFIF extension) thumbnail
+// embedded in their first THUMB_HEAD_BYTES, which needs no decoding at all.
+// Files without one are recorded as THUMB_FORMAT_NONE; the caller then falls
+// back to a platform downscale and hands the result back with nativeThumbPut.
+//
+// Results live in one mmap'd cache file: a header, an index of THUMB_SLOTS
+// slots and a data ring. Entries are keyed by a hash of path, mtime and size,
+// so a changed file misses instead of showing a stale picture. Ring positions
+// only grow; a record is intact while the write position is at most one ring
+// size past it, and older records are overwritten in place.
+//
+// Requests wait in a max-heap on (priority, request order). Search pool
+// workers take turns between it and running searches, so the rows the UI
+// asked for last, at the highest priority, are filled first.
+#define THUMB_HEAD_BYTES 65536
+#define THUMB_MAGIC 0x31424d5548544c47ULL  // "GLTHUMB1"
+#define THUMB_HEADER_BYTES 4096
+#define THUMB_SLOTS 16384
+#define THUMB_PROBES 8
+#define THUMB_DATA_BYTES (64 * 1024 * 1024)
+#define THUMB_QUEUE_MAX 4096
+
+#define THUMB_FORMAT_NONE 0         // no embedded thumbnail
+#define THUMB_FORMAT_JPEG 1
+
 typedef struct {
-    WorkQueue* queue;
-    GlobalBuffer* gbuf;
-    const SearchContext* ctx;
-} WorkerArgs;
+    uint64_t magic;
+    uint32_t slots;
+    uint32_t data_bytes;
+    uint64_t write_pos;         // ring position of the next record
+} ThumbFileHeader;
 
-#define LOCAL_BUF_SIZE 65536
+typedef struct {
+    uint64_t key;               // 0 = empty
+    uint64_t pos;
+} ThumbSlot;
 
-void* worker_thread(void* arg) {
-    WorkerArgs* args = (WorkerArgs*)arg;
-    WorkQueue* q = args->queue;
-    GlobalBuffer* gbuf = args->gbuf;
-    const SearchContext* ctx = args->ctx;
+typedef struct {
+    uint64_t key;
+    uint32_t length;            // payload bytes after the record
+    uint8_t format;             // THUMB_FORMAT_*
+    uint8_t orientation;        // Exif orientation 1-8, 0 = unknown
+    uint16_t reserved;
+} ThumbRecord;
 
-    unsigned char local_buf[LOCAL_BUF_SIZE];
-    unsigned char* head = local_buf;
-    unsigned char* end = local_buf + LOCAL_BUF_SIZE;
+typedef struct {
+    char* path;
+    uint64_t key;
+    int priority;
+    uint64_t seq;
+} ThumbJob;
 
-    // Reuse a single getdents buffer per worker to avoid per-directory malloc/free
-    size_t kbuf_size2 = 65536; // 64KB
-    char* kbuf2 = (char*)malloc(kbuf_size2);
-    if (!kbuf2) {
-        // Fallback to a smaller stack buffer path by exiting quickly
-        return NULL;
+typedef struct {
+    pthread_mutex_t lock;       // the mapping
+    unsigned char* map;
+    size_t map_bytes;
+    ThumbFileHeader* header;
+    ThumbSlot* slots;
+    unsigned char* data;
+    atomic_int version;         // bumped whenever a request completes
+
+    // Guarded by the search pool lock
+    ThumbJob* queue;            // max-heap, see thumb_job_before()
+    int queued;
+    uint64_t next_seq;
+    int turn;                   // alternates workers between searches and thumbnails
+} ThumbCache;
+
+static ThumbCache g_thumbs = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint64_t thumb_key(const char* path, int64_t mtime, int64_t size) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const unsigned char* p = (const unsigned char*)path; *p; p++) {
+        h = (h ^ *p) * 0x100000001b3ULL;
+    }
+    h ^= (uint64_t)mtime * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)size * 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 29;
+    return h ? h : 1;
+}
+
+// Rows outside a listing's stat window carry no mtime or size; those are keyed
+// on the file as it is now, so an edited file never hits its old thumbnail.
+static uint64_t thumb_key_for(const char* path, int64_t mtime, int64_t size) {
+    struct stat st;
+    if (mtime == 0 && size == 0 && stat(path, &st) == 0) {
+        mtime = st.st_mtime;
+        size = st.st_size;
+    }
+    return thumb_key(path, mtime, size);
+}
+
+// Thumbs lock held. The slot holding key with an intact record, or NULL.
+static ThumbSlot* thumb_find_locked(uint64_t key) {
+    ThumbCache* c = &g_thumbs;
+    if (!c->map) return NULL;
+    for (int i = 0; i < THUMB_PROBES; i++) {
+        ThumbSlot* slot = &c->slots[(key + i) & (THUMB_SLOTS - 1)];
+        if (slot->key != key) continue;
+        if (c->header->write_pos - slot->pos > THUMB_DATA_BYTES) return NULL;
+        ThumbRecord* rec = (ThumbRecord*)(c->data + slot->pos % THUMB_DATA_BYTES);
+        return rec->key == key ? slot : NULL;
+    }
+    return NULL;
+}
+
+// Thumbs lock held. Appends a record to the ring and points key's slot at it,
+// taking over an empty or overwritten slot first, else the oldest one.
+static int thumb_store_locked(uint64_t key, int format, int orientation, const void* payload, uint32_t length) {
+    ThumbCache* c = &g_thumbs;
+    if (!c->map) return 0;
+    size_t need = (sizeof(ThumbRecord) + length + 7) & ~(size_t)7;
+    if (need > THUMB_DATA_BYTES / 16) return 0;
+
+    uint64_t pos = c->header->write_pos;
+    uint64_t off = pos % THUMB_DATA_BYTES;
+    if (off + need > THUMB_DATA_BYTES) {
+        pos += THUMB_DATA_BYTES - off;
+        off = 0;
     }
+    ThumbRecord* rec = (ThumbRecord*)(c->data + off);
+    rec->key = key;
+    rec->length = length;
+    rec->format = (uint8_t)format;
+    rec->orientation = (uint8_t)orientation;
+    rec->reserved = 0;
+    if (length) memcpy(rec + 1, payload, length);
+    c->header->write_pos = pos + need;
 
-    while (1) {
-        if (atomic_load(&g_cancel_search)) {
-            pthread_mutex_lock(&q->lock);
-            q->shutdown = 1;
-            pthread_cond_broadcast(&q->cond);
-            pthread_mutex_unlock(&q->lock);
+    ThumbSlot* victim = NULL;
+    for (int i = 0; i < THUMB_PROBES; i++) {
+        ThumbSlot* slot = &c->slots[(key + i) & (THUMB_SLOTS - 1)];
+        if (slot->key == key || slot->key == 0 || c->header->write_pos - slot->pos > THUMB_DATA_BYTES) {
+            victim = slot;
             break;
         }
+        if (!victim || slot->pos < victim->pos) victim = slot;
+    }
+    victim->key = key;
+    victim->pos = pos;
+    return 1;
+}
 
-        WorkItem* item = queue_pop(q);
-        if (!item) break;
+static inline uint32_t thumb_rd16(const unsigned char* p, int le) {
+    return le ? (uint32_t)(p[0] | p[1] << 8) : (uint32_t)(p[0] << 8 | p[1]);
+}
 
-        int fd = open(item->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
-        if (fd != -1) {
-            struct linux_dirent64 *d;
-            int nread;
+static inline uint32_t thumb_rd32(const unsigned char* p, int le) {
+    return le ? ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24)
+              : ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3]);
+}
 
-            while ((nread = syscall(__NR_getdents64, fd, kbuf2, kbuf_size2)) > 0) {
-                if (atomic_load(&g_cancel_search)) break;
+// Byte offset of the entries of the IFD at ifd, or 0 when its count, entries
+// and next-IFD link do not all fit in n.
+static size_t exif_ifd(const unsigned char* tiff, size_t n, uint32_t ifd, int le, uint32_t* count) {
+    if (ifd < 8 || ifd > n || n - ifd < 6) return 0;
+    *count = thumb_rd16(tiff + ifd, le);
+    if (*count > (n - ifd - 6) / 12) return 0;
+    return ifd + 2;
+}
 
-                int bpos = 0;
-                while (bpos < nread) {
-                    d = (struct linux_dirent64 *)(kbuf2 + bpos);
-                    bpos += d->d_reclen;
-                    if (d->d_name[0] == '.') continue;
+// The IFD1 thumbnail of an Exif TIFF block, and the IFD0 orientation.
+static int exif_thumbnail(const unsigned char* tiff, size_t n, size_t* off, size_t* len, int* orientation) {
+    if (n < 16) return 0;
+    int le;
+    if (tiff[0] == 'I' && tiff[1] == 'I') le = 1;
+    else if (tiff[0] == 'M' && tiff[1] == 'M') le = 0;
+    else return 0;
+    if (thumb_rd16(tiff + 2, le) != 42) return 0;
 
-                    int name_len = 0;
-                    while (d->d_name[name_len]) name_len++;
+    uint32_t count;
+    size_t entries = exif_ifd(tiff, n, thumb_rd32(tiff + 4, le), le, &count);
+    if (!entries) return 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const unsigned char* e = tiff + entries + 12 * i;
+        // SHORT values sit in the first half of the value field in both byte orders
+        if (thumb_rd16(e, le) == 0x0112) *orientation = (int)thumb_rd16(e + 8, le);
+    }
 
-                    unsigned char type = DT_UNKNOWN;
-                    if (d->d_type == DT_DIR) type = DT_DIR;
-                    else if (d->d_type == DT_REG) type = DT_REG;
-                    else {
-                        struct stat st;
-                        if (fstatat(fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
-                            if (S_ISDIR(st.st_mode)) type = DT_DIR; else type = DT_REG;
-                        }
-                    }
+    entries = exif_ifd(tiff, n, thumb_rd32(tiff + entries + 12 * count, le), le, &count);
+    if (!entries) return 0;
+    uint32_t at = 0, size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const unsigned char* e = tiff + entries + 12 * i;
+        uint32_t tag = thumb_rd16(e, le);
+        if (tag == 0x0201) at = thumb_rd32(e + 8, le);          // JPEGInterchangeFormat
+        else if (tag == 0x0202) size = thumb_rd32(e + 8, le);   // JPEGInterchangeFormatLength
+    }
+    if (at == 0 || size < 4 || at > n || size > n - at) return 0;
+    if (tiff[at] != 0xFF || tiff[at + 1] != 0xD8) return 0;
+    *off = at;
+    *len = size;
+    return 1;
+}
 
-                    if (type == DT_DIR) {
-                         size_t child_len = item->len + 1 + name_len;
-                         char* child_path = malloc(child_len + 1);
-                         memcpy(child_path, item->path, item->len);
-                         child_path[item->len] = '/';
-                         memcpy(child_path + item->len + 1, d->d_name, name_len + 1);
-                         queue_push(q, child_path, child_len);
-                    } else {
-                        if (optimized_matches_query(d->d_name, name_len, ctx)) {
-                            unsigned char g_type = fast_get_type(d->d_name, name_len);
-                            if (ctx->filterMask != 0) {
-                                if (!((1 << g_type) & ctx->filterMask)) continue;
-                            }
+// Finds the JPEG thumbnail embedded in the head of a JPEG file by walking its
+// marker segments up to the image data. Returns 0 when there is none.
+static int thumb_find_embedded(const unsigned char* b, size_t n, size_t* off, size_t* len, int* orientation) {
+    *orientation = 0;
+    if (n < 4 || b[0] != 0xFF || b[1] != 0xD8) return 0;
+    size_t p = 2;
+    while (p + 4 <= n) {
+        if (b[p] != 0xFF) return 0;
+        unsigned char marker = b[p + 1];
+        if (marker == 0xFF) {
+            p++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            p += 2;
+            continue;
+        }
+        if (marker == 0xDA || marker == 0xD9) return 0;
 
-                            size_t full_len = item->len + 1 + name_len;
-                            size_t base_index = (gbuf->base_len + 1 <= item->len) ? (gbuf->base_len + 1) : item->len;
-                            size_t rel_len = full_len - base_index;
+        size_t seg = thumb_rd16(b + p + 2, 0);
+        if (seg < 2) return 0;
+        const unsigned char* s = b + p + 4;
+        size_t avail = seg - 2;
+        if (avail > n - p - 4) avail = n - p - 4;
 
-                            if (head + 18 + rel_len > end) {
-                                gbuf_write(gbuf, local_buf, head - local_buf);
-                                head = local_buf;
-                            }
+        if (marker == 0xE1 && avail > 6 && !memcmp(s, "Exif\0\0", 6)) {
+            if (exif_thumbnail(s + 6, avail - 6, off, len, orientation)) {
+                *off += (size_t)(s + 6 - b);
+                return 1;
+            }
+        } else if (marker == 0xE0 && avail == seg - 2 && avail > 10 && !memcmp(s, "JFXX\0", 5) && s[5] == 0x10) {
+            *off = (size_t)(s + 6 - b);
+            *len = avail - 6;
+            return 1;
+        }
+        p += 2 + seg;
+    }
+    return 0;
+}
 
-                            int proto_len = (rel_len > 255) ? 255 : (int)rel_len;
-                            if (head + 18 + proto_len <= end) {
-                                *head++ = g_type;
-                                *head++ = (unsigned char)proto_len;
-
-                                char* base_ptr = item->path + base_index;
-                                size_t prefix_len = (item->len > base_index) ? (item->len - base_index) : 0;
-                                if (prefix_len > 0) {
-                                    size_t copy_len = (prefix_len > proto_len) ? proto_len : prefix_len;
-                                    memcpy(head, base_ptr, copy_len);
-                                    if (copy_len < proto_len) {
-                                        head[copy_len] = '/';
-                                        size_t rem = proto_len - copy_len - 1;
-                                        if (rem > name_len) rem = name_len;
-                                        memcpy(head + copy_len + 1, d->d_name, rem);
-                                    }
-                                } else {
-                                     size_t copy_len = (name_len > proto_len) ? proto_len : name_len;
-                                     memcpy(head, d->d_name, copy_len);
-                                }
-
-                                head += proto_len;
-                                memset(head, 0, 16);
-                                head += 16;
-                            }
-                        }
-                    }
-                }
+// Opens or creates the cache file. A file with another layout is started over.
+static int thumb_cache_open(const char* path) {
+    ThumbCache* c = &g_thumbs;
+    size_t total = THUMB_HEADER_BYTES + THUMB_SLOTS * sizeof(ThumbSlot) + THUMB_DATA_BYTES;
+    pthread_mutex_lock(&c->lock);
+    if (c->map) {
+        pthread_mutex_unlock(&c->lock);
+        return 1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        pthread_mutex_unlock(&c->lock);
+        return 0;
+    }
+    struct stat st;
+    ThumbFileHeader existing = {0};
+    int valid = fstat(fd, &st) == 0 && (size_t)st.st_size == total &&
+                pread(fd, &existing, sizeof(existing), 0) == (ssize_t)sizeof(existing) &&
+                existing.magic == THUMB_MAGIC && existing.slots == THUMB_SLOTS &&
+                existing.data_bytes == THUMB_DATA_BYTES;
+    if (!valid && (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)total) != 0)) {
+        close(fd);
+        pthread_mutex_unlock(&c->lock);
+        return 0;
+    }
+    // Reserve every block up front, also for files an older build left sparse:
+    // a write fault on an unbacked page of a full disk would be SIGBUS
+    if (posix_fallocate(fd, 0, (off_t)total) != 0) {
+        if (!valid) ftruncate(fd, 0);
+        close(fd);
+        pthread_mutex_unlock(&c->lock);
+        return 0;
+    }
+    void* map = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        pthread_mutex_unlock(&c->lock);
+        return 0;
+    }
+    c->map = (unsigned char*)map;
+    c->map_bytes = total;
+    c->header = (ThumbFileHeader*)map;
+    c->slots = (ThumbSlot*)(c->map + THUMB_HEADER_BYTES);
+    c->data = c->map + THUMB_HEADER_BYTES + THUMB_SLOTS * sizeof(ThumbSlot);
+    if (!valid) {
+        c->header->slots = THUMB_SLOTS;
+        c->header->data_bytes = THUMB_DATA_BYTES;
+        c->header->write_pos = 0;
+        c->header->magic = THUMB_MAGIC;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return 1;
+}
+
+static inline int thumb_job_before(const ThumbJob* a, const ThumbJob* b) {
+    if (a->priority != b->priority) return a->priority > b->priority;
+    return a->seq < b->seq;
+}
+
+static void thumb_sift_up(int i) {
+    ThumbJob* q = g_thumbs.queue;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!thumb_job_before(&q[i], &q[parent])) break;
+        ThumbJob t = q[i];
+        q[i] = q[parent];
+        q[parent] = t;
+        i = parent;
+    }
+}
+
+static void thumb_sift_down(int i) {
+    ThumbJob* q = g_thumbs.queue;
+    int n = g_thumbs.queued;
+    for (;;) {
+        int best = i;
+        int l = 2 * i + 1;
+        int r = l + 1;
+        if (l < n && thumb_job_before(&q[l], &q[best])) best = l;
+        if (r < n && thumb_job_before(&q[r], &q[best])) best = r;
+        if (best == i) return;
+        ThumbJob t = q[i];
+        q[i] = q[best];
+        q[best] = t;
+        i = best;
+    }
+}
+
+// Pool lock held. Removes queue entry i.
+static void thumb_remove_locked(int i) {
+    ThumbCache* c = &g_thumbs;
+    free(c->queue[i].path);
+    c->queued--;
+    if (i == c->queued) return;
+    c->queue[i] = c->queue[c->queued];
+    thumb_sift_up(i);
+    thumb_sift_down(i);
+}
+
+// Pool lock held. Queues path, or raises the priority of its pending request.
+// A full queue gives up its lowest priority request for a higher one.
+static int thumb_enqueue_locked(const char* path, uint64_t key, int priority) {
+    ThumbCache* c = &g_thumbs;
+    if (!c->queue) {
+        c->queue = (ThumbJob*)malloc(THUMB_QUEUE_MAX * sizeof(ThumbJob));
+        if (!c->queue) return 0;
+    }
+    int lowest = -1;
+    for (int i = 0; i < c->queued; i++) {
+        if (c->queue[i].key == key) {
+            if (priority > c->queue[i].priority) {
+                c->queue[i].priority = priority;
+                thumb_sift_up(i);
             }
-            close(fd);
+            return 1;
         }
-        free(item->path);
-        free(item);
-        queue_worker_done(q);
+        if (lowest < 0 || thumb_job_before(&c->queue[lowest], &c->queue[i])) lowest = i;
     }
-    if (head > local_buf) {
-        gbuf_write(gbuf, local_buf, head - local_buf);
+    if (c->queued == THUMB_QUEUE_MAX) {
+        if (c->queue[lowest].priority >= priority) return 0;
+        thumb_remove_locked(lowest);
     }
-    free(kbuf2);
-    return NULL;
+    char* copy = strdup(path);
+    if (!copy) return 0;
+    ThumbJob* job = &c->queue[c->queued];
+    job->path = copy;
+    job->key = key;
+    job->priority = priority;
+    job->seq = c->next_seq++;
+    c->queued++;
+    thumb_sift_up(c->queued - 1);
+    return 1;
+}
+
+// Pool lock held. Drops the pending request for key, if any, unless it was
+// raised to below or above.
+static void thumb_cancel_locked(uint64_t key, int below) {
+    ThumbCache* c = &g_thumbs;
+    for (int i = 0; i < c->queued; i++) {
+        if (c->queue[i].key == key) {
+            if (c->queue[i].priority < below) thumb_remove_locked(i);
+            return;
+        }
+    }
+}
+
+// Pool lock held. Whether a worker should serve a thumbnail this turn: always
+// when no search has work queued, every other turn otherwise.
+static int thumb_take_turn_locked(int searches_waiting) {
+    ThumbCache* c = &g_thumbs;
+    if (c->queued == 0) return 0;
+    if (!searches_waiting) return 1;
+    c->turn = !c->turn;
+    return c->turn;
+}
+
+// Pool lock held on entry and exit. Runs the best queued request, reading the
+// file head into buf.
+static void thumb_run_job_locked(unsigned char* buf, size_t buf_size) {
+    ThumbCache* c = &g_thumbs;
+    ThumbJob job = c->queue[0];
+    c->queued--;
+    if (c->queued > 0) {
+        c->queue[0] = c->queue[c->queued];
+        thumb_sift_down(0);
+    }
+    pthread_mutex_unlock(&g_search_pool.lock);
+
+    // Callers ask again while they wait, so a request may come back after it was served
+    pthread_mutex_lock(&c->lock);
+    int done = thumb_find_locked(job.key) != NULL;
+    pthread_mutex_unlock(&c->lock);
+    if (done) {
+        free(job.path);
+        pthread_mutex_lock(&g_search_pool.lock);
+        return;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    size_t want = buf_size < THUMB_HEAD_BYTES ? buf_size : THUMB_HEAD_BYTES;
+    ssize_t n = -1;
+    uint64_t key = job.key;
+    struct stat st;
+    int fd = open(job.path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        // Key what was actually read; the request may predate a change to the file
+        if (fstat(fd, &st) == 0) key = thumb_key(job.path, st.st_mtime, st.st_size);
+        n = pread(fd, buf, want, 0);
+        close(fd);
+    }
+    size_t off = 0, len = 0;
+    int orientation = 0;
+    int found = n > 0 && thumb_find_embedded(buf, (size_t)n, &off, &len, &orientation);
+
+    pthread_mutex_lock(&c->lock);
+    int format = found ? THUMB_FORMAT_JPEG : THUMB_FORMAT_NONE;
+    thumb_store_locked(key, format, orientation, buf + off, found ? (uint32_t)len : 0);
+    // The waiting caller still asks under the key it requested; it gets the current picture
+    if (key != job.key) thumb_store_locked(job.key, format, orientation, buf + off, found ? (uint32_t)len : 0);
+    pthread_mutex_unlock(&c->lock);
+    atomic_fetch_add(&c->version, 1);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long us = (t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000;
+    GLOG_WITH_TEXT(GLOG_DEBUG, GLOG_MSG_THUMB, job.path, found ? (int)len : -1, us);
+    free(job.path);
+
+    pthread_mutex_lock(&g_search_pool.lock);
 }
 
 // ==========================================
-// JNI INTERFACE (SEARCH)
+// WORKER
 // ==========================================
+#define LOCAL_BUF_SIZE 65536
+#define SEARCH_KBUF_SIZE 65536
 
-JNIEXPORT jint JNICALL
-Java_com_mewmix_glaive_core_NativeCore_nativeSearch(JNIEnv *env, jobject clazz, jstring jRoot, jstring jQuery, jobject jBuffer, jint capacity, jint filterMask) {
-    if (capacity <= 0) return 0;
-    if (atomic_load(&g_cancel_search)) return 0;
+#define SEARCH_RECORD_MAX (18 + 255)
 
-    const char *root = (*env)->GetStringUTFChars(env, jRoot, NULL);
-    const char *query = (*env)->GetStringUTFChars(env, jQuery, NULL);
-    unsigned char *buffer = (*env)->GetDirectBufferAddress(env, jBuffer);
+// Encodes one result record, with the path relative to the search root, into
+// out (SEARCH_RECORD_MAX bytes). Returns the record length.
+static int encode_search_record(unsigned char* out, const GlobalBuffer* gbuf, const WorkItem* item,
+                                const char* name, int name_len, unsigned char type,
+                                int64_t size, int64_t mtime) {
+    size_t base_index = (gbuf->base_len + 1 <= item->len) ? (gbuf->base_len + 1) : item->len;
+    size_t prefix_len = item->len - base_index;
+    size_t rel_len = prefix_len ? prefix_len + 1 + name_len : (size_t)name_len;
+    int proto_len = (rel_len > 255) ? 255 : (int)rel_len;
 
-    if (!buffer) {
-        (*env)->ReleaseStringUTFChars(env, jRoot, root);
-        (*env)->ReleaseStringUTFChars(env, jQuery, query);
-        return -2;
+    unsigned char* head = out;
+    *head++ = type;
+    *head++ = (unsigned char)proto_len;
+    if (prefix_len > 0) {
+        size_t copy_len = (prefix_len > proto_len) ? proto_len : prefix_len;
+        memcpy(head, item->path + base_index, copy_len);
+        if (copy_len < proto_len) {
+            head[copy_len] = '/';
+            size_t rem = proto_len - copy_len - 1;
+            if (rem > name_len) rem = name_len;
+            memcpy(head + copy_len + 1, name, rem);
+        }
+    } else {
+        memcpy(head, name, proto_len);
     }
+    head += proto_len;
+    memcpy(head, &size, 8);
+    memcpy(head + 8, &mtime, 8);
+    return 18 + proto_len;
+}
 
-    SearchContext ctx;
-    setup_search_context(&ctx, query, filterMask);
+// Scans one directory of a session: subdirectories are queued back as one
+// batch at the end. Unranked matches go through local_buf into the session
+// buffer; ranked matches are stat'ed, scored and offered to the top-K heap.
+// Scan sessions offer every filtered file; they only ask for size and mtime,
+// which FUSE serves from one attribute cache entry.
+static void search_scan_dir(SearchSession* s, WorkItem* item, char* kbuf2, unsigned char* local_buf) {
+    const SearchContext* ctx = s->ctx;
+    const PruneRules* prune = s->prune;
+    GlobalBuffer* gbuf = s->gbuf;
+    const int ranked = s->top_k > 0;
+    const int scan = s->scan_order;
+    const int depth_penalty = item->depth * SEARCH_DEPTH_PENALTY;
+    unsigned char* head = local_buf;
+    unsigned char* end = local_buf + LOCAL_BUF_SIZE;
+    unsigned char rec[SEARCH_RECORD_MAX];
+    WorkItem* children = NULL;
+    WorkItem* children_tail = NULL;
+    int stop = 0;
 
-    size_t root_len = strlen(root);
-    size_t base_len = root_len;
-    if (base_len > 1 && root[base_len - 1] == '/') base_len--;
+    int fd = open(item->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1 && (prune->flags & PRUNE_SAME_FS) && item->depth > 0) {
+        struct stat dst;
+        if (fstat(fd, &dst) != 0 || dst.st_dev != s->root_dev) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd != -1) {
+        struct linux_dirent64 *d;
+        int nread;
 
-    GlobalBuffer gbuf;
-    gbuf_init(&gbuf, buffer, capacity, base_len);
+        while (!stop && (nread = syscall(__NR_getdents64, fd, kbuf2, SEARCH_KBUF_SIZE)) > 0) {
+            if (session_should_stop(s)) break;
 
-    WorkQueue q;
-    queue_init(&q);
+            int bpos = 0;
+            while (bpos < nread) {
+                d = (struct linux_dirent64 *)(kbuf2 + bpos);
+                bpos += d->d_reclen;
+                if (d->d_name[0] == '.') {
+                    if (d->d_name[1] == 0) continue;
+                    if (d->d_name[1] == '.' && d->d_name[2] == 0) continue;
+                    if (prune_skip_hidden(prune, d->d_name)) continue;
+                }
 
-    char* root_dup = malloc(base_len + 1);
-    memcpy(root_dup, root, base_len);
-    root_dup[base_len] = 0;
-    queue_push(&q, root_dup, base_len);
+                int name_len = 0;
+                while (d->d_name[name_len]) name_len++;
 
-    long cores = sysconf(_SC_NPROCESSORS_ONLN);
-    if (cores < 1) cores = 4;
-    int NUM_THREADS = (int)cores;
-    if (NUM_THREADS < 2) NUM_THREADS = 2;
-    if (NUM_THREADS > 8) NUM_THREADS = 8;
-    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * NUM_THREADS);
-    WorkerArgs args = { .queue = &q, .gbuf = &gbuf, .ctx = &ctx };
+                LiteStat st;
+                int have_st = 0;
+                unsigned char type = DT_UNKNOWN;
+                if (d->d_type == DT_DIR) type = DT_DIR;
+                else if (d->d_type == DT_REG) type = DT_REG;
+                else {
+                    if (lite_stat(fd, d->d_name, STAT_WANT_TYPE | STAT_WANT_MTIME | STAT_WANT_SIZE, &st) == 0) {
+                        have_st = 1;
+                        type = st.is_dir ? DT_DIR : DT_REG;
+                    }
+                }
+
+                if (type == DT_DIR) {
+                     if (prune_skip_dir(prune, item->path, item->len, d->d_name, name_len, item->depth + 1)) continue;
+                     size_t child_len = item->len + 1 + name_len;
+                     char* child_path = malloc(child_len + 1);
+                     WorkItem* child = (WorkItem*)malloc(sizeof(WorkItem));
+                     if (!child_path || !child) {
+                         free(child_path);
+                         free(child);
+                         continue;
+                     }
+                     memcpy(child_path, item->path, item->len);
+                     child_path[item->len] = '/';
+                     memcpy(child_path + item->len + 1, d->d_name, name_len + 1);
+                     child->path = child_path;
+                     child->len = child_len;
+                     child->depth = item->depth + 1;
+                     child->prio = child->depth * (SEARCH_RECENCY_BUCKETS + 1);
+                     if (ranked && scan != SEARCH_SCAN_LARGEST) {
+                         // Recently modified trees first within a depth
+                         if (have_st || lite_stat(fd, d->d_name, STAT_WANT_MTIME, &st) == 0) {
+                             child->prio -= recency_bucket(st.mtime, s->now_sec);
+                         }
+                     }
+                     child->next = NULL;
+                     if (children_tail) children_tail->next = child;
+                     else children = child;
+                     children_tail = child;
+                } else if (scan) {
+                    unsigned char g_type = fast_get_type(d->d_name, name_len);
+                    if (ctx->filterMask != 0 && !((1 << g_type) & ctx->filterMask)) continue;
+                    atomic_fetch_add(&s->results, 1);
+                    if (!have_st && lite_stat(fd, d->d_name, STAT_WANT_MTIME | STAT_WANT_SIZE, &st) != 0) continue;
+                    // Empty files never rank as largest, nor files without an mtime as recent
+                    if (scan == SEARCH_SCAN_LARGEST && st.size <= 0) continue;
+                    if (scan == SEARCH_SCAN_RECENT && st.mtime <= 0) continue;
+                    int64_t key = scan == SEARCH_SCAN_LARGEST ? st.size : st.mtime;
+                    if (key < atomic_load(&s->hit_floor)) continue;
+                    int len = encode_search_record(rec, gbuf, item, d->d_name, name_len, g_type, st.size, st.mtime);
+                    session_offer_hit(s, key, rec, len);
+                } else {
+                    int match = optimized_matches_query(d->d_name, name_len, ctx);
+                    if (match) {
+                        unsigned char g_type = fast_get_type(d->d_name, name_len);
+                        if (ctx->filterMask != 0) {
+                            if (!((1 << g_type) & ctx->filterMask)) continue;
+                        }
+
+                        int seen = atomic_fetch_add(&s->results, 1);
+
+                        if (ranked) {
+                            int score = search_name_score(d->d_name, name_len, match, ctx) - depth_penalty;
+                            // Skip the stat when even the best recency cannot make the cut
+                            int64_t floor = atomic_load(&s->hit_floor);
+                            if (score + SEARCH_RECENCY_BUCKETS * SEARCH_SCORE_RECENCY < floor) continue;
+                            if (!have_st && lite_stat(fd, d->d_name, STAT_WANT_MTIME | STAT_WANT_SIZE, &st) != 0) continue;
+                            score += recency_bucket(st.mtime, s->now_sec) * SEARCH_SCORE_RECENCY;
+                            if (score < 1) score = 1;
+                            int len = encode_search_record(rec, gbuf, item, d->d_name, name_len, g_type,
+                                                           st.size, st.mtime);
+                            session_offer_hit(s, score, rec, len);
+                            continue;
+                        }
 
-    for (int i = 0; i < NUM_THREADS; i++) {
-        pthread_create(&threads[i], NULL, worker_thread, &args);
+                        if (s->max_results > 0 && seen >= s->max_results) {
+                            atomic_fetch_or(&s->status, SEARCH_STATUS_CAPPED);
+                            stop = 1;
+                            break;
+                        }
+
+                        if (head + SEARCH_RECORD_MAX > end) {
+                            if (!gbuf_write(gbuf, local_buf, head - local_buf)) {
+                                atomic_fetch_or(&s->status, SEARCH_STATUS_CAPPED);
+                                stop = 1;
+                                break;
+                            }
+                            head = local_buf;
+                        }
+                        head += encode_search_record(head, gbuf, item, d->d_name, name_len, g_type, 0, 0);
+                    }
+                }
+            }
+        }
+        close(fd);
     }
-    for (int i = 0; i < NUM_THREADS; i++) {
-        pthread_join(threads[i], NULL);
+
+    if (head > local_buf && !gbuf_write(gbuf, local_buf, head - local_buf)) {
+        atomic_fetch_or(&s->status, SEARCH_STATUS_CAPPED);
     }
-    free(threads);
 
-    queue_destroy(&q);
-    int result_len = (int)(gbuf.current - gbuf.start);
-    gbuf_destroy(&gbuf);
+    if (children && !session_should_stop(s)) {
+        pthread_mutex_lock(&g_search_pool.lock);
+        session_push_locked(s, children);
+        pthread_mutex_unlock(&g_search_pool.lock);
+    } else {
+        free_work_items(children);
+    }
+}
 
-    (*env)->ReleaseStringUTFChars(env, jRoot, root);
-    (*env)->ReleaseStringUTFChars(env, jQuery, query);
-    return result_len;
+// Pool lock held on entry and exit. Runs one directory of the session.
+static void session_run_item_locked(SearchSession* s, char* kbuf, unsigned char* local_buf) {
+    WorkItem* item = session_take_locked(s);
+    if (session_depth_exhausted(s, item->depth)) session_drop_queue_locked(s);
+    pthread_mutex_unlock(&g_search_pool.lock);
+
+    if (!session_should_stop(s) && !session_depth_exhausted(s, item->depth)) {
+        search_scan_dir(s, item, kbuf, local_buf);
+    }
+    free(item->path);
+    free(item);
+
+    pthread_mutex_lock(&g_search_pool.lock);
+    s->active--;
+    session_settle_locked(s);
 }
 
-// ==========================================
-// LEGACY / UTILS
-// ==========================================
+void* search_pool_worker(void* arg) {
+    char* kbuf = (char*)malloc(SEARCH_KBUF_SIZE);
+    unsigned char* local_buf = (unsigned char*)malloc(LOCAL_BUF_SIZE);
+    SearchPool* p = &g_search_pool;
 
-int64_t calculate_dir_size_recursive(int parent_fd, const char *path) {
-    int64_t total_size = 0;
-    struct stat st;
-    int dir_fd = openat(parent_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
-    if (dir_fd == -1) return 0;
-    char kbuf[8192] __attribute__((aligned(8)));
-    struct linux_dirent64 *d;
-    int nread;
+    pthread_mutex_lock(&p->lock);
+    if (!kbuf || !local_buf) {
+        p->threads--;
+        pthread_mutex_unlock(&p->lock);
+        free(kbuf);
+        free(local_buf);
+        return NULL;
+    }
+    for (;;) {
+        SearchSession* s = pool_next_session_locked();
+        if (thumb_take_turn_locked(s != NULL)) {
+            thumb_run_job_locked((unsigned char*)kbuf, SEARCH_KBUF_SIZE);
+            continue;
+        }
+        if (!s) {
+            pthread_cond_wait(&p->work, &p->lock);
+            continue;
+        }
+        session_run_item_locked(s, kbuf, local_buf);
+    }
+    return NULL;
+}
+
+// Pool lock held. Workers live for the whole process and idle on the pool cond.
+static void search_pool_start_locked(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 4;
+    int target = (int)cores;
+    if (target < 2) target = 2;
+    if (target > 8) target = 8;
+
+    SearchPool* p = &g_search_pool;
+    if (p->threads >= target) return;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (p->threads < target) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, search_pool_worker, NULL) != 0) break;
+        p->threads++;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+// ==========================================
+// JNI INTERFACE (SEARCH)
+// ==========================================
+
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSearchCreate(JNIEnv *env, jobject clazz, jlong timeBudgetMs, jint maxResults, jboolean ranked, jint scanOrder) {
+    SearchSession* s = (SearchSession*)calloc(1, sizeof(SearchSession));
+    if (!s) return 0;
+    atomic_init(&s->status, 0);
+    atomic_init(&s->results, 0);
+    atomic_init(&s->hit_floor, 0);
+    atomic_init(&s->hit_version, 0);
+    s->budget_ms = timeBudgetMs > 0 ? timeBudgetMs : 0;
+    if (scanOrder == SEARCH_SCAN_RECENT || scanOrder == SEARCH_SCAN_LARGEST) {
+        s->scan_order = scanOrder;
+        ranked = JNI_TRUE;
+    }
+    if (ranked) {
+        // "Best N": maxResults sizes the top-K heap instead of stopping the walk
+        s->top_k = maxResults > 0 ? maxResults : SEARCH_DEFAULT_TOP_K;
+        if (s->top_k > SEARCH_MAX_TOP_K) s->top_k = SEARCH_MAX_TOP_K;
+        s->hits = (SearchHit*)malloc(s->top_k * sizeof(SearchHit));
+        if (!s->hits) {
+            free(s);
+            return 0;
+        }
+    } else {
+        s->max_results = maxResults > 0 ? maxResults : 0;
+    }
+    pthread_mutex_init(&s->hits_lock, NULL);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->done, &attr);
+    pthread_condattr_destroy(&attr);
+    return (jlong)(intptr_t)s;
+}
+
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSearchCancel(JNIEnv *env, jobject clazz, jlong handle) {
+    SearchSession* s = (SearchSession*)(intptr_t)handle;
+    if (!s) return;
+    atomic_fetch_or(&s->status, SEARCH_STATUS_CANCELLED);
+    pthread_mutex_lock(&g_search_pool.lock);
+    session_settle_locked(s);
+    pthread_mutex_unlock(&g_search_pool.lock);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSearchStatus(JNIEnv *env, jobject clazz, jlong handle) {
+    SearchSession* s = (SearchSession*)(intptr_t)handle;
+    return s ? atomic_load(&s->status) : 0;
+}
+
+// Changes whenever the top-K heap of a running session does.
+JNIEXPORT jint JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSearchHitVersion(JNIEnv *env, jobject clazz, jlong handle) {
+    SearchSession* s = (SearchSession*)(intptr_t)handle;
+    return s ? atomic_load(&s->hit_version) : 0;
+}
+
+// Writes the current top-K of a ranked session, best first, into buffer while
+// the walk goes on, leaving the heap untouched. Returns the bytes written;
+// records that do not fit are left out.
+JNIEXPORT jint JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSearchSnapshot(JNIEnv *env, jobject clazz, jlong handle, jobject jBuffer, jint capacity) {
+    SearchSession* s = (SearchSession*)(intptr_t)handle;
+    if (!s || !s->top_k || capacity <= 0) return 0;
+    unsigned char *buffer = (*env)->GetDirectBufferAddress(env, jBuffer);
+    if (!buffer) return -2;
+
+    pthread_mutex_lock(&s->hits_lock);
+    int n = s->hit_count;
+    SearchHit* sorted = n ? (SearchHit*)malloc(n * sizeof(SearchHit)) : NULL;
+    int written = 0;
+    if (sorted) {
+        memcpy(sorted, s->hits, n * sizeof(SearchHit));
+        qsort(sorted, n, sizeof(SearchHit), compare_hits_desc);
+        for (int i = 0; i < n && written + sorted[i].len <= capacity; i++) {
+            memcpy(buffer + written, sorted[i].rec, sorted[i].len);
+            written += sorted[i].len;
+        }
+    }
+    pthread_mutex_unlock(&s->hits_lock);
+    free(sorted);
+    return written;
+}
+
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSearchDestroy(JNIEnv *env, jobject clazz, jlong handle) {
+    SearchSession* s = (SearchSession*)(intptr_t)handle;
+    if (!s) return;
+    for (int i = 0; i < s->hit_count; i++) free(s->hits[i].rec);
+    free(s->hits);
+    free(s->frontier);
+    pthread_mutex_destroy(&s->hits_lock);
+    pthread_cond_destroy(&s->done);
+    free(s);
+}
+
+// Runs the search of one session and blocks until it completes, is cancelled,
+// hits its result cap or runs out of time. Partial results stay in the buffer;
+// for ranked sessions they are the best matches found so far, best first.
+JNIEXPORT jint JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSearch(JNIEnv *env, jobject clazz, jlong handle, jstring jRoot, jstring jQuery, jobject jBuffer, jint capacity, jint filterMask, jlong pruneHandle) {
+    SearchSession* s = (SearchSession*)(intptr_t)handle;
+    if (!s || capacity <= 0) return 0;
+    if (atomic_load(&s->status)) return 0;
+
+    const char *root = (*env)->GetStringUTFChars(env, jRoot, NULL);
+    const char *query = (*env)->GetStringUTFChars(env, jQuery, NULL);
+    unsigned char *buffer = (*env)->GetDirectBufferAddress(env, jBuffer);
+
+    if (!buffer) {
+        (*env)->ReleaseStringUTFChars(env, jRoot, root);
+        (*env)->ReleaseStringUTFChars(env, jQuery, query);
+        return -2;
+    }
+
+    SearchContext ctx;
+    setup_search_context(&ctx, query, filterMask);
+
+    size_t root_len = strlen(root);
+    size_t base_len = root_len;
+    if (base_len > 1 && root[base_len - 1] == '/') base_len--;
+
+    GlobalBuffer gbuf;
+    gbuf_init(&gbuf, buffer, capacity, base_len);
+
+    WorkItem* root_item = (WorkItem*)malloc(sizeof(WorkItem));
+    char* root_dup = malloc(base_len + 1);
+    if (!root_item || !root_dup) {
+        free(root_item);
+        free(root_dup);
+        gbuf_destroy(&gbuf);
+        (*env)->ReleaseStringUTFChars(env, jRoot, root);
+        (*env)->ReleaseStringUTFChars(env, jQuery, query);
+        return -3;
+    }
+    memcpy(root_dup, root, base_len);
+    root_dup[base_len] = 0;
+    root_item->path = root_dup;
+    root_item->len = base_len;
+    root_item->depth = 0;
+    root_item->prio = 0;
+    root_item->next = NULL;
+
+    int64_t start_ns = monotonic_ns();
+    s->now_sec = (int64_t)time(NULL);
+    s->deadline_ns = s->budget_ms ? start_ns + s->budget_ms * 1000000LL : 0;
+    s->ctx = &ctx;
+    s->gbuf = &gbuf;
+    s->prune = pruneHandle ? (const PruneRules*)(intptr_t)pruneHandle : &g_prune_search_default;
+    struct stat root_st;
+    s->root_dev = stat(root_dup, &root_st) == 0 ? root_st.st_dev : 0;
+
+    SearchPool* p = &g_search_pool;
+    pthread_mutex_lock(&p->lock);
+    search_pool_start_locked();
+    s->running = 1;
+    s->next = p->sessions;
+    p->sessions = s;
+    session_push_locked(s, root_item);
+
+    char* inline_kbuf = NULL;
+    unsigned char* inline_local = NULL;
+    while (s->running) {
+        if (p->threads == 0 && s->queued > 0) {
+            // No pool threads could be started: do the walk on this thread
+            if (!inline_kbuf) inline_kbuf = (char*)malloc(SEARCH_KBUF_SIZE);
+            if (!inline_local) inline_local = (unsigned char*)malloc(LOCAL_BUF_SIZE);
+            if (!inline_kbuf || !inline_local) {
+                atomic_fetch_or(&s->status, SEARCH_STATUS_CANCELLED);
+                session_settle_locked(s);
+                continue;
+            }
+            session_run_item_locked(s, inline_kbuf, inline_local);
+            continue;
+        }
+        if (s->deadline_ns && !atomic_load(&s->status)) {
+            struct timespec ts = {
+                .tv_sec = (time_t)(s->deadline_ns / 1000000000LL),
+                .tv_nsec = (long)(s->deadline_ns % 1000000000LL)
+            };
+            if (pthread_cond_timedwait(&s->done, &p->lock, &ts) == ETIMEDOUT) {
+                atomic_fetch_or(&s->status, SEARCH_STATUS_DEADLINE);
+                session_settle_locked(s);
+            }
+        } else {
+            pthread_cond_wait(&s->done, &p->lock);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    free(inline_kbuf);
+    free(inline_local);
+
+    if (s->top_k) session_flush_hits(s);
+    int result_len = (int)(gbuf.current - gbuf.start);
+    gbuf_destroy(&gbuf);
+    long elapsed_ms = (long)((monotonic_ns() - start_ns) / 1000000LL);
+    GLOG(GLOG_INFO, GLOG_MSG_SEARCH_TIMINGS, elapsed_ms, atomic_load(&s->results), atomic_load(&s->status), result_len);
+
+    (*env)->ReleaseStringUTFChars(env, jRoot, root);
+    (*env)->ReleaseStringUTFChars(env, jQuery, query);
+    return result_len;
+}
+
+// ==========================================
+// DELETE ENGINE
+// ==========================================
+// Recursive delete using fd-relative syscalls. Each directory node keeps its
+// fd open while it still has children in flight; the last child to finish
+// removes itself with unlinkat(parent->fd) and releases the parent, so sibling
+// subtrees are emptied in parallel without ever re-resolving full paths.
+typedef struct DeleteNode {
+    char* name;                 // entry name (full path for roots)
+    struct DeleteNode* parent;  // NULL for roots
+    struct DeleteNode* next;    // stack link
+    int fd;
+    atomic_int pending;         // queued children + 1 while enumerating
+    atomic_int failed;          // something below could not be removed
+} DeleteNode;
+
+typedef struct {
+    atomic_int cancel;
+    atomic_long removed;
+    pthread_mutex_t lock;
+    char** failures;
+    size_t failure_count;
+    size_t failure_cap;
+} DeleteJob;
+
+// LIFO keeps the traversal depth-first, which bounds the number of open fds.
+typedef struct {
+    DeleteNode* head;
+    int active_workers;
+    int shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} DeleteStack;
+
+static void dstack_push(DeleteStack* s, DeleteNode* n) {
+    pthread_mutex_lock(&s->lock);
+    n->next = s->head;
+    s->head = n;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static DeleteNode* dstack_pop(DeleteStack* s) {
+    pthread_mutex_lock(&s->lock);
+    while (!s->head && !s->shutdown) {
+        if (s->active_workers == 0) {
+            s->shutdown = 1;
+            pthread_cond_broadcast(&s->cond);
+            break;
+        }
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    DeleteNode* n = s->shutdown ? NULL : s->head;
+    if (n) {
+        s->head = n->next;
+        s->active_workers++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return n;
+}
+
+static void dstack_worker_done(DeleteStack* s) {
+    pthread_mutex_lock(&s->lock);
+    s->active_workers--;
+    if (!s->head && s->active_workers == 0) {
+        s->shutdown = 1;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static size_t delete_node_path(const DeleteNode* n, char* out, size_t cap) {
+    size_t len = n->parent ? delete_node_path(n->parent, out, cap) : 0;
+    if (n->parent && len + 1 < cap) out[len++] = '/';
+    size_t name_len = strlen(n->name);
+    if (len + name_len >= cap) name_len = cap - len - 1;
+    memcpy(out + len, n->name, name_len);
+    len += name_len;
+    out[len] = 0;
+    return len;
+}
+
+static void delete_record_failure(DeleteJob* job, const DeleteNode* dir, const char* name) {
+    char path[PATH_MAX];
+    size_t len = dir ? delete_node_path(dir, path, sizeof(path)) : 0;
+    if (name) snprintf(path + len, sizeof(path) - len, "%s%s", dir ? "/" : "", name);
+
+    pthread_mutex_lock(&job->lock);
+    if (job->failure_count == job->failure_cap) {
+        size_t cap = job->failure_cap ? job->failure_cap * 2 : 64;
+        char** grown = (char**)realloc(job->failures, cap * sizeof(char*));
+        if (grown) {
+            job->failures = grown;
+            job->failure_cap = cap;
+        }
+    }
+    if (job->failure_count < job->failure_cap) {
+        job->failures[job->failure_count++] = strdup(path);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Drops one reference; the last one closes the fd, removes the directory and
+// walks up to release the parent in turn.
+static void delete_node_release(DeleteJob* job, DeleteNode* n) {
+    while (n && atomic_fetch_sub(&n->pending, 1) == 1) {
+        DeleteNode* parent = n->parent;
+        if (n->fd != -1) close(n->fd);
+
+        int failed = atomic_load(&n->failed);
+        if (!failed && !atomic_load(&job->cancel)) {
+            int parent_fd = parent ? parent->fd : AT_FDCWD;
+            if (unlinkat(parent_fd, n->name, AT_REMOVEDIR) == 0) {
+                atomic_fetch_add(&job->removed, 1);
+            } else if (errno != ENOENT) {
+                n->fd = -1;
+                delete_record_failure(job, n, NULL);
+                failed = 1;
+            }
+        }
+        if (failed && parent) atomic_store(&parent->failed, 1);
+
+        free(n->name);
+        free(n);
+        n = parent;
+    }
+}
+
+static DeleteNode* delete_node_new(char* name, DeleteNode* parent) {
+    DeleteNode* n = (DeleteNode*)malloc(sizeof(DeleteNode));
+    if (!n) return NULL;
+    n->name = name;
+    n->parent = parent;
+    n->next = NULL;
+    n->fd = -1;
+    atomic_init(&n->pending, 1);
+    atomic_init(&n->failed, 0);
+    return n;
+}
+
+#define DELETE_KBUF_SIZE 65536
+
+static void delete_process_node(DeleteJob* job, DeleteStack* s, DeleteNode* n, char* kbuf) {
+    int parent_fd = n->parent ? n->parent->fd : AT_FDCWD;
+    // An unreadable directory is not fatal yet: if it is empty the final
+    // unlinkat in delete_node_release still succeeds.
+    n->fd = openat(parent_fd, n->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (n->fd != -1) {
+        struct linux_dirent64 *d;
+        int nread;
+        while ((nread = syscall(__NR_getdents64, n->fd, kbuf, DELETE_KBUF_SIZE)) > 0) {
+            if (atomic_load(&job->cancel)) break;
+
+            int bpos = 0;
+            while (bpos < nread) {
+                d = (struct linux_dirent64 *)(kbuf + bpos);
+                bpos += d->d_reclen;
+                if (d->d_name[0] == '.') {
+                    if (d->d_name[1] == 0) continue;
+                    if (d->d_name[1] == '.' && d->d_name[2] == 0) continue;
+                }
+
+                unsigned char type = d->d_type;
+                if (type == DT_UNKNOWN) {
+                    struct stat st;
+                    if (fstatat(n->fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                        type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+                    }
+                }
+
+                if (type == DT_DIR) {
+                    char* name = strdup(d->d_name);
+                    DeleteNode* child = name ? delete_node_new(name, n) : NULL;
+                    if (!child) {
+                        free(name);
+                        delete_record_failure(job, n, d->d_name);
+                        atomic_store(&n->failed, 1);
+                        continue;
+                    }
+                    atomic_fetch_add(&n->pending, 1);
+                    dstack_push(s, child);
+                } else if (unlinkat(n->fd, d->d_name, 0) == 0) {
+                    atomic_fetch_add(&job->removed, 1);
+                } else if (errno != ENOENT) {
+                    delete_record_failure(job, n, d->d_name);
+                    atomic_store(&n->failed, 1);
+                }
+            }
+        }
+    }
+    delete_node_release(job, n);
+}
+
+typedef struct {
+    DeleteJob* job;
+    DeleteStack* stack;
+} DeleteWorkerArgs;
+
+void* delete_worker_thread(void* arg) {
+    DeleteWorkerArgs* args = (DeleteWorkerArgs*)arg;
+    char kbuf[DELETE_KBUF_SIZE] __attribute__((aligned(8)));
+
+    DeleteNode* n;
+    while ((n = dstack_pop(args->stack)) != NULL) {
+        // After cancellation queued nodes are only released, which unwinds
+        // their parents and closes every fd without touching the disk.
+        if (atomic_load(&args->job->cancel)) delete_node_release(args->job, n);
+        else delete_process_node(args->job, args->stack, n, kbuf);
+        dstack_worker_done(args->stack);
+    }
+    return NULL;
+}
+
+// ==========================================
+// JNI INTERFACE (DELETE)
+// ==========================================
+
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeDeleteCreate(JNIEnv *env, jobject clazz) {
+    DeleteJob* job = (DeleteJob*)calloc(1, sizeof(DeleteJob));
+    if (!job) return 0;
+    pthread_mutex_init(&job->lock, NULL);
+    return (jlong)(intptr_t)job;
+}
+
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeDeleteCancel(JNIEnv *env, jobject clazz, jlong handle) {
+    DeleteJob* job = (DeleteJob*)(intptr_t)handle;
+    if (job) atomic_store(&job->cancel, 1);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeDeleteProgress(JNIEnv *env, jobject clazz, jlong handle) {
+    DeleteJob* job = (DeleteJob*)(intptr_t)handle;
+    return job ? atomic_load(&job->removed) : 0;
+}
+
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeDeleteDestroy(JNIEnv *env, jobject clazz, jlong handle) {
+    DeleteJob* job = (DeleteJob*)(intptr_t)handle;
+    if (!job) return;
+    for (size_t i = 0; i < job->failure_count; i++) free(job->failures[i]);
+    free(job->failures);
+    pthread_mutex_destroy(&job->lock);
+    free(job);
+}
+
+// Deletes every path (files or whole trees) and returns the paths that could
+// not be removed. Blocks until done or cancelled via nativeDeleteCancel.
+JNIEXPORT jobjectArray JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeDeleteRun(JNIEnv *env, jobject clazz, jlong handle, jobjectArray jPaths) {
+    DeleteJob* job = (DeleteJob*)(intptr_t)handle;
+    jclass string_class = (*env)->FindClass(env, "java/lang/String");
+    if (!job) return (*env)->NewObjectArray(env, 0, string_class, NULL);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    DeleteStack stack = { .head = NULL, .active_workers = 0, .shutdown = 0 };
+    pthread_mutex_init(&stack.lock, NULL);
+    pthread_cond_init(&stack.cond, NULL);
+
+    int roots = 0;
+    jsize path_count = (*env)->GetArrayLength(env, jPaths);
+    for (jsize i = 0; i < path_count; i++) {
+        jstring jPath = (jstring)(*env)->GetObjectArrayElement(env, jPaths, i);
+        const char* path = (*env)->GetStringUTFChars(env, jPath, NULL);
+        if (path) {
+            struct stat st;
+            if (lstat(path, &st) != 0) {
+                if (errno != ENOENT) delete_record_failure(job, NULL, path);
+            } else if (!S_ISDIR(st.st_mode)) {
+                if (unlink(path) == 0) atomic_fetch_add(&job->removed, 1);
+                else if (errno != ENOENT) delete_record_failure(job, NULL, path);
+            } else {
+                char* name = strdup(path);
+                DeleteNode* root = name ? delete_node_new(name, NULL) : NULL;
+                if (root) {
+                    dstack_push(&stack, root);
+                    roots++;
+                } else {
+                    free(name);
+                    delete_record_failure(job, NULL, path);
+                }
+            }
+            (*env)->ReleaseStringUTFChars(env, jPath, path);
+        }
+        (*env)->DeleteLocalRef(env, jPath);
+    }
+
+    if (roots > 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cores < 1) cores = 4;
+        int num_threads = (int)cores;
+        if (num_threads < 2) num_threads = 2;
+        if (num_threads > 8) num_threads = 8;
+
+        pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * num_threads);
+        DeleteWorkerArgs args = { .job = job, .stack = &stack };
+        int created = 0;
+        for (int i = 0; threads && i < num_threads; i++) {
+            if (pthread_create(&threads[created], NULL, delete_worker_thread, &args) == 0) created++;
+        }
+        if (created == 0) delete_worker_thread(&args);
+        for (int i = 0; i < created; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+    }
+    pthread_mutex_destroy(&stack.lock);
+    pthread_cond_destroy(&stack.cond);
+
+    pthread_mutex_lock(&job->lock);
+    jobjectArray result = (*env)->NewObjectArray(env, (jsize)job->failure_count, string_class, NULL);
+    for (size_t i = 0; result && i < job->failure_count; i++) {
+        jstring s = (*env)->NewStringUTF(env, job->failures[i]);
+        (*env)->SetObjectArrayElement(env, result, (jsize)i, s);
+        (*env)->DeleteLocalRef(env, s);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long total_ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+    GLOG(GLOG_INFO, GLOG_MSG_DELETE_TIMINGS, total_ms, atomic_load(&job->removed), (int64_t)job->failure_count, atomic_load(&job->cancel));
+    pthread_mutex_unlock(&job->lock);
+    return result;
+}
+
+// ==========================================
+// BATCH RENAME (RECYCLE BIN)
+// ==========================================
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+// renameat that fails with EEXIST instead of replacing dst. Filesystems or
+// kernels without renameat2 fall back to an existence check first.
+static int rename_noreplace(int from_fd, const char* src, int to_fd, const char* dst) {
+#ifdef __NR_renameat2
+    if (syscall(__NR_renameat2, from_fd, src, to_fd, dst, RENAME_NOREPLACE) == 0) return 0;
+    if (errno != ENOSYS && errno != EINVAL) return -1;
+#endif
+    struct stat st;
+    if (fstatat(to_fd, dst, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    return renameat(from_fd, src, to_fd, dst);
+}
+
+// Renames from[i] to to[i], where a non-null directory makes its side relative
+// to one fd opened for the whole batch; an existing to[i] is never replaced.
+// sizes[i] receives the pre-rename st_size, or -1 for directories. Returns 0
+// or the errno (EEXIST when to[i] is taken) for every entry.
+JNIEXPORT jintArray JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeRenameBatch(JNIEnv *env, jobject clazz, jstring jFromDir, jobjectArray jFrom, jstring jToDir, jobjectArray jTo, jlongArray jSizes) {
+    jsize count = (*env)->GetArrayLength(env, jFrom);
+    if ((*env)->GetArrayLength(env, jTo) < count) return NULL;
+    jintArray jResult = (*env)->NewIntArray(env, count);
+    if (!jResult || count == 0) return jResult;
+
+    jint* result = (jint*)malloc(sizeof(jint) * count);
+    jlong* sizes = (jlong*)malloc(sizeof(jlong) * count);
+    if (!result || !sizes) {
+        free(result);
+        free(sizes);
+        return NULL;
+    }
+
+    int from_fd = AT_FDCWD;
+    int to_fd = AT_FDCWD;
+    int dir_error = 0;
+    if (jFromDir) {
+        const char* dir = (*env)->GetStringUTFChars(env, jFromDir, NULL);
+        from_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (from_fd == -1) dir_error = errno;
+        (*env)->ReleaseStringUTFChars(env, jFromDir, dir);
+    }
+    if (jToDir && !dir_error) {
+        const char* dir = (*env)->GetStringUTFChars(env, jToDir, NULL);
+        to_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (to_fd == -1) dir_error = errno;
+        (*env)->ReleaseStringUTFChars(env, jToDir, dir);
+    }
+
+    for (jsize i = 0; i < count; i++) {
+        sizes[i] = 0;
+        if (dir_error) {
+            result[i] = dir_error;
+            continue;
+        }
+        jstring jSrc = (jstring)(*env)->GetObjectArrayElement(env, jFrom, i);
+        jstring jDst = (jstring)(*env)->GetObjectArrayElement(env, jTo, i);
+        const char* src = (*env)->GetStringUTFChars(env, jSrc, NULL);
+        const char* dst = (*env)->GetStringUTFChars(env, jDst, NULL);
+
+        struct stat st;
+        if (fstatat(from_fd, src, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            result[i] = errno;
+        } else {
+            sizes[i] = S_ISDIR(st.st_mode) ? -1 : st.st_size;
+            result[i] = rename_noreplace(from_fd, src, to_fd, dst) == 0 ? 0 : errno;
+        }
+
+        (*env)->ReleaseStringUTFChars(env, jSrc, src);
+        (*env)->ReleaseStringUTFChars(env, jDst, dst);
+        (*env)->DeleteLocalRef(env, jSrc);
+        (*env)->DeleteLocalRef(env, jDst);
+    }
+    if (from_fd >= 0) close(from_fd);
+    if (to_fd >= 0) close(to_fd);
+
+    (*env)->SetIntArrayRegion(env, jResult, 0, count, result);
+    if (jSizes && (*env)->GetArrayLength(env, jSizes) >= count) {
+        (*env)->SetLongArrayRegion(env, jSizes, 0, count, sizes);
+    }
+    free(result);
+    free(sizes);
+    return jResult;
+}
+
+// ==========================================
+// COMPARE / SYNC ENGINE
+// ==========================================
+// Compares two trees by path relative to their roots. Workers take directory
+// pairs off a shared stack, read both sides, sort the names and merge them, so
+// both trees are walked at once and every directory is read once. A directory
+// that exists on one side only is reported as a whole and not descended.
+//
+// Files match when size and mtime agree; mtimes within SYNC_MTIME_SLACK_SEC
+// count as equal because FAT/exFAT volumes keep 2s resolution. With
+// SYNC_FLAG_VERIFY, same-size files whose mtimes differ are compared by
+// content and left out when identical. Symlinks and special files are ignored.
+#define DIFF_ONLY_LEFT 1
+#define DIFF_ONLY_RIGHT 2
+#define DIFF_NEWER_LEFT 3
+#define DIFF_NEWER_RIGHT 4
+#define DIFF_SIZE 5
+#define DIFF_TYPE 6
+
+#define SYNC_FLAG_VERIFY 1
+#define SYNC_MTIME_SLACK_SEC 2
+#define SYNC_KBUF_SIZE 65536
+#define SYNC_IO_CHUNK (256 * 1024)
+#define SYNC_SENDFILE_CHUNK (4 * 1024 * 1024)
+#define SYNC_DIFF_INFO_FIELDS 5
+
+typedef struct SyncPair {
+    char* rel;                  // "" for the roots
+    struct SyncPair* next;
+} SyncPair;
+
+typedef struct {
+    char* rel;
+    unsigned char kind;
+    unsigned char left_dir;
+    unsigned char right_dir;
+    int64_t left_size;
+    int64_t left_time;
+    int64_t right_size;
+    int64_t right_time;
+} SyncDiff;
+
+typedef struct {
+    atomic_int cancel;
+    atomic_long progress;       // entries compared, or bytes copied
+    int flags;
+    pthread_mutex_t lock;       // guards everything below
+    pthread_cond_t cond;
+    SyncDiff* diffs;
+    size_t diff_count;
+    size_t diff_cap;
+    SyncPair* pairs;            // directory pairs still to compare, LIFO
+    int active_workers;
+    int walk_done;
+    const char* left_root;
+    const char* right_root;
+} SyncJob;
+
+typedef struct {
+    char* name;
+    unsigned char is_dir;
+    int64_t size;
+    int64_t time;
+} SyncEntry;
+
+typedef struct {
+    SyncEntry* items;
+    size_t count;
+    size_t cap;
+} SyncEntryList;
+
+typedef struct {
+    SyncJob* job;
+    char kbuf[SYNC_KBUF_SIZE] __attribute__((aligned(8)));
+    SyncEntryList left;
+    SyncEntryList right;
+    char* io_a;                 // content checks, allocated on first use
+    char* io_b;
+} SyncWorker;
+
+static int sync_entry_cmp(const void* a, const void* b) {
+    return strcmp(((const SyncEntry*)a)->name, ((const SyncEntry*)b)->name);
+}
+
+static void sync_entries_clear(SyncEntryList* l) {
+    for (size_t i = 0; i < l->count; i++) free(l->items[i].name);
+    l->count = 0;
+}
+
+// root + "/" + rel + "/" + name, skipping empty parts. 0 if it does not fit.
+static int sync_path(char* out, size_t cap, const char* root, const char* rel, const char* name) {
+    int n = snprintf(out, cap, "%s%s%s%s%s", root, rel[0] ? "/" : "", rel, name ? "/" : "", name ? name : "");
+    return n > 0 && (size_t)n < cap;
+}
+
+// Reads one directory into out, sorted by name. Returns 0 or an errno.
+static int sync_read_dir(const char* path, SyncEntryList* out, char* kbuf) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return errno;
+
+    int err = 0;
+    int nread;
+    while (!err && (nread = syscall(__NR_getdents64, fd, kbuf, SYNC_KBUF_SIZE)) > 0) {
+        int bpos = 0;
+        while (bpos < nread) {
+            struct linux_dirent64* d = (struct linux_dirent64*)(kbuf + bpos);
+            bpos += d->d_reclen;
+            if (d->d_name[0] == '.') {
+                if (d->d_name[1] == 0) continue;
+                if (d->d_name[1] == '.' && d->d_name[2] == 0) continue;
+            }
+            if (d->d_type == DT_LNK) continue;
+
+            int is_dir = d->d_type == DT_DIR;
+            int64_t size = 0, time = 0;
+            if (!is_dir) {
+                struct stat st;
+                if (fstatat(fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                if (S_ISDIR(st.st_mode)) {
+                    is_dir = 1;
+                } else if (S_ISREG(st.st_mode)) {
+                    size = st.st_size;
+                    time = st.st_mtime;
+                } else {
+                    continue;
+                }
+            }
+
+            if (out->count == out->cap) {
+                size_t cap = out->cap ? out->cap * 2 : 256;
+                SyncEntry* grown = (SyncEntry*)realloc(out->items, cap * sizeof(SyncEntry));
+                if (!grown) {
+                    err = ENOMEM;
+                    break;
+                }
+                out->items = grown;
+                out->cap = cap;
+            }
+            char* name = strdup(d->d_name);
+            if (!name) {
+                err = ENOMEM;
+                break;
+            }
+            SyncEntry* e = &out->items[out->count++];
+            e->name = name;
+            e->is_dir = (unsigned char)is_dir;
+            e->size = size;
+            e->time = time;
+        }
+    }
+    if (!err && nread < 0) err = errno;
+    close(fd);
+    if (!err) qsort(out->items, out->count, sizeof(SyncEntry), sync_entry_cmp);
+    return err;
+}
+
+// Lock held by the caller. Wakes a worker for the new pair.
+static void sync_push_pair_locked(SyncJob* job, SyncPair* pair) {
+    pair->next = job->pairs;
+    job->pairs = pair;
+    pthread_cond_signal(&job->cond);
+}
+
+static SyncPair* sync_pop_pair(SyncJob* job) {
+    pthread_mutex_lock(&job->lock);
+    while (!job->pairs && !job->walk_done) {
+        if (job->active_workers == 0) {
+            job->walk_done = 1;
+            pthread_cond_broadcast(&job->cond);
+            break;
+        }
+        pthread_cond_wait(&job->cond, &job->lock);
+    }
+    SyncPair* pair = job->walk_done ? NULL : job->pairs;
+    if (pair) {
+        job->pairs = pair->next;
+        job->active_workers++;
+    }
+    pthread_mutex_unlock(&job->lock);
+    return pair;
+}
+
+static void sync_pair_done(SyncJob* job, SyncPair* pair) {
+    free(pair->rel);
+    free(pair);
+    pthread_mutex_lock(&job->lock);
+    job->active_workers--;
+    if (!job->pairs && job->active_workers == 0) {
+        job->walk_done = 1;
+        pthread_cond_broadcast(&job->cond);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+static char* sync_join_rel(const char* rel, const char* name) {
+    size_t rel_len = strlen(rel);
+    size_t name_len = strlen(name);
+    char* out = (char*)malloc(rel_len + 1 + name_len + 1);
+    if (!out) return NULL;
+    if (rel_len) {
+        memcpy(out, rel, rel_len);
+        out[rel_len++] = '/';
+    }
+    memcpy(out + rel_len, name, name_len + 1);
+    return out;
+}
+
+static void sync_add_diff(SyncJob* job, const char* rel, const SyncEntry* l, const SyncEntry* r, int kind) {
+    char* path = sync_join_rel(rel, l ? l->name : r->name);
+    if (!path) return;
+
+    pthread_mutex_lock(&job->lock);
+    if (job->diff_count == job->diff_cap) {
+        size_t cap = job->diff_cap ? job->diff_cap * 2 : 256;
+        SyncDiff* grown = (SyncDiff*)realloc(job->diffs, cap * sizeof(SyncDiff));
+        if (grown) {
+            job->diffs = grown;
+            job->diff_cap = cap;
+        }
+    }
+    if (job->diff_count < job->diff_cap) {
+        SyncDiff* d = &job->diffs[job->diff_count++];
+        d->rel = path;
+        d->kind = (unsigned char)kind;
+        d->left_dir = l ? l->is_dir : 0;
+        d->right_dir = r ? r->is_dir : 0;
+        d->left_size = l ? l->size : -1;
+        d->left_time = l ? l->time : 0;
+        d->right_size = r ? r->size : -1;
+        d->right_time = r ? r->time : 0;
+        path = NULL;
+    }
+    pthread_mutex_unlock(&job->lock);
+    free(path);
+}
+
+// 1 when both files hold the same bytes.
+static int sync_same_content(SyncWorker* w, const char* a, const char* b, int64_t size) {
+    if (!w->io_a) w->io_a = (char*)malloc(SYNC_IO_CHUNK);
+    if (!w->io_b) w->io_b = (char*)malloc(SYNC_IO_CHUNK);
+    if (!w->io_a || !w->io_b) return 0;
+
+    int fa = open(a, O_RDONLY | O_CLOEXEC);
+    if (fa == -1) return 0;
+    int fb = open(b, O_RDONLY | O_CLOEXEC);
+    if (fb == -1) {
+        close(fa);
+        return 0;
+    }
+    int same = 1;
+    int64_t off = 0;
+    while (same && off < size) {
+        if (atomic_load(&w->job->cancel)) {
+            same = 0;
+            break;
+        }
+        size_t want = (size - off) < SYNC_IO_CHUNK ? (size_t)(size - off) : SYNC_IO_CHUNK;
+        ssize_t ra = pread(fa, w->io_a, want, off);
+        ssize_t rb = pread(fb, w->io_b, want, off);
+        if (ra <= 0 || ra != rb || memcmp(w->io_a, w->io_b, (size_t)ra) != 0) same = 0;
+        else off += ra;
+    }
+    close(fa);
+    close(fb);
+    return same;
+}
+
+// Difference between two files of the same name, or 0 when they match.
+static int sync_classify(SyncWorker* w, const char* rel, const SyncEntry* l, const SyncEntry* r) {
+    int64_t dt = l->time - r->time;
+    int same_time = dt <= SYNC_MTIME_SLACK_SEC && dt >= -SYNC_MTIME_SLACK_SEC;
+    if (same_time) return l->size == r->size ? 0 : DIFF_SIZE;
+
+    SyncJob* job = w->job;
+    if (l->size == r->size && (job->flags & SYNC_FLAG_VERIFY)) {
+        char a[PATH_MAX], b[PATH_MAX];
+        if (sync_path(a, sizeof(a), job->left_root, rel, l->name) &&
+            sync_path(b, sizeof(b), job->right_root, rel, r->name) &&
+            sync_same_content(w, a, b, l->size)) {
+            return 0;
+        }
+    }
+    return dt > 0 ? DIFF_NEWER_LEFT : DIFF_NEWER_RIGHT;
+}
+
+static void sync_compare_pair(SyncWorker* w, SyncPair* pair) {
+    SyncJob* job = w->job;
+    char path[PATH_MAX];
+    // A directory that vanished or cannot be read is skipped, not reported
+    if (!sync_path(path, sizeof(path), job->left_root, pair->rel, NULL) || sync_read_dir(path, &w->left, w->kbuf) != 0 ||
+        !sync_path(path, sizeof(path), job->right_root, pair->rel, NULL) || sync_read_dir(path, &w->right, w->kbuf) != 0) {
+        sync_entries_clear(&w->left);
+        sync_entries_clear(&w->right);
+        return;
+    }
+
+    SyncEntryList* L = &w->left;
+    SyncEntryList* R = &w->right;
+    size_t i = 0, j = 0;
+    while ((i < L->count || j < R->count) && !atomic_load(&job->cancel)) {
+        int c = i >= L->count ? 1 : j >= R->count ? -1 : strcmp(L->items[i].name, R->items[j].name);
+        if (c < 0) {
+            sync_add_diff(job, pair->rel, &L->items[i++], NULL, DIFF_ONLY_LEFT);
+        } else if (c > 0) {
+            sync_add_diff(job, pair->rel, NULL, &R->items[j++], DIFF_ONLY_RIGHT);
+        } else {
+            const SyncEntry* l = &L->items[i++];
+            const SyncEntry* r = &R->items[j++];
+            if (l->is_dir && r->is_dir) {
+                SyncPair* child = (SyncPair*)malloc(sizeof(SyncPair));
+                char* rel = sync_join_rel(pair->rel, l->name);
+                if (child && rel) {
+                    child->rel = rel;
+                    pthread_mutex_lock(&job->lock);
+                    sync_push_pair_locked(job, child);
+                    pthread_mutex_unlock(&job->lock);
+                } else {
+                    free(child);
+                    free(rel);
+                }
+            } else if (l->is_dir != r->is_dir) {
+                sync_add_diff(job, pair->rel, l, r, DIFF_TYPE);
+            } else {
+                int kind = sync_classify(w, pair->rel, l, r);
+                if (kind) sync_add_diff(job, pair->rel, l, r, kind);
+            }
+        }
+        atomic_fetch_add(&job->progress, 1);
+    }
+    sync_entries_clear(L);
+    sync_entries_clear(R);
+}
+
+void* sync_compare_worker(void* arg) {
+    SyncWorker* w = (SyncWorker*)arg;
+    SyncPair* pair;
+    while ((pair = sync_pop_pair(w->job)) != NULL) {
+        if (!atomic_load(&w->job->cancel)) sync_compare_pair(w, pair);
+        sync_pair_done(w->job, pair);
+    }
+    return NULL;
+}
+
+// Copies one regular file through a temporary sibling that is renamed over to
+// once complete, keeping the source mtime so the next compare sees a match.
+static int sync_copy_file(SyncJob* job, const char* from, const char* to, const struct stat* st, char* buf) {
+    char tmp[PATH_MAX];
+    int n = snprintf(tmp, sizeof(tmp), "%s.glaive-sync", to);
+    if (n < 0 || (size_t)n >= sizeof(tmp)) return ENAMETOOLONG;
+
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in == -1) return errno;
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out == -1) {
+        int err = errno;
+        close(in);
+        return err;
+    }
+
+    int err = 0;
+    int use_sendfile = 1;
+    off_t off = 0;
+    while (off < st->st_size) {
+        if (atomic_load(&job->cancel)) {
+            err = ECANCELED;
+            break;
+        }
+        ssize_t done;
+        if (use_sendfile) {
+            size_t want = (st->st_size - off) < SYNC_SENDFILE_CHUNK ? (size_t)(st->st_size - off) : SYNC_SENDFILE_CHUNK;
+            done = sendfile(out, in, &off, want);
+            if (done < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EINVAL || errno == ENOSYS) {
+                    use_sendfile = 0;
+                    continue;
+                }
+                err = errno;
+                break;
+            }
+        } else {
+            size_t want = (st->st_size - off) < SYNC_IO_CHUNK ? (size_t)(st->st_size - off) : SYNC_IO_CHUNK;
+            done = pread(in, buf, want, off);
+            if (done < 0) {
+                if (errno == EINTR) continue;
+                err = errno;
+                break;
+            }
+            for (ssize_t written = 0; written < done;) {
+                ssize_t k = write(out, buf + written, (size_t)(done - written));
+                if (k < 0) {
+                    if (errno == EINTR) continue;
+                    err = errno;
+                    break;
+                }
+                written += k;
+            }
+            if (err) break;
+            off += done;
+        }
+        if (done == 0) break; // source shrank while copying
+        atomic_fetch_add(&job->progress, done);
+    }
+    close(in);
+
+    if (!err) {
+        struct timespec times[2] = { st->st_atim, st->st_mtim };
+        futimens(out, times);
+    }
+    if (close(out) != 0 && !err) err = errno;
+    if (!err && rename(tmp, to) != 0) err = errno;
+    if (err) unlink(tmp);
+    return err;
+}
+
+// Copies the file or tree at from to to. Both are PATH_MAX buffers holding
+// from_len/to_len bytes; child paths are appended in place and cut back.
+static int sync_copy_tree(SyncJob* job, char* from, size_t from_len, char* to, size_t to_len, char* kbuf, char* buf) {
+    struct stat st;
+    if (lstat(from, &st) != 0) return errno;
+    if (S_ISREG(st.st_mode)) return sync_copy_file(job, from, to, &st, buf);
+    if (!S_ISDIR(st.st_mode)) return 0;
+    if (mkdir(to, 0775) != 0 && errno != EEXIST) return errno;
+
+    // The listing is read up front so only one directory fd is open at a time
+    SyncEntryList list = { NULL, 0, 0 };
+    int err = sync_read_dir(from, &list, kbuf);
+    for (size_t i = 0; !err && i < list.count; i++) {
+        if (atomic_load(&job->cancel)) {
+            err = ECANCELED;
+            break;
+        }
+        size_t name_len = strlen(list.items[i].name);
+        if (from_len + 1 + name_len >= PATH_MAX || to_len + 1 + name_len >= PATH_MAX) {
+            err = ENAMETOOLONG;
+            break;
+        }
+        from[from_len] = '/';
+        memcpy(from + from_len + 1, list.items[i].name, name_len + 1);
+        to[to_len] = '/';
+        memcpy(to + to_len + 1, list.items[i].name, name_len + 1);
+        err = sync_copy_tree(job, from, from_len + 1 + name_len, to, to_len + 1 + name_len, kbuf, buf);
+        from[from_len] = 0;
+        to[to_len] = 0;
+    }
+    sync_entries_clear(&list);
+    free(list.items);
+
+    if (!err) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        utimensat(AT_FDCWD, to, times, 0);
+    }
+    return err;
+}
+
+static void sync_free_diffs(SyncJob* job) {
+    for (size_t i = 0; i < job->diff_count; i++) free(job->diffs[i].rel);
+    free(job->diffs);
+    job->diffs = NULL;
+    job->diff_count = 0;
+    job->diff_cap = 0;
+}
+
+// Root path without trailing slashes; "/" stays as is.
+static char* sync_root(const char* path) {
+    size_t len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') len--;
+    char* out = (char*)malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, path, len);
+    out[len] = 0;
+    return out;
+}
+
+// ==========================================
+// JNI INTERFACE (SYNC)
+// ==========================================
+
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSyncCreate(JNIEnv *env, jobject clazz, jint flags) {
+    SyncJob* job = (SyncJob*)calloc(1, sizeof(SyncJob));
+    if (!job) return 0;
+    job->flags = flags;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->cond, NULL);
+    return (jlong)(intptr_t)job;
+}
+
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSyncCancel(JNIEnv *env, jobject clazz, jlong handle) {
+    SyncJob* job = (SyncJob*)(intptr_t)handle;
+    if (job) atomic_store(&job->cancel, 1);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSyncProgress(JNIEnv *env, jobject clazz, jlong handle) {
+    SyncJob* job = (SyncJob*)(intptr_t)handle;
+    return job ? atomic_load(&job->progress) : 0;
+}
+
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSyncDestroy(JNIEnv *env, jobject clazz, jlong handle) {
+    SyncJob* job = (SyncJob*)(intptr_t)handle;
+    if (!job) return;
+    sync_free_diffs(job);
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->cond);
+    free(job);
+}
+
+// Compares the trees under left and right and returns the number of
+// differences (see nativeSyncDiffPaths/nativeSyncDiffInfo), or -errno when a
+// root is not a readable directory. Blocks until done or cancelled.
+JNIEXPORT jint JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSyncCompare(JNIEnv *env, jobject clazz, jlong handle, jstring jLeft, jstring jRight) {
+    SyncJob* job = (SyncJob*)(intptr_t)handle;
+    if (!job) return -EINVAL;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    const char* left = (*env)->GetStringUTFChars(env, jLeft, NULL);
+    const char* right = (*env)->GetStringUTFChars(env, jRight, NULL);
+    struct stat st;
+    int err = 0;
+    if (!left || !right) err = ENOMEM;
+    else if (stat(left, &st) != 0) err = errno;
+    else if (!S_ISDIR(st.st_mode)) err = ENOTDIR;
+    else if (stat(right, &st) != 0) err = errno;
+    else if (!S_ISDIR(st.st_mode)) err = ENOTDIR;
+
+    char* left_root = err ? NULL : sync_root(left);
+    char* right_root = err ? NULL : sync_root(right);
+    if (left) (*env)->ReleaseStringUTFChars(env, jLeft, left);
+    if (right) (*env)->ReleaseStringUTFChars(env, jRight, right);
+    SyncPair* root = err ? NULL : (SyncPair*)malloc(sizeof(SyncPair));
+    char* root_rel = err ? NULL : strdup("");
+    if (!err && (!left_root || !right_root || !root || !root_rel)) err = ENOMEM;
+    if (err) {
+        free(left_root);
+        free(right_root);
+        free(root);
+        free(root_rel);
+        return -err;
+    }
+
+    sync_free_diffs(job);
+    atomic_store(&job->progress, 0);
+    job->left_root = left_root;
+    job->right_root = right_root;
+    job->walk_done = 0;
+    job->active_workers = 0;
+    root->rel = root_rel;
+    root->next = NULL;
+    job->pairs = root;
+
+    // Mostly waiting on I/O of two trees; a few workers keep both busy
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_threads = cores < 2 ? 2 : cores > 4 ? 4 : (int)cores;
+    SyncWorker* workers = (SyncWorker*)calloc(num_threads, sizeof(SyncWorker));
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * num_threads);
+    int created = 0;
+    if (workers && threads) {
+        for (int i = 0; i < num_threads; i++) {
+            workers[i].job = job;
+            if (pthread_create(&threads[created], NULL, sync_compare_worker, &workers[i]) == 0) created++;
+        }
+        if (created == 0) sync_compare_worker(&workers[0]);
+        for (int i = 0; i < created; i++) pthread_join(threads[i], NULL);
+    } else {
+        SyncWorker* fallback = (SyncWorker*)calloc(1, sizeof(SyncWorker));
+        if (fallback) {
+            fallback->job = job;
+            sync_compare_worker(fallback);
+            free(fallback);
+        } else {
+            err = ENOMEM;
+        }
+    }
+    for (int i = 0; workers && i < num_threads; i++) {
+        free(workers[i].left.items);
+        free(workers[i].right.items);
+        free(workers[i].io_a);
+        free(workers[i].io_b);
+    }
+    free(workers);
+    free(threads);
+
+    // Pairs left over after a cancel or a failed start
+    while (job->pairs) {
+        SyncPair* next = job->pairs->next;
+        free(job->pairs->rel);
+        free(job->pairs);
+        job->pairs = next;
+    }
+    job->left_root = NULL;
+    job->right_root = NULL;
+    free(left_root);
+    free(right_root);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long total_ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+    GLOG(GLOG_INFO, GLOG_MSG_SYNC_COMPARE, total_ms, atomic_load(&job->progress), (int64_t)job->diff_count, created, atomic_load(&job->cancel));
+    return err ? -err : (jint)job->diff_count;
+}
+
+// Relative paths of the differences found by the last compare.
+JNIEXPORT jobjectArray JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSyncDiffPaths(JNIEnv *env, jobject clazz, jlong handle) {
+    SyncJob* job = (SyncJob*)(intptr_t)handle;
+    jclass string_class = (*env)->FindClass(env, "java/lang/String");
+    size_t count = job ? job->diff_count : 0;
+    jobjectArray result = (*env)->NewObjectArray(env, (jsize)count, string_class, NULL);
+    for (size_t i = 0; result && i < count; i++) {
+        jstring s = (*env)->NewStringUTF(env, job->diffs[i].rel);
+        (*env)->SetObjectArrayElement(env, result, (jsize)i, s);
+        (*env)->DeleteLocalRef(env, s);
+    }
+    return result;
+}
+
+// SYNC_DIFF_INFO_FIELDS longs per difference: kind | leftIsDir << 8 |
+// rightIsDir << 9, left size, left mtime, right size, right mtime. Sizes are
+// -1 on the side that lacks the entry, and 0 for directories.
+JNIEXPORT jlongArray JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSyncDiffInfo(JNIEnv *env, jobject clazz, jlong handle) {
+    SyncJob* job = (SyncJob*)(intptr_t)handle;
+    size_t count = job ? job->diff_count : 0;
+    jlongArray result = (*env)->NewLongArray(env, (jsize)(count * SYNC_DIFF_INFO_FIELDS));
+    if (!result || count == 0) return result;
+
+    jlong* info = (jlong*)malloc(count * SYNC_DIFF_INFO_FIELDS * sizeof(jlong));
+    if (!info) return result;
+    for (size_t i = 0; i < count; i++) {
+        const SyncDiff* d = &job->diffs[i];
+        jlong* row = info + i * SYNC_DIFF_INFO_FIELDS;
+        row[0] = d->kind | (d->left_dir << 8) | (d->right_dir << 9);
+        row[1] = d->left_size;
+        row[2] = d->left_time;
+        row[3] = d->right_size;
+        row[4] = d->right_time;
+    }
+    (*env)->SetLongArrayRegion(env, result, 0, (jsize)(count * SYNC_DIFF_INFO_FIELDS), info);
+    free(info);
+    return result;
+}
+
+// Copies from[i] (a file or a whole tree) to to[i] and returns 0 or the errno
+// for every pair. Progress counts copied bytes. Blocks until done or cancelled.
+JNIEXPORT jintArray JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeSyncCopy(JNIEnv *env, jobject clazz, jlong handle, jobjectArray jFrom, jobjectArray jTo) {
+    SyncJob* job = (SyncJob*)(intptr_t)handle;
+    jsize count = (*env)->GetArrayLength(env, jFrom);
+    if ((*env)->GetArrayLength(env, jTo) != count) return NULL;
+    jintArray result = (*env)->NewIntArray(env, count);
+    if (!result || count == 0) return result;
+
+    jint* errs = (jint*)malloc(sizeof(jint) * count);
+    char* from = (char*)malloc(PATH_MAX);
+    char* to = (char*)malloc(PATH_MAX);
+    char* kbuf = (char*)malloc(SYNC_KBUF_SIZE);
+    char* buf = (char*)malloc(SYNC_IO_CHUNK);
+    if (!job || !errs || !from || !to || !kbuf || !buf) {
+        free(errs);
+        free(from);
+        free(to);
+        free(kbuf);
+        free(buf);
+        return NULL;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    atomic_store(&job->progress, 0);
+    int failed = 0;
+    for (jsize i = 0; i < count; i++) {
+        jstring jF = (jstring)(*env)->GetObjectArrayElement(env, jFrom, i);
+        jstring jT = (jstring)(*env)->GetObjectArrayElement(env, jTo, i);
+        const char* f = (*env)->GetStringUTFChars(env, jF, NULL);
+        const char* t = (*env)->GetStringUTFChars(env, jT, NULL);
+        size_t from_len = f ? strlen(f) : 0;
+        size_t to_len = t ? strlen(t) : 0;
+        if (atomic_load(&job->cancel)) {
+            errs[i] = ECANCELED;
+        } else if (!f || !t) {
+            errs[i] = ENOMEM;
+        } else if (from_len >= PATH_MAX || to_len >= PATH_MAX) {
+            errs[i] = ENAMETOOLONG;
+        } else {
+            memcpy(from, f, from_len + 1);
+            memcpy(to, t, to_len + 1);
+            errs[i] = sync_copy_tree(job, from, from_len, to, to_len, kbuf, buf);
+        }
+        if (errs[i]) failed++;
+        if (f) (*env)->ReleaseStringUTFChars(env, jF, f);
+        if (t) (*env)->ReleaseStringUTFChars(env, jT, t);
+        (*env)->DeleteLocalRef(env, jF);
+        (*env)->DeleteLocalRef(env, jT);
+    }
+    (*env)->SetIntArrayRegion(env, result, 0, count, errs);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long total_ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+    GLOG(GLOG_INFO, GLOG_MSG_SYNC_COPY, total_ms, count, atomic_load(&job->progress), failed, atomic_load(&job->cancel));
+    free(errs);
+    free(from);
+    free(to);
+    free(kbuf);
+    free(buf);
+    return result;
+}
+
+// ==========================================
+// TEXT READER (RANGED READS)
+// ==========================================
+// A file is opened once and read in ranges with pread; nothing is mapped, so a
+// file truncated while open (a rotated log, nativeLogClear) reads short instead
+// of raising SIGBUS. Line numbers resolve through a sparse index, one
+// checkpoint every TEXT_INDEX_STRIDE lines, that grows only as far as a caller
+// asks for. The index is kept for as long as the handle, so later seeks skip
+// the scan.
+#define TEXT_INDEX_STRIDE 1024
+#define TEXT_COPY_CHUNK (256 * 1024)
+#define TEXT_SCAN_CHUNK 65536
+
+typedef struct {
+    int fd;
+    size_t size;                // at open; reads also stop at a shorter file
+    int ends_with_newline;
+    pthread_mutex_t lock;       // guards the index and the scan window
+    char* window;               // TEXT_SCAN_CHUNK bytes read at window_off
+    size_t window_off;
+    size_t window_len;
+    size_t* checkpoints;        // checkpoints[k] = offset of line k * TEXT_INDEX_STRIDE
+    size_t checkpoint_count;
+    size_t checkpoint_cap;
+    size_t scan_pos;            // start offset of line scan_line, the furthest line found so far
+    int64_t scan_line;
+    int scan_done;              // scan_pos/scan_line reached the last line
+} TextFile;
+
+// Lock held. Offset right after the next '\n' at or after pos, or size if
+// there is none (or the file has shrunk before one).
+static size_t text_next_line(TextFile* t, size_t pos) {
+    while (pos < t->size) {
+        if (pos < t->window_off || pos >= t->window_off + t->window_len) {
+            size_t want = t->size - pos < TEXT_SCAN_CHUNK ? t->size - pos : TEXT_SCAN_CHUNK;
+            ssize_t n = pread(t->fd, t->window, want, (off_t)pos);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                return t->size;
+            }
+            t->window_off = pos;
+            t->window_len = (size_t)n;
+        }
+        size_t at = pos - t->window_off;
+        const char* nl = memchr(t->window + at, '\n', t->window_len - at);
+        if (nl) return t->window_off + (size_t)(nl - t->window) + 1;
+        pos = t->window_off + t->window_len;
+    }
+    return t->size;
+}
+
+// Lock held. Extends the scan (and the checkpoints) up to line, or to EOF.
+static void text_scan_to(TextFile* t, int64_t line) {
+    while (!t->scan_done && t->scan_line < line) {
+        size_t next = text_next_line(t, t->scan_pos);
+        if (next >= t->size) {
+            // The last line has no successor unless the file ends with '\n'
+            if (next == t->size && t->ends_with_newline && t->scan_pos < t->size) {
+                t->scan_pos = next;
+                t->scan_line++;
+            }
+            t->scan_done = 1;
+            break;
+        }
+        if ((t->scan_line + 1) % TEXT_INDEX_STRIDE == 0) {
+            if (t->checkpoint_count == t->checkpoint_cap) {
+                size_t cap = t->checkpoint_cap ? t->checkpoint_cap * 2 : 64;
+                size_t* grown = (size_t*)realloc(t->checkpoints, cap * sizeof(size_t));
+                if (!grown) break;
+                t->checkpoints = grown;
+                t->checkpoint_cap = cap;
+            }
+            t->checkpoints[t->checkpoint_count++] = next;
+        }
+        t->scan_pos = next;
+        t->scan_line++;
+    }
+}
+
+// Bytes the file still holds from offset, at most want.
+static size_t text_available(const TextFile* t, size_t offset, size_t want) {
+    struct stat st;
+    size_t size = fstat(t->fd, &st) == 0 ? (size_t)st.st_size : t->size;
+    if (offset >= size) return 0;
+    return size - offset < want ? size - offset : want;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeTextOpen(JNIEnv *env, jobject clazz, jstring jPath) {
+    const char *path = (*env)->GetStringUTFChars(env, jPath, NULL);
+    if (!path) return 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    (*env)->ReleaseStringUTFChars(env, jPath, path);
+    if (fd == -1) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return 0;
+    }
+    TextFile* t = (TextFile*)calloc(1, sizeof(TextFile));
+    char* window = (char*)malloc(TEXT_SCAN_CHUNK);
+    if (!t || !window) {
+        free(t);
+        free(window);
+        close(fd);
+        return 0;
+    }
+    t->fd = fd;
+    t->size = (size_t)st.st_size;
+    t->window = window;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (t->size > 0) {
+        char last = 0;
+        t->ends_with_newline = pread(fd, &last, 1, (off_t)(t->size - 1)) == 1 && last == '\n';
+    }
+    t->scan_done = t->size == 0;
+    pthread_mutex_init(&t->lock, NULL);
+    return (jlong)(intptr_t)t;
+}
+
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeTextClose(JNIEnv *env, jobject clazz, jlong handle) {
+    TextFile* t = (TextFile*)(intptr_t)handle;
+    if (!t) return;
+    close(t->fd);
+    free(t->window);
+    free(t->checkpoints);
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeTextSize(JNIEnv *env, jobject clazz, jlong handle) {
+    TextFile* t = (TextFile*)(intptr_t)handle;
+    return t ? (jlong)t->size : -1;
+}
+
+// Start offset of the 0-based line, or -1 past the last line. Line N of a file
+// ending with '\n' is the empty line at EOF.
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeTextLineOffset(JNIEnv *env, jobject clazz, jlong handle, jlong line) {
+    TextFile* t = (TextFile*)(intptr_t)handle;
+    if (!t || line < 0) return -1;
+    if (line == 0) return 0;
+
+    pthread_mutex_lock(&t->lock);
+    jlong result = -1;
+    if (line > t->scan_line) text_scan_to(t, line);
+    if (line == t->scan_line) {
+        result = (jlong)t->scan_pos;
+    } else if (line < t->scan_line) {
+        // Walk forward from the nearest checkpoint at or before line
+        size_t k = (size_t)(line / TEXT_INDEX_STRIDE);
+        size_t pos = 0;
+        int64_t at = 0;
+        if (k > 0 && k <= t->checkpoint_count) {
+            pos = t->checkpoints[k - 1];
+            at = (int64_t)k * TEXT_INDEX_STRIDE;
+        }
+        while (at < line) {
+            pos = text_next_line(t, pos);
+            at++;
+        }
+        result = (jlong)pos;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return result;
+}
+
+// Start offset of the last `lines` lines. A trailing '\n' ends the last line
+// rather than starting an empty one.
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeTextTailOffset(JNIEnv *env, jobject clazz, jlong handle, jlong lines) {
+    TextFile* t = (TextFile*)(intptr_t)handle;
+    if (!t || t->size == 0 || lines <= 0) return t ? (jlong)t->size : -1;
+    char* buf = (char*)malloc(TEXT_SCAN_CHUNK);
+    if (!buf) return 0;
+    size_t end = t->size;
+    if (t->ends_with_newline) end--;
+    jlong result = 0;
+    // Backwards a chunk at a time; a file that shrank meanwhile reads as lines from the start
+    while (end > 0) {
+        size_t from = end > TEXT_SCAN_CHUNK ? end - TEXT_SCAN_CHUNK : 0;
+        ssize_t n = pread(t->fd, buf, end - from, (off_t)from);
+        if (n < 0 && errno == EINTR) continue;
+        if (n != (ssize_t)(end - from)) break;
+        size_t i = end - from;
+        while (i > 0) {
+            if (buf[--i] == '\n' && --lines == 0) {
+                result = (jlong)(from + i) + 1;
+                goto done;
+            }
+        }
+        end = from;
+    }
+done:
+    free(buf);
+    return result;
+}
+
+// Reads [offset, offset + length), cut short where the file now ends.
+JNIEXPORT jbyteArray JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeTextRead(JNIEnv *env, jobject clazz, jlong handle, jlong offset, jint length) {
+    TextFile* t = (TextFile*)(intptr_t)handle;
+    if (!t || offset < 0 || length < 0) return NULL;
+    size_t want = text_available(t, (size_t)offset, (size_t)length);
+    char* buf = (char*)malloc(want ? want : 1);
+    if (!buf) return NULL;
+    size_t got = 0;
+    while (got < want) {
+        ssize_t n = pread(t->fd, buf + got, want - got, (off_t)offset + (off_t)got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    jbyteArray out = (*env)->NewByteArray(env, (jsize)got);
+    if (out && got > 0) (*env)->SetByteArrayRegion(env, out, 0, (jsize)got, (const jbyte*)buf);
+    free(buf);
+    return out;
+}
+
+// Writes [offset, offset + length) to fd (the write end of a pipe) and returns
+// the bytes written, or -errno when the reader went away or a read or write
+// failed. Stops early where the file now ends.
+JNIEXPORT jlong JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeTextCopyTo(JNIEnv *env, jobject clazz, jlong handle, jlong offset, jlong length, jint fd) {
+    TextFile* t = (TextFile*)(intptr_t)handle;
+    if (!t || offset < 0 || length < 0) return -EINVAL;
+    char* buf = (char*)malloc(TEXT_COPY_CHUNK);
+    if (!buf) return -ENOMEM;
+    size_t pos = (size_t)offset;
+    size_t end = pos + text_available(t, pos, (size_t)length);
+    size_t start = pos;
+    jlong result = 0;
+    while (pos < end) {
+        size_t chunk = end - pos < TEXT_COPY_CHUNK ? end - pos : TEXT_COPY_CHUNK;
+        ssize_t n = pread(t->fd, buf, chunk, (off_t)pos);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            result = -errno;
+            break;
+        }
+        if (n == 0) break;
+        size_t done = 0;
+        while (done < (size_t)n) {
+            ssize_t w = write(fd, buf + done, (size_t)n - done);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                result = -errno;
+                break;
+            }
+            done += (size_t)w;
+        }
+        if (result < 0) break;
+        pos += (size_t)n;
+    }
+    free(buf);
+    return result < 0 ? result : (jlong)(pos - start);
+}
+
+// ==========================================
+// JNI INTERFACE (THUMBNAILS)
+// ==========================================
+
+// Maps the thumbnail cache file at cachePath, creating it when needed.
+JNIEXPORT jboolean JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeThumbOpen(JNIEnv *env, jobject clazz, jstring jCachePath) {
+    const char *cache_path = (*env)->GetStringUTFChars(env, jCachePath, NULL);
+    if (!cache_path) return JNI_FALSE;
+    int ok = thumb_cache_open(cache_path);
+    (*env)->ReleaseStringUTFChars(env, jCachePath, cache_path);
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+// The cached thumbnail of path as [format u8][orientation u8][2 reserved] plus
+// the JPEG bytes (none for THUMB_FORMAT_NONE), or null on a miss.
+JNIEXPORT jbyteArray JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeThumbGet(JNIEnv *env, jobject clazz, jstring jPath, jlong mtime, jlong size) {
+    const char *path = (*env)->GetStringUTFChars(env, jPath, NULL);
+    if (!path) return NULL;
+    uint64_t key = thumb_key_for(path, mtime, size);
+    (*env)->ReleaseStringUTFChars(env, jPath, path);
+
+    jbyteArray out = NULL;
+    pthread_mutex_lock(&g_thumbs.lock);
+    ThumbSlot* slot = thumb_find_locked(key);
+    if (slot) {
+        ThumbRecord* rec = (ThumbRecord*)(g_thumbs.data + slot->pos % THUMB_DATA_BYTES);
+        jbyte head[4] = { (jbyte)rec->format, (jbyte)rec->orientation, 0, 0 };
+        out = (*env)->NewByteArray(env, (jsize)(4 + rec->length));
+        if (out) {
+            (*env)->SetByteArrayRegion(env, out, 0, 4, head);
+            if (rec->length) (*env)->SetByteArrayRegion(env, out, 4, (jsize)rec->length, (const jbyte*)(rec + 1));
+        }
+    }
+    pthread_mutex_unlock(&g_thumbs.lock);
+    return out;
+}
+
+// Queues path for extraction at priority, higher first. Returns 1 when it is
+// already cached, 0 when queued and -1 when the request was not taken.
+JNIEXPORT jint JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeThumbRequest(JNIEnv *env, jobject clazz, jstring jPath, jlong mtime, jlong size, jint priority) {
+    const char *path = (*env)->GetStringUTFChars(env, jPath, NULL);
+    if (!path) return -1;
+    uint64_t key = thumb_key_for(path, mtime, size);
+
+    pthread_mutex_lock(&g_thumbs.lock);
+    int open = g_thumbs.map != NULL;
+    int cached = open && thumb_find_locked(key) != NULL;
+    pthread_mutex_unlock(&g_thumbs.lock);
+    if (!open || cached) {
+        (*env)->ReleaseStringUTFChars(env, jPath, path);
+        return open ? 1 : -1;
+    }
+
+    pthread_mutex_lock(&g_search_pool.lock);
+    int queued = thumb_enqueue_locked(path, key, priority);
+    if (queued) {
+        search_pool_start_locked();
+        pthread_cond_signal(&g_search_pool.work);
+    }
+    pthread_mutex_unlock(&g_search_pool.lock);
+    (*env)->ReleaseStringUTFChars(env, jPath, path);
+    return queued ? 0 : -1;
+}
+
+// Drops a queued request that is no longer needed, unless its priority has
+// since been raised to belowPriority or above.
+JNIEXPORT void JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeThumbCancel(JNIEnv *env, jobject clazz, jstring jPath, jlong mtime, jlong size, jint belowPriority) {
+    const char *path = (*env)->GetStringUTFChars(env, jPath, NULL);
+    if (!path) return;
+    uint64_t key = thumb_key_for(path, mtime, size);
+    (*env)->ReleaseStringUTFChars(env, jPath, path);
+    pthread_mutex_lock(&g_search_pool.lock);
+    thumb_cancel_locked(key, belowPriority);
+    pthread_mutex_unlock(&g_search_pool.lock);
+}
+
+// Caches a JPEG thumbnail the caller made itself, replacing a THUMB_FORMAT_NONE entry.
+JNIEXPORT jboolean JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeThumbPut(JNIEnv *env, jobject clazz, jstring jPath, jlong mtime, jlong size, jint orientation, jbyteArray jJpeg) {
+    const char *path = (*env)->GetStringUTFChars(env, jPath, NULL);
+    if (!path) return JNI_FALSE;
+    uint64_t key = thumb_key_for(path, mtime, size);
+    (*env)->ReleaseStringUTFChars(env, jPath, path);
+
+    jsize len = (*env)->GetArrayLength(env, jJpeg);
+    if (len <= 0 || len > THUMB_DATA_BYTES / 16) return JNI_FALSE;
+    jbyte* jpeg = (jbyte*)malloc((size_t)len);
+    if (!jpeg) return JNI_FALSE;
+    (*env)->GetByteArrayRegion(env, jJpeg, 0, len, jpeg);
+    pthread_mutex_lock(&g_thumbs.lock);
+    int ok = thumb_store_locked(key, THUMB_FORMAT_JPEG, orientation, jpeg, (uint32_t)len);
+    pthread_mutex_unlock(&g_thumbs.lock);
+    free(jpeg);
+    if (ok) atomic_fetch_add(&g_thumbs.version, 1);
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+// Changes whenever a request completes or a thumbnail is put.
+JNIEXPORT jint JNICALL
+Java_com_mewmix_glaive_core_NativeCore_nativeThumbVersion(JNIEnv *env, jobject clazz) {
+    return atomic_load(&g_thumbs.version);
+}
+
+// ==========================================
+// LEGACY / UTILS
+// ==========================================
+
+// Walk state for the size engine. The path is only tracked when the rules have
+// prefix excludes, in a fixed buffer.
+typedef struct {
+    const PruneRules* rules;
+    dev_t root_dev;
+    char path[PATH_MAX];
+    size_t len;                 // SIZE_MAX once the path no longer fits
+} SizeWalk;
+
+int64_t calculate_dir_size_recursive(int parent_fd, const char *path, SizeWalk* walk, int depth) {
+    int64_t total_size = 0;
+    struct stat st;
+    int dir_fd = openat(parent_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) return 0;
+    if ((walk->rules->flags & PRUNE_SAME_FS) && depth > 0) {
+        if (fstat(dir_fd, &st) != 0 || st.st_dev != walk->root_dev) {
+            close(dir_fd);
+            return 0;
+        }
+    }
+    const int track_path = walk->rules->prefix_count > 0 && walk->len != SIZE_MAX;
+    char kbuf[8192] __attribute__((aligned(8)));
+    struct linux_dirent64 *d;
+    int nread;
     while ((nread = syscall(__NR_getdents64, dir_fd, kbuf, sizeof(kbuf))) > 0) {
         int bpos = 0;
         while (bpos < nread) {
@@ -921,6 +4370,7 @@ int64_t calculate_dir_size_recursive(int parent_fd, const char *path) {
             if (d->d_name[0] == '.') {
                 if (d->d_name[1] == 0) continue;
                 if (d->d_name[1] == '.' && d->d_name[2] == 0) continue;
+                if (prune_skip_hidden(walk->rules, d->d_name)) continue;
             }
             unsigned char type = d->d_type;
             if (type == DT_UNKNOWN) {
@@ -929,7 +4379,22 @@ int64_t calculate_dir_size_recursive(int parent_fd, const char *path) {
                 }
             }
             if (type == DT_DIR) {
-                total_size += calculate_dir_size_recursive(dir_fd, d->d_name);
+                int name_len = (int)strlen(d->d_name);
+                if (prune_skip_dir(walk->rules, track_path ? walk->path : NULL, walk->len,
+                                   d->d_name, name_len, depth + 1)) continue;
+                size_t saved_len = walk->len;
+                if (track_path) {
+                    if (saved_len + 1 + name_len < sizeof(walk->path)) {
+                        walk->path[saved_len] = '/';
+                        memcpy(walk->path + saved_len + 1, d->d_name, name_len + 1);
+                        walk->len = saved_len + 1 + name_len;
+                    } else {
+                        walk->len = SIZE_MAX;
+                    }
+                }
+                total_size += calculate_dir_size_recursive(dir_fd, d->d_name, walk, depth + 1);
+                walk->len = saved_len;
+                if (track_path) walk->path[saved_len] = 0;
             } else {
                 if (d->d_type == DT_UNKNOWN) {
                      if (!S_ISDIR(st.st_mode)) total_size += st.st_size;
@@ -943,8 +4408,24 @@ int64_t calculate_dir_size_recursive(int parent_fd, const char *path) {
     return total_size;
 }
 
+// Sets up a size walk rooted at path, the directory behind root_fd.
+static void size_walk_init(SizeWalk* walk, const PruneRules* rules, int root_fd, const char* path) {
+    struct stat st;
+    walk->rules = rules;
+    walk->root_dev = fstat(root_fd, &st) == 0 ? st.st_dev : 0;
+    size_t len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') len--;
+    if (len < sizeof(walk->path)) {
+        memcpy(walk->path, path, len);
+        walk->path[len] = 0;
+        walk->len = len;
+    } else {
+        walk->len = SIZE_MAX;
+    }
+}
+
 JNIEXPORT jlong JNICALL
-Java_com_mewmix_glaive_core_NativeCore_nativeCalculateDirectorySize(JNIEnv *env, jobject clazz, jstring jPath) {
+Java_com_mewmix_glaive_core_NativeCore_nativeCalculateDirectorySize(JNIEnv *env, jobject clazz, jstring jPath, jlong pruneHandle) {
     const char *path = (*env)->GetStringUTFChars(env, jPath, NULL);
     if (path == NULL) {
         return 0;
@@ -955,7 +4436,9 @@ Java_com_mewmix_glaive_core_NativeCore_nativeCalculateDirectorySize(JNIEnv *env,
         return 0;
     }
 
-    int64_t size = calculate_dir_size_recursive(fd, ".");
+    SizeWalk walk;
+    size_walk_init(&walk, pruneHandle ? (const PruneRules*)(intptr_t)pruneHandle : &g_prune_size_default, fd, path);
+    int64_t size = calculate_dir_size_recursive(fd, ".", &walk, 0);
 
     close(fd);
     (*env)->ReleaseStringUTFChars(env, jPath, path);
@@ -988,7 +4471,9 @@ Java_com_mewmix_glaive_core_NativeCore_nativeRunBenchmark(JNIEnv *env, jobject c
     create_benchmark_files(bench_path);
     int fd = open(bench_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
     if (fd != -1) {
-        int64_t size = calculate_dir_size_recursive(fd, ".");
+        SizeWalk walk;
+        size_walk_init(&walk, &g_prune_size_default, fd, bench_path);
+        int64_t size = calculate_dir_size_recursive(fd, ".", &walk, 0);
         LOGE("BENCHMARK DIR SIZE: %lld", (long long)size);
         close(fd);
     }
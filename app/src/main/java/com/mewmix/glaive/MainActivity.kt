@@ -15,6 +15,7 @@ class MainActivity : ComponentActivity() {
         super.onCreate(savedInstanceState)
 
         com.mewmix.glaive.core.DebugLogger.init(this)
+        com.mewmix.glaive.core.Thumbnails.init(this)
         
         // CHECK: Do we have total control?
         if (!hasAllFilesAccess()) {
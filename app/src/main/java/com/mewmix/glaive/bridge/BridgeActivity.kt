@@ -9,11 +9,13 @@ import android.os.Environment
 import android.provider.Settings
 import androidx.activity.ComponentActivity
 import androidx.lifecycle.lifecycleScope
+import com.mewmix.glaive.core.FileOperations
 import com.mewmix.glaive.core.NativeCore
+import com.mewmix.glaive.core.RecordJson
+import com.mewmix.glaive.core.TextReader
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
-import org.json.JSONArray
 import org.json.JSONObject
 import java.io.File
 
@@ -66,19 +68,20 @@ class BridgeActivity : ComponentActivity() {
                 val file = File(path)
                 if (!file.exists()) throw IllegalArgumentException("Path not found: $path")
                 if (!file.isDirectory) throw IllegalArgumentException("Path is not a directory: $path")
-                val files = file.listFiles()
-                    ?: throw SecurityException("Permission Denial: Cannot list directory $path")
-                val jsonArray = JSONArray()
-                files.forEach { f ->
-                    val obj = JSONObject()
-                    obj.put("name", f.name)
-                    obj.put("path", f.absolutePath)
-                    obj.put("isDirectory", f.isDirectory)
-                    obj.put("length", f.length())
-                    obj.put("lastModified", f.lastModified())
-                    jsonArray.put(obj)
+                val page = PageParams.from(params)
+                val sortMode = RecordJson.parseSortMode(params.optString("sort"))
+                val ascending = !params.optString("order").equals("desc", ignoreCase = true)
+                val filterMask = RecordJson.parseFilterMask(params.optString("filter"))
+                // Only the requested page is stat'ed, and not at all unless size, mtime or type is asked for
+                val needStat = page.fields and (RecordJson.FIELD_SIZE or RecordJson.FIELD_MTIME or RecordJson.FIELD_TYPE) != 0
+                NativeCore.withListing(
+                    path, sortMode, ascending, filterMask,
+                    statFrom = page.start,
+                    statCount = if (needStat) page.limit else 0
+                ) { buffer, filledBytes ->
+                    if (filledBytes < 0) throw SecurityException("Permission Denial: Cannot list directory $path")
+                    RecordJson.encodePage(buffer, filledBytes, path, page.start, page.limit, page.fields)
                 }
-                jsonArray.toString()
             }
             "read_file" -> {
                 val path = normalizeToolPath(params.optString("path"))
@@ -88,8 +91,28 @@ class BridgeActivity : ComponentActivity() {
                 if (!file.exists()) throw IllegalArgumentException("File not found: $path")
                 if (!file.isFile) throw IllegalArgumentException("Path is not a file: $path")
                 if (!file.canRead()) throw SecurityException("Permission Denial: Cannot read file $path")
-                if (file.length() > 1024 * 1024) throw IllegalArgumentException("File too large (max 1MB)")
-                file.readText()
+                val lookup = { key: String -> if (params.has(key)) params.optString(key) else null }
+                val request = ReadParams.parse(lookup)
+                when {
+                    params.optBoolean("stream") -> JSONObject()
+                        .put("uri", ReadParams.streamUri(path, lookup).toString())
+                        .put("file_size", file.length())
+                        .toString()
+                    request == null && file.length() <= BridgeConstants.READ_INLINE_MAX_BYTES ->
+                        String(TextReader.read(path, TextReader.Request(), BridgeConstants.READ_INLINE_MAX_BYTES).bytes, Charsets.UTF_8)
+                    else -> {
+                        val chunk = TextReader.read(path, request ?: TextReader.Request(), BridgeConstants.READ_INLINE_MAX_BYTES)
+                        val range = chunk.range
+                        JSONObject()
+                            .put("content", String(chunk.bytes, Charsets.UTF_8))
+                            .put("offset", range.offset)
+                            .put("length", chunk.bytes.size)
+                            .put("file_size", range.fileSize)
+                            .put("next_offset", if (chunk.truncated) range.offset + chunk.bytes.size else JSONObject.NULL)
+                            .apply { range.startLine?.let { put("start_line", it) } }
+                            .toString()
+                    }
+                }
             }
             "write_file" -> {
                 val path = normalizeToolPath(params.optString("path"))
@@ -115,7 +138,7 @@ class BridgeActivity : ComponentActivity() {
                 val path = normalizeToolPath(params.optString("path"))
                 if (path.isEmpty()) throw IllegalArgumentException("Path is required")
                 requireStorageAccess(path, "delete file")
-                if (File(path).deleteRecursively()) "Success" else "Failed to delete"
+                if (FileOperations.delete(File(path))) "Success" else "Failed to delete"
             }
             "search_files" -> {
                 val rootPath = normalizeToolPath(params.optString("root_path"))
@@ -124,24 +147,56 @@ class BridgeActivity : ComponentActivity() {
                 if (query.isEmpty()) throw IllegalArgumentException("Query is required")
                 requireStorageAccess(rootPath, "search files")
 
-                // Using NativeCore.search
-                val results = NativeCore.search(rootPath, query)
-                val jsonArray = JSONArray()
-                results.forEach { item ->
-                    val obj = JSONObject()
-                    obj.put("name", item.name)
-                    obj.put("path", item.path)
-                    obj.put("type", item.type)
-                    obj.put("size", item.size)
-                    obj.put("mtime", item.mtime)
-                    jsonArray.put(obj)
+                val page = PageParams.from(params, tokens = true)
+                if (page.start >= BridgeConstants.SEARCH_MAX_RESULTS) throw IllegalArgumentException("Cursor out of range")
+
+                // Later pages come from the result the first page kept, never from a new search
+                val result = if (page.token != null) {
+                    SearchPages.get(page.token)
+                        ?: throw IllegalArgumentException("Cursor expired, search again: ${page.token}")
+                } else {
+                    // Own session with a time budget, so a slow bridge search never stalls the UI searches
+                    NativeCore.searchSession(
+                        rootPath,
+                        query,
+                        filterMask = RecordJson.parseFilterMask(params.optString("filter")),
+                        timeBudgetMs = BridgeConstants.SEARCH_BUDGET_MS,
+                        maxResults = BridgeConstants.SEARCH_MAX_RESULTS,
+                        ranked = true
+                    )
                 }
-                jsonArray.toString()
+                val token = page.token
+                    ?: if (result.items.size > page.start + page.limit) SearchPages.keep(result) else null
+                RecordJson.encodePage(
+                    result.records, result.recordBytes, result.root, page.start, page.limit, page.fields,
+                    reportTotal = false,
+                    cursorPrefix = token?.let { "$it:" } ?: "",
+                    extra = mapOf("complete" to result.isComplete)
+                )
             }
             else -> throw IllegalArgumentException("Unknown tool: $toolName")
         }
     }
 
+    /**
+     * Cursor, page size and field projection shared by the paginated tools. With [tokens] the
+     * cursor may be `<token>:<index>`, naming a result kept in [SearchPages].
+     */
+    private class PageParams(val token: String?, val start: Int, val limit: Int, val fields: Int) {
+        companion object {
+            fun from(params: JSONObject, tokens: Boolean = false): PageParams {
+                val cursor = params.optString("cursor")
+                val token = if (tokens) cursor.substringBefore(':', "").takeIf { it.isNotEmpty() } else null
+                val index = if (token != null) cursor.substringAfter(':') else cursor
+                val start = if (index.isEmpty()) 0 else index.toIntOrNull()?.takeIf { it >= 0 }
+                    ?: throw IllegalArgumentException("Invalid cursor: $cursor")
+                val limit = params.optInt("limit", BridgeConstants.DEFAULT_PAGE_SIZE)
+                    .coerceIn(1, BridgeConstants.MAX_PAGE_SIZE)
+                return PageParams(token, start, limit, RecordJson.parseFields(params.optString("fields")))
+            }
+        }
+    }
+
     private fun normalizeToolPath(rawPath: String): String {
         val trimmed = rawPath.trim().trim('"')
         if (trimmed.isEmpty()) return ""
@@ -7,4 +7,9 @@ object BridgeConstants {
     const val EXTRA_TOOL_RESULT = "TOOL_RESULT"
     const val EXTRA_TOOL_ERROR = "TOOL_ERROR"
     const val AUTHORITY = "com.mewmix.glaive.tool_provider"
+    const val SEARCH_BUDGET_MS = 10_000L
+    const val SEARCH_MAX_RESULTS = 5_000
+    const val DEFAULT_PAGE_SIZE = 500
+    const val MAX_PAGE_SIZE = 5_000
+    const val READ_INLINE_MAX_BYTES = 512 * 1024
 }
@@ -0,0 +1,50 @@
+package com.mewmix.glaive.bridge
+
+import android.net.Uri
+import com.mewmix.glaive.core.TextReader
+
+/**
+ * read_file range parameters, shared by the bridge (JSON params) and ToolProvider stream URIs
+ * (query parameters) so both spell and validate them the same way.
+ */
+internal object ReadParams {
+    private const val OFFSET = "offset"
+    private const val LENGTH = "length"
+    private const val START_LINE = "start_line"
+    private const val END_LINE = "end_line"
+    private const val TAIL_LINES = "tail_lines"
+    private val KEYS = listOf(OFFSET, LENGTH, START_LINE, END_LINE, TAIL_LINES)
+
+    const val READ_SEGMENT = "read"
+
+    /** Builds a request from raw parameter values; null when no range parameter is present. */
+    fun parse(lookup: (String) -> String?): TextReader.Request? {
+        val values = KEYS.associateWith { key ->
+            lookup(key)?.takeIf { it.isNotBlank() }?.let { raw ->
+                raw.trim().toLongOrNull()?.takeIf { it >= 0 }
+                    ?: throw IllegalArgumentException("Invalid $key: $raw")
+            }
+        }
+        if (values.values.all { it == null }) return null
+        return TextReader.Request(
+            offset = values[OFFSET] ?: 0,
+            length = values[LENGTH],
+            startLine = values[START_LINE],
+            endLine = values[END_LINE],
+            tailLines = values[TAIL_LINES]
+        )
+    }
+
+    /** content:// URI that ToolProvider.openFile streams the requested range from. */
+    fun streamUri(path: String, lookup: (String) -> String?): Uri {
+        val builder = Uri.Builder()
+            .scheme("content")
+            .authority(BridgeConstants.AUTHORITY)
+            .appendPath(READ_SEGMENT)
+            .appendQueryParameter("path", path)
+        for (key in KEYS) {
+            lookup(key)?.takeIf { it.isNotBlank() }?.let { builder.appendQueryParameter(key, it.trim()) }
+        }
+        return builder.build()
+    }
+}
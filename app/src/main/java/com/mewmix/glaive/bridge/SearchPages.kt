@@ -0,0 +1,41 @@
+package com.mewmix.glaive.bridge
+
+import android.os.SystemClock
+import com.mewmix.glaive.core.SearchResult
+import java.util.UUID
+
+/**
+ * Ranked search_files results that have more than one page. Later pages are cut from the
+ * same result through a `<token>:<index>` cursor instead of searching again, so a tree that
+ * changed in between or a time budget that ran out elsewhere never shifts matches across
+ * pages. The activity is launched per call, so the results are kept here for the process.
+ */
+internal object SearchPages {
+    private const val MAX_KEPT = 4
+    private const val MAX_AGE_MS = 10 * 60_000L
+
+    private class Kept(val result: SearchResult, val keptAt: Long)
+
+    private val kept = object : LinkedHashMap<String, Kept>(MAX_KEPT, 0.75f, true) {
+        override fun removeEldestEntry(eldest: MutableMap.MutableEntry<String, Kept>?): Boolean = size > MAX_KEPT
+    }
+
+    /** Keeps [result] and returns the token for its cursors. */
+    @Synchronized
+    fun keep(result: SearchResult): String {
+        val token = UUID.randomUUID().toString().substring(0, 8)
+        kept[token] = Kept(result, SystemClock.elapsedRealtime())
+        return token
+    }
+
+    /** The result kept under [token], or null once it was evicted or expired. */
+    @Synchronized
+    fun get(token: String): SearchResult? {
+        val entry = kept[token] ?: return null
+        if (SystemClock.elapsedRealtime() - entry.keptAt > MAX_AGE_MS) {
+            kept.remove(token)
+            return null
+        }
+        return entry.result
+    }
+}
@@ -5,9 +5,18 @@ import android.content.ContentValues
 import android.database.Cursor
 import android.database.MatrixCursor
 import android.net.Uri
+import android.os.ParcelFileDescriptor
+import com.mewmix.glaive.core.TextReader
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.SupervisorJob
+import kotlinx.coroutines.launch
 import org.json.JSONObject
+import java.io.File
+import java.io.FileNotFoundException
 
 class ToolProvider : ContentProvider() {
+    private val streamScope = CoroutineScope(SupervisorJob() + Dispatchers.IO)
 
     override fun onCreate(): Boolean {
         return true
@@ -26,15 +35,32 @@ class ToolProvider : ContentProvider() {
         // list_files
         cursor.addRow(arrayOf(
             "list_files",
-            "List files in a directory.",
-            JSONObject().put("path", "string").toString()
+            "List files in a directory, one page at a time. Returns {items, total, next_cursor}; " +
+                "pass next_cursor back as cursor for the next page. " +
+                "fields: comma list of name,path,type,size,mtime (default all; mtime in ms). " +
+                "sort: name|date|size|type, order: asc|desc. " +
+                "filter: comma list of dir,image,video,audio,apk,doc,archive,code,ebook,file " +
+                "(directories are always listed).",
+            pagedParameters().put("path", "string").put("sort", "string").put("order", "string").toString()
         ))
 
         // read_file
         cursor.addRow(arrayOf(
             "read_file",
-            "Read the content of a file (Max 1MB).",
-            JSONObject().put("path", "string").toString()
+            "Read a text file of any size. Without range parameters, small files are returned as plain text. " +
+                "Otherwise returns {content, offset, length, file_size, next_offset, start_line}; content is capped " +
+                "at 512KB and next_offset continues a cut-off read. Ranges: offset/length in bytes, " +
+                "start_line/end_line (1-based, inclusive) or tail_lines. stream: true returns {uri, file_size} " +
+                "with a content:// uri that streams the whole range.",
+            JSONObject()
+                .put("path", "string")
+                .put("offset", "integer")
+                .put("length", "integer")
+                .put("start_line", "integer")
+                .put("end_line", "integer")
+                .put("tail_lines", "integer")
+                .put("stream", "boolean")
+                .toString()
         ))
 
         // write_file
@@ -61,14 +87,45 @@ class ToolProvider : ContentProvider() {
         // search_files
         cursor.addRow(arrayOf(
             "search_files",
-            "Search for files.",
-            JSONObject().put("query", "string").put("root_path", "string").toString()
+            "Search for files by name (substring or * ? glob), best matches first. " +
+                "Returns {items, next_cursor, complete}; pass next_cursor back as cursor for the next page. " +
+                "fields and filter work as in list_files.",
+            pagedParameters().put("query", "string").put("root_path", "string").toString()
         ))
 
         return cursor
     }
 
+    private fun pagedParameters(): JSONObject = JSONObject()
+        .put("cursor", "string")
+        .put("limit", "integer")
+        .put("fields", "string")
+        .put("filter", "string")
+
+    /** Streams a read_file range (see [ReadParams.streamUri]) through a pipe, without buffering it. */
+    override fun openFile(uri: Uri, mode: String): ParcelFileDescriptor {
+        if (uri.pathSegments.firstOrNull() != ReadParams.READ_SEGMENT) throw FileNotFoundException("Unknown uri: $uri")
+        if (mode != "r") throw SecurityException("Read-only uri: $uri")
+        val path = uri.getQueryParameter("path") ?: throw FileNotFoundException("Path is required")
+        val file = File(path)
+        if (!file.isFile || !file.canRead()) throw FileNotFoundException("Cannot read file $path")
+        val request = ReadParams.parse { uri.getQueryParameter(it) } ?: TextReader.Request()
+
+        val (readSide, writeSide) = ParcelFileDescriptor.createReliablePipe()
+        streamScope.launch {
+            try {
+                TextReader.copyTo(path, request, writeSide.fd)
+                writeSide.close()
+            } catch (e: Exception) {
+                // The reader may already be gone; nothing left to report to
+                runCatching { writeSide.closeWithError(e.message ?: "Read failed") }
+            }
+        }
+        return readSide
+    }
+
     override fun getType(uri: Uri): String? {
+        if (uri.pathSegments.firstOrNull() == ReadParams.READ_SEGMENT) return "text/plain"
         return "vnd.android.cursor.dir/vnd.com.mewmix.glaive.tools"
     }
 
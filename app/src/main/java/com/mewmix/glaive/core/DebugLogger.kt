@@ -3,19 +3,26 @@ package com.mewmix.glaive.core
 import android.content.Context
 import android.util.Log
 import java.io.File
-import java.io.FileWriter
-import java.text.SimpleDateFormat
-import java.util.Date
-import java.util.Locale
-import java.util.concurrent.ConcurrentLinkedQueue
 
+/**
+ * Debug log backed by the native trace ring (TRACE LOG in glaive_core.c). A log call copies the
+ * message into the ring with one atomic slot claim and returns; a native thread formats the
+ * records and appends them to a rotating file in batches. Native timings land in the same file.
+ */
 object DebugLogger {
     private const val TAG = "GlaiveDebug"
+    private const val MAX_LOG_FILE_BYTES = 2L * 1024 * 1024
+    private const val SHOWN_LOG_LINES = 1000L
+    private const val SHOWN_LOG_MAX_BYTES = 512 * 1024
+
+    // Interned message ids, GLOG_MSG_* in glaive_core.c
+    private const val MSG_TEXT = 0
+    private const val MSG_STARTING = 1
+    private const val MSG_FINISHED = 2
+
     private var logFile: File? = null
-    private val memoryLog = ConcurrentLinkedQueue<String>()
-    private const val MAX_MEMORY_LOGS = 1000
-    private val dateFormat = SimpleDateFormat("yyyy-MM-dd HH:mm:ss.SSS", Locale.US)
 
+    @Volatile
     var isEnabled: Boolean = false
         private set
 
@@ -28,6 +35,7 @@ object DebugLogger {
             val dir = context.getExternalFilesDir(null) ?: context.filesDir
             logFile = File(dir, "glaive_debug.log")
             if (isEnabled) {
+                start()
                 log("DebugLogger initialized. Log file: ${logFile?.absolutePath}")
             }
         } catch (e: Exception) {
@@ -44,60 +52,42 @@ object DebugLogger {
         val prefs = context.getSharedPreferences("glaive_prefs", Context.MODE_PRIVATE)
         prefs.edit().putBoolean("debug_logging_enabled", enabled).apply()
         if (enabled) {
+            start()
             log("Logging enabled by user")
+        } else {
+            NativeCore.nativeLogStop()
         }
     }
 
-    fun log(message: String) {
-        if (!isEnabled) return
-
-        val timestamp = dateFormat.format(Date())
-        val formattedMessage = "$timestamp: $message"
-
-        // Logcat
-        try {
-            Log.d(TAG, message)
-        } catch (_: RuntimeException) {
-            println("$TAG: $message")
-        }
-
-        // Memory
-        memoryLog.add(formattedMessage)
-        while (memoryLog.size > MAX_MEMORY_LOGS) {
-            memoryLog.poll()
+    private fun start() {
+        val file = logFile ?: return
+        if (!NativeCore.nativeLogStart(file.absolutePath, MAX_LOG_FILE_BYTES)) {
+            Log.e(TAG, "Cannot open log file ${file.absolutePath}")
         }
+    }
 
-        // File
-        logFile?.let { file ->
-            try {
-                // Synchronized to prevent race conditions on file write
-                synchronized(this) {
-                    FileWriter(file, true).use { fw ->
-                        fw.appendLine(formattedMessage)
-                    }
-                }
-            } catch (e: Exception) {
-                // Ignore file write errors
-            }
-        }
+    fun log(message: String) {
+        if (!isEnabled) return
+        NativeCore.nativeLogWrite(Log.DEBUG, MSG_TEXT, message)
     }
 
     fun log(message: String, t: Throwable) {
         if (!isEnabled) return
-        try {
-            log("$message\n${Log.getStackTraceString(t)}")
+        val trace = try {
+            Log.getStackTraceString(t)
         } catch (_: RuntimeException) {
-            log("$message\n${t.stackTraceToString()}")
+            t.stackTraceToString()
         }
+        NativeCore.nativeLogWrite(Log.ERROR, MSG_TEXT, "$message\n$trace")
     }
 
     fun <T> log(message: String, block: () -> T): T {
         if (!isEnabled) return block()
 
-        log("$message: Starting")
+        NativeCore.nativeLogWrite(Log.DEBUG, MSG_STARTING, message)
         try {
             val result = block()
-            log("$message: Finished")
+            NativeCore.nativeLogWrite(Log.DEBUG, MSG_FINISHED, message)
             return result
         } catch (t: Throwable) {
             log("$message: Failed", t)
@@ -108,10 +98,10 @@ object DebugLogger {
     suspend fun <T> logSuspend(message: String, block: suspend () -> T): T {
         if (!isEnabled) return block()
 
-        log("$message: Starting")
+        NativeCore.nativeLogWrite(Log.DEBUG, MSG_STARTING, message)
         try {
             val result = block()
-            log("$message: Finished")
+            NativeCore.nativeLogWrite(Log.DEBUG, MSG_FINISHED, message)
             return result
         } catch (t: Throwable) {
             log("$message: Failed", t)
@@ -119,15 +109,33 @@ object DebugLogger {
         }
     }
 
+    /** The last [SHOWN_LOG_LINES] lines of the log file, including anything still in the ring. */
     fun getLogs(): String {
-        return memoryLog.joinToString("\n")
+        val file = getLogFile() ?: return ""
+        if (!file.exists()) return ""
+        return try {
+            TextReader.read(file.absolutePath, TextReader.Request(tailLines = SHOWN_LOG_LINES), SHOWN_LOG_MAX_BYTES)
+                .bytes.toString(Charsets.UTF_8)
+        } catch (_: Exception) {
+            ""
+        }
     }
 
-    fun getLogFile(): File? = logFile
+    fun getLogFile(): File? {
+        if (isEnabled) NativeCore.nativeLogFlush()
+        return logFile
+    }
 
     fun clearLogs() {
-        memoryLog.clear()
-        logFile?.delete()
-        if (isEnabled) log("Logs cleared")
+        NativeCore.nativeLogClear()
+        if (isEnabled) {
+            log("Logs cleared")
+        } else {
+            // No open log to truncate
+            logFile?.let { file ->
+                file.delete()
+                File(file.path + ".1").delete()
+            }
+        }
     }
 }
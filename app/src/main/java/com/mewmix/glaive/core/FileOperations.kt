@@ -156,14 +156,19 @@ object FileOperations {
         }
     }
 
-    suspend fun delete(target: File): Boolean = withContext(Dispatchers.IO) {
-        DebugLogger.logSuspend("Deleting ${target.path}") {
-            try {
-                target.deleteRecursively()
-            } catch (e: Exception) {
-                e.printStackTrace()
-                false
+    suspend fun delete(target: File): Boolean = deleteAll(listOf(target)).isEmpty()
+
+    /**
+     * Deletes all [targets] in one native pass so sibling trees are removed in parallel.
+     * Returns the paths that could not be removed.
+     */
+    suspend fun deleteAll(targets: List<File>, onProgress: ((Long) -> Unit)? = null): List<String> {
+        return DebugLogger.logSuspend("Deleting ${targets.size} items") {
+            val failed = NativeCore.delete(targets.map { it.path }, onProgress)
+            if (failed.isNotEmpty()) {
+                DebugLogger.log("Could not delete ${failed.size} paths, first: ${failed.first()}")
             }
+            failed
         }
     }
 
@@ -0,0 +1,145 @@
+package com.mewmix.glaive.core
+
+/**
+ * One difference between two trees. [path] is relative to both roots; sizes are -1 on the
+ * side that lacks the entry and times are in seconds.
+ */
+data class SyncDiff(
+    val path: String,
+    val kind: Int,
+    val leftIsDir: Boolean,
+    val rightIsDir: Boolean,
+    val leftSize: Long,
+    val leftMtime: Long,
+    val rightSize: Long,
+    val rightMtime: Long
+) {
+    companion object {
+        const val ONLY_LEFT = 1
+        const val ONLY_RIGHT = 2
+        const val NEWER_LEFT = 3
+        const val NEWER_RIGHT = 4
+        // Same mtime, different size
+        const val SIZE_DIFFERS = 5
+        // A file on one side, a directory on the other
+        const val TYPE_DIFFERS = 6
+
+        internal fun fromNative(path: String, info: LongArray, at: Int): SyncDiff {
+            val flags = info[at]
+            return SyncDiff(
+                path = path,
+                kind = (flags and 0xFF).toInt(),
+                leftIsDir = (flags shr 8) and 1L != 0L,
+                rightIsDir = (flags shr 9) and 1L != 0L,
+                leftSize = info[at + 1],
+                leftMtime = info[at + 2],
+                rightSize = info[at + 3],
+                rightMtime = info[at + 4]
+            )
+        }
+    }
+}
+
+/**
+ * Compares two folders (typically the two panes) and brings them in line by copying and
+ * deleting only what differs. The compare and the copies run on the native sync engine;
+ * a re-sync costs a walk of both trees plus the changed files, not a full copy.
+ */
+object FolderSync {
+    enum class Mode {
+        /** Copy entries that are missing or newer on the left to the right; never delete. */
+        UPDATE,
+        /** Make the right an exact copy of the left, deleting what the left lacks. */
+        MIRROR,
+        /** Copy missing and newer entries both ways; never delete. */
+        TWO_WAY
+    }
+
+    /**
+     * What a sync will do. [deletes] run before [copies] so that a file can replace a
+     * directory and vice versa. [conflicts] are differences the mode leaves alone.
+     */
+    class Plan(
+        val copies: List<Pair<String, String>>,
+        val deletes: List<String>,
+        val conflicts: List<SyncDiff>,
+        val copyBytes: Long
+    ) {
+        val isEmpty: Boolean get() = copies.isEmpty() && deletes.isEmpty()
+    }
+
+    class Result(val copied: Int, val deleted: Int, val failures: List<String>)
+
+    suspend fun compare(left: String, right: String, verifyContent: Boolean = false, onProgress: ((Long) -> Unit)? = null): List<SyncDiff> =
+        NativeCore.compareTrees(left, right, verifyContent, onProgress)
+
+    /** The smallest set of copies and deletes that brings [right] in line with [left] for [mode]. */
+    fun plan(left: String, right: String, diffs: List<SyncDiff>, mode: Mode): Plan {
+        val copies = mutableListOf<Pair<String, String>>()
+        val deletes = mutableListOf<String>()
+        val conflicts = mutableListOf<SyncDiff>()
+        var copyBytes = 0L
+
+        fun leftPath(diff: SyncDiff) = join(left, diff.path)
+        fun rightPath(diff: SyncDiff) = join(right, diff.path)
+        fun toRight(diff: SyncDiff) {
+            copies += leftPath(diff) to rightPath(diff)
+            copyBytes += diff.leftSize.coerceAtLeast(0)
+        }
+        fun toLeft(diff: SyncDiff) {
+            copies += rightPath(diff) to leftPath(diff)
+            copyBytes += diff.rightSize.coerceAtLeast(0)
+        }
+
+        for (diff in diffs) {
+            when (diff.kind) {
+                SyncDiff.ONLY_LEFT, SyncDiff.NEWER_LEFT -> toRight(diff)
+                SyncDiff.ONLY_RIGHT -> when (mode) {
+                    Mode.MIRROR -> deletes += rightPath(diff)
+                    Mode.TWO_WAY -> toLeft(diff)
+                    Mode.UPDATE -> Unit
+                }
+                SyncDiff.NEWER_RIGHT -> when (mode) {
+                    Mode.MIRROR -> toRight(diff)
+                    Mode.TWO_WAY -> toLeft(diff)
+                    Mode.UPDATE -> Unit
+                }
+                SyncDiff.SIZE_DIFFERS -> if (mode == Mode.TWO_WAY) conflicts += diff else toRight(diff)
+                SyncDiff.TYPE_DIFFERS -> if (mode == Mode.MIRROR) {
+                    deletes += rightPath(diff)
+                    toRight(diff)
+                } else {
+                    conflicts += diff
+                }
+            }
+        }
+        return Plan(copies, deletes, conflicts, copyBytes)
+    }
+
+    /**
+     * Runs [plan]: deletes on the native delete engine, then copies on the native copier.
+     * [onProgress] receives the bytes copied so far. Returns the paths that failed.
+     */
+    suspend fun execute(plan: Plan, onProgress: ((Long) -> Unit)? = null): Result {
+        val failures = mutableListOf<String>()
+        var deleted = plan.deletes.size
+        if (plan.deletes.isNotEmpty()) {
+            val failedDeletes = NativeCore.delete(plan.deletes)
+            deleted -= failedDeletes.size
+            failures += failedDeletes
+        }
+
+        var copied = 0
+        if (plan.copies.isNotEmpty()) {
+            val errors = NativeCore.copyTrees(plan.copies.map { it.first }, plan.copies.map { it.second }, onProgress)
+            errors.forEachIndexed { i, errno ->
+                if (errno == 0) copied++ else failures += plan.copies[i].first
+            }
+        }
+        DebugLogger.log("Sync: copied $copied, deleted $deleted, failed ${failures.size}")
+        return Result(copied, deleted, failures)
+    }
+
+    private fun join(root: String, relative: String): String =
+        if (root.endsWith("/")) root + relative else "$root/$relative"
+}
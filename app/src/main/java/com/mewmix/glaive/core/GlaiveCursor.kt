@@ -54,6 +54,12 @@ class GlaiveLazyList(
     override val size: Int
         get() = _size
 
+    /** The native records behind this list, `[0, recordBytes)` of [recordBuffer]. */
+    internal val recordBuffer: ByteBuffer
+        get() = buffer
+    internal val recordBytes: Int
+        get() = limit
+
     override fun get(index: Int): GlaiveItem {
         if (index < 0 || index >= size) throw IndexOutOfBoundsException("Index: $index, Size: $size")
         
@@ -0,0 +1,151 @@
+package com.mewmix.glaive.core
+
+import android.os.Process
+import com.mewmix.glaive.data.GlaiveItem
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.Job
+import kotlinx.coroutines.SupervisorJob
+import kotlinx.coroutines.asCoroutineDispatcher
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.withContext
+import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.util.concurrent.Executors
+
+/**
+ * Lists the subdirectories the user is likely to open next on a low-priority thread, so that
+ * opening one is served from memory instead of a cold open+getdents+sort. Candidates are the
+ * visible directories, most visited first. Prefetching yields to foreground listings: the native
+ * scan gives up as soon as one is running and the directory is retried afterwards.
+ *
+ * Prefetched listings are kept within [BUDGET_BYTES], handed out once, and dropped when the
+ * directory's mtime changed or they are older than [MAX_AGE_MS] (file sizes inside a directory
+ * can change without touching its mtime).
+ */
+object ListingPrefetcher {
+    private const val BUDGET_BYTES = 4 * 1024 * 1024
+    private const val LISTING_MAX_BYTES = 512 * 1024
+    private const val RECORD_MAX_BYTES = 2 + 255 + 16
+    private const val MAX_AGE_MS = 30_000L
+    private const val MAX_CANDIDATES = 24
+    private const val MAX_VISITS = 64
+    private const val PREEMPT_BACKOFF_MS = 50L
+
+    private data class Key(val path: String, val sortMode: Int, val asc: Boolean, val filterMask: Int)
+
+    private class Listing(val records: ByteBuffer, val bytes: Int, val dirModified: Long, val fetchedAt: Long) {
+        val isFresh: Boolean get() = System.currentTimeMillis() - fetchedAt <= MAX_AGE_MS
+    }
+
+    private val lock = Any()
+    private val listings = LinkedHashMap<Key, Listing>(16, 0.75f, true)
+    private var listingBytes = 0
+    private val pending = ArrayDeque<Key>()
+    private val visits = LinkedHashMap<String, Int>(16, 0.75f, true)
+    private var worker: Job? = null
+
+    private val scope = CoroutineScope(
+        SupervisorJob() + Executors.newSingleThreadExecutor { runnable ->
+            Thread({
+                Process.setThreadPriority(Process.THREAD_PRIORITY_LOWEST)
+                runnable.run()
+            }, "glaive-prefetch").apply { isDaemon = true }
+        }.asCoroutineDispatcher()
+    )
+
+    // Only touched by the single prefetch thread
+    private val buffer: ByteBuffer by lazy {
+        ByteBuffer.allocateDirect(LISTING_MAX_BYTES).order(ByteOrder.LITTLE_ENDIAN)
+    }
+
+    /** Records that [path] was opened; frequently visited directories are prefetched first. */
+    fun noteVisit(path: String) {
+        synchronized(lock) {
+            visits[path] = (visits[path] ?: 0) + 1
+            if (visits.size > MAX_VISITS) {
+                val eldest = visits.keys.iterator()
+                eldest.next()
+                eldest.remove()
+            }
+        }
+    }
+
+    /**
+     * Replaces the prefetch queue with [directories] (in on-screen order), listed the way the
+     * foreground will ask for them.
+     */
+    fun prefetch(directories: List<String>, sortMode: Int, asc: Boolean, filterMask: Int) {
+        synchronized(lock) {
+            pending.clear()
+            directories.take(MAX_CANDIDATES)
+                .sortedByDescending { visits[it] ?: 0 }
+                .map { Key(it, sortMode, asc, filterMask) }
+                .filter { listings[it]?.isFresh != true }
+                .forEach { pending.addLast(it) }
+            if (pending.isNotEmpty() && worker == null) {
+                worker = scope.launch { drain() }
+            }
+        }
+    }
+
+    /** The prefetched listing of [path], if it is still current. */
+    suspend fun take(path: String, sortMode: Int, asc: Boolean, filterMask: Int): List<GlaiveItem>? {
+        val listing = synchronized(lock) {
+            listings.remove(Key(path, sortMode, asc, filterMask))?.also { listingBytes -= it.bytes }
+        } ?: return null
+        if (!listing.isFresh) return null
+        // The stat can block on FUSE-backed storage, so keep it off the caller's thread
+        val dirModified = withContext(Dispatchers.IO) { File(path).lastModified() }
+        if (dirModified != listing.dirModified) return null
+        return if (listing.bytes == 0) emptyList() else GlaiveLazyList(listing.records, path, listing.bytes)
+    }
+
+    private suspend fun drain() {
+        while (true) {
+            val key = synchronized(lock) {
+                pending.removeFirstOrNull() ?: run {
+                    worker = null
+                    null
+                }
+            } ?: return
+
+            // Read before listing, so a change during the scan fails the check in take()
+            val dirModified = File(key.path).lastModified()
+            if (dirModified == 0L) continue
+
+            val filled = NativeCore.listBackground(key.path, buffer, key.sortMode, key.asc, key.filterMask)
+            when {
+                filled == NativeCore.LIST_PREEMPTED -> {
+                    synchronized(lock) { pending.addFirst(key) }
+                    delay(PREEMPT_BACKOFF_MS)
+                }
+                // Unreadable, or possibly cut short by the buffer
+                filled < 0 || filled > LISTING_MAX_BYTES - RECORD_MAX_BYTES -> Unit
+                else -> store(key, filled, dirModified)
+            }
+        }
+    }
+
+    private fun store(key: Key, filled: Int, dirModified: Long) {
+        val records = ByteBuffer.allocate(filled).order(ByteOrder.LITTLE_ENDIAN)
+        buffer.position(0)
+        buffer.limit(filled)
+        records.put(buffer)
+        records.rewind()
+        buffer.clear()
+
+        synchronized(lock) {
+            listings.put(key, Listing(records, filled, dirModified, System.currentTimeMillis()))
+                ?.let { listingBytes -= it.bytes }
+            listingBytes += filled
+            val eldest = listings.values.iterator()
+            while (listingBytes > BUDGET_BYTES && eldest.hasNext()) {
+                listingBytes -= eldest.next().bytes
+                eldest.remove()
+            }
+        }
+    }
+}
@@ -0,0 +1,183 @@
+package com.mewmix.glaive.core
+
+import android.content.Context
+import com.mewmix.glaive.data.GlaiveItem
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.SupervisorJob
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.withContext
+import java.io.File
+import java.io.RandomAccessFile
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.channels.FileChannel
+
+/**
+ * Persists rendered directory listings so panes can draw immediately on a cold start.
+ * A snapshot is the native record buffer behind the listing a pane showed last; on launch it
+ * is mmap'd straight into a [GlaiveLazyList] and the directory is relisted behind it right away,
+ * since sizes and dates of the files inside can change without touching the directory's mtime.
+ * Snapshots are only written by [saveRendered], so navigating costs no disk writes.
+ *
+ * File layout (little-endian): magic, sortMode, asc, filterMask, pathLen, recordBytes,
+ * path (UTF-8), records. Snapshots are written to a temp file and renamed into place, so a
+ * mapping of the previous version stays intact.
+ */
+object ListingSnapshots {
+    private const val DIR_NAME = "listing_snapshots"
+    private const val MAGIC = 0x324E5347 // "GSN2"
+    private const val HEADER_BYTES = 4 * 4 + 4 * 2
+    private const val MAX_SNAPSHOTS = 8
+    private const val MAX_SNAPSHOT_BYTES = 4 * 1024 * 1024
+
+    private class Rendered(
+        val path: String,
+        val sortMode: Int,
+        val asc: Boolean,
+        val filterMask: Int,
+        val items: GlaiveLazyList,
+        var saved: Boolean = false
+    )
+
+    private val lock = Any()
+    private val backgroundScope = CoroutineScope(SupervisorJob() + Dispatchers.IO)
+
+    // The directory listing each pane showed last, guarded by renderedLock
+    private val renderedLock = Any()
+    private val rendered = arrayOfNulls<Rendered>(2)
+
+    /**
+     * Lists [path] for [pane] through [show]. A pane with nothing on screen ([cold]) is first
+     * shown the saved listing; the directory is always relisted afterwards and [show] gets the
+     * fresh listing unless it has the same records as the one already shown.
+     */
+    suspend fun list(
+        context: Context,
+        pane: Int,
+        path: String,
+        sortMode: Int,
+        asc: Boolean,
+        filterMask: Int,
+        cold: Boolean,
+        show: (List<GlaiveItem>) -> Unit
+    ) {
+        val snapshot = if (cold) load(context, path, sortMode, asc, filterMask) else null
+        if (snapshot != null) show(snapshot)
+        val fresh = NativeCore.list(path, sortMode, asc, filterMask)
+        val items = if (snapshot != null && sameRecords(snapshot, fresh)) snapshot else fresh
+        if (items !== snapshot) show(items)
+        synchronized(renderedLock) {
+            rendered[pane] = (items as? GlaiveLazyList)?.let { Rendered(path, sortMode, asc, filterMask, it) }
+        }
+    }
+
+    /** Saves each pane's last directory listing as its snapshot in the background. */
+    fun saveRendered(context: Context) {
+        val dir = File(context.noBackupFilesDir, DIR_NAME)
+        val pending = synchronized(renderedLock) {
+            rendered.filterNotNull().filter { !it.saved && it.items.recordBytes <= MAX_SNAPSHOT_BYTES }
+                .onEach { it.saved = true }
+        }
+        if (pending.isEmpty()) return
+        backgroundScope.launch {
+            pending.forEach { save(dir, it.path, it.sortMode, it.asc, it.filterMask, it.items) }
+        }
+    }
+
+    private suspend fun load(context: Context, path: String, sortMode: Int, asc: Boolean, filterMask: Int): List<GlaiveItem>? = withContext(Dispatchers.IO) {
+        val file = snapshotFile(context, path)
+        if (!file.isFile) return@withContext null
+        try {
+            RandomAccessFile(file, "r").use { raf ->
+                val length = raf.length()
+                if (length < HEADER_BYTES || length > MAX_SNAPSHOT_BYTES + HEADER_BYTES + 4096) return@withContext null
+                val map = raf.channel.map(FileChannel.MapMode.READ_ONLY, 0, length).order(ByteOrder.LITTLE_ENDIAN)
+                if (map.getInt(0) != MAGIC || map.getInt(4) != sortMode || (map.getInt(8) != 0) != asc || map.getInt(12) != filterMask) {
+                    return@withContext null
+                }
+                val pathLen = map.getInt(16)
+                val recordBytes = map.getInt(20)
+                if (pathLen < 0 || recordBytes < 0 || HEADER_BYTES.toLong() + pathLen + recordBytes != length) return@withContext null
+
+                val pathBytes = ByteArray(pathLen)
+                map.position(HEADER_BYTES)
+                map.get(pathBytes)
+                if (String(pathBytes, Charsets.UTF_8) != path) return@withContext null
+
+                val records = map.slice().order(ByteOrder.LITTLE_ENDIAN)
+                if (!recordsWellFormed(records, recordBytes)) return@withContext null
+                if (recordBytes == 0) emptyList() else GlaiveLazyList(records, path, recordBytes)
+            }
+        } catch (e: Exception) {
+            DebugLogger.log("Dropping unreadable listing snapshot for $path: ${e.message}")
+            file.delete()
+            null
+        }
+    }
+
+    private fun sameRecords(a: List<GlaiveItem>, b: List<GlaiveItem>): Boolean {
+        if (a.isEmpty() || b.isEmpty()) return a.isEmpty() && b.isEmpty()
+        if (a !is GlaiveLazyList || b !is GlaiveLazyList || a.recordBytes != b.recordBytes) return false
+        val left = a.recordBuffer.duplicate().apply { position(0); limit(a.recordBytes) }
+        val right = b.recordBuffer.duplicate().apply { position(0); limit(b.recordBytes) }
+        return left == right
+    }
+
+    private fun save(dir: File, path: String, sortMode: Int, asc: Boolean, filterMask: Int, items: GlaiveLazyList) {
+        val pathBytes = path.toByteArray(Charsets.UTF_8)
+        val header = ByteBuffer.allocate(HEADER_BYTES).order(ByteOrder.LITTLE_ENDIAN)
+            .putInt(MAGIC)
+            .putInt(sortMode)
+            .putInt(if (asc) 1 else 0)
+            .putInt(filterMask)
+            .putInt(pathBytes.size)
+            .putInt(items.recordBytes)
+        header.flip()
+        val records = items.recordBuffer.duplicate()
+        records.position(0)
+        records.limit(items.recordBytes)
+
+        synchronized(lock) {
+            try {
+                if (!dir.isDirectory && !dir.mkdirs()) return
+                val target = File(dir, fileName(path))
+                val temp = File(dir, "${target.name}.tmp")
+                RandomAccessFile(temp, "rw").use { raf ->
+                    raf.setLength(0)
+                    val parts = arrayOf(header, ByteBuffer.wrap(pathBytes), records)
+                    while (records.hasRemaining() || header.hasRemaining()) raf.channel.write(parts)
+                }
+                if (!temp.renameTo(target)) {
+                    temp.delete()
+                    return
+                }
+                trim(dir)
+            } catch (e: Exception) {
+                DebugLogger.log("Failed to save listing snapshot for $path: ${e.message}")
+            }
+        }
+    }
+
+    // Lock held. Keeps the most recently written snapshots.
+    private fun trim(dir: File) {
+        val snapshots = dir.listFiles { f -> f.name.endsWith(".snap") } ?: return
+        if (snapshots.size <= MAX_SNAPSHOTS) return
+        snapshots.sortedByDescending { it.lastModified() }.drop(MAX_SNAPSHOTS).forEach { it.delete() }
+    }
+
+    private fun recordsWellFormed(records: ByteBuffer, recordBytes: Int): Boolean {
+        var pos = 0
+        while (pos < recordBytes) {
+            if (pos + 2 > recordBytes) return false
+            pos += 2 + (records.get(pos + 1).toInt() and 0xFF) + 16
+        }
+        return pos == recordBytes
+    }
+
+    private fun snapshotFile(context: Context, path: String): File =
+        File(File(context.noBackupFilesDir, DIR_NAME), fileName(path))
+
+    // The path itself is checked against the header, so a hash collision only costs a miss
+    private fun fileName(path: String): String = "%08x.snap".format(path.hashCode())
+}
@@ -2,9 +2,39 @@ package com.mewmix.glaive.core
 
 import com.mewmix.glaive.data.GlaiveItem
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.NonCancellable
+import kotlinx.coroutines.awaitCancellation
+import kotlinx.coroutines.cancelAndJoin
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
+import java.io.IOException
 import java.nio.ByteBuffer
 import java.nio.ByteOrder
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.ConcurrentLinkedQueue
+
+/**
+ * Outcome of one search session. [status] holds the SEARCH_STATUS_* bits of the native
+ * session; [records] holds the first [recordBytes] bytes of result records found before the
+ * session stopped, with paths relative to [root].
+ */
+class SearchResult(val records: ByteBuffer, val recordBytes: Int, val root: String, val status: Int) {
+    val items: List<GlaiveItem> by lazy {
+        if (recordBytes <= 0) emptyList() else GlaiveLazyList(records, root, recordBytes)
+    }
+
+    val isComplete: Boolean get() = status == 0
+    val timedOut: Boolean get() = (status and NativeCore.SEARCH_STATUS_DEADLINE) != 0
+    val capped: Boolean get() = (status and NativeCore.SEARCH_STATUS_CAPPED) != 0
+}
+
+/** What a [NativeCore.topFiles] scan ranks by; values match SEARCH_SCAN_* in glaive_core.c. */
+enum class ScanOrder(internal val nativeOrder: Int) {
+    RECENT(1),
+    LARGEST(2)
+}
 
 object NativeCore {
     init {
@@ -15,58 +45,378 @@ object NativeCore {
         ByteBuffer.allocateDirect(4 * 1024 * 1024).order(ByteOrder.LITTLE_ENDIAN)
     private val bufferLock = Any()
 
-    private external fun nativeFillBuffer(path: String, buffer: ByteBuffer, capacity: Int, sortMode: Int, asc: Boolean, filterMask: Int): Int
-    private external fun nativeSearch(root: String, query: String, buffer: ByteBuffer, capacity: Int, filterMask: Int): Int
-    private external fun nativeCalculateDirectorySize(path: String): Long
+    private external fun nativeFillBuffer(path: String, buffer: ByteBuffer, capacity: Int, sortMode: Int, asc: Boolean, filterMask: Int, statFrom: Int, statCount: Int, background: Boolean, sniffContent: Boolean): Int
+    private external fun nativeFileTypes(dir: String, files: Array<String>, names: Array<String>, sniff: Boolean): ByteArray?
+    private external fun nativeSearchCreate(timeBudgetMs: Long, maxResults: Int, ranked: Boolean, scanOrder: Int): Long
+    private external fun nativeSearch(handle: Long, root: String, query: String, buffer: ByteBuffer, capacity: Int, filterMask: Int, pruneHandle: Long): Int
+    private external fun nativeSearchStatus(handle: Long): Int
+    private external fun nativeSearchCancel(handle: Long)
+    private external fun nativeSearchHitVersion(handle: Long): Int
+    private external fun nativeSearchSnapshot(handle: Long, buffer: ByteBuffer, capacity: Int): Int
+    private external fun nativeSearchDestroy(handle: Long)
+    private external fun nativePruneCompile(excludePrefixes: Array<String>, excludeDirNames: Array<String>, maxDepth: Int, flags: Int): Long
+    private external fun nativeCalculateDirectorySize(path: String, pruneHandle: Long): Long
     private external fun nativeRunBenchmark(path: String)
-    private external fun nativeCancelSearch()
-    private external fun nativeResetSearch()
+    private external fun nativeDeleteCreate(): Long
+    private external fun nativeDeleteRun(handle: Long, paths: Array<String>): Array<String>
+    private external fun nativeDeleteProgress(handle: Long): Long
+    private external fun nativeDeleteCancel(handle: Long)
+    private external fun nativeDeleteDestroy(handle: Long)
+    private external fun nativeSyncCreate(flags: Int): Long
+    private external fun nativeSyncCompare(handle: Long, left: String, right: String): Int
+    private external fun nativeSyncDiffPaths(handle: Long): Array<String>
+    private external fun nativeSyncDiffInfo(handle: Long): LongArray
+    private external fun nativeSyncCopy(handle: Long, from: Array<String>, to: Array<String>): IntArray?
+    private external fun nativeSyncProgress(handle: Long): Long
+    private external fun nativeSyncCancel(handle: Long)
+    private external fun nativeSyncDestroy(handle: Long)
+    // Ranged text reads, used by TextReader
+    internal external fun nativeTextOpen(path: String): Long
+    internal external fun nativeTextClose(handle: Long)
+    internal external fun nativeTextSize(handle: Long): Long
+    internal external fun nativeTextLineOffset(handle: Long, line: Long): Long
+    internal external fun nativeTextTailOffset(handle: Long, lines: Long): Long
+    internal external fun nativeTextRead(handle: Long, offset: Long, length: Int): ByteArray?
+    internal external fun nativeTextCopyTo(handle: Long, offset: Long, length: Long, fd: Int): Long
+    internal external fun nativeLogStart(path: String, maxFileBytes: Long): Boolean
+    internal external fun nativeLogStop()
+    internal external fun nativeLogWrite(level: Int, messageId: Int, text: String?)
+    internal external fun nativeLogFlush()
+    internal external fun nativeLogClear()
+    internal external fun nativeThumbOpen(cachePath: String): Boolean
+    internal external fun nativeThumbGet(path: String, mtime: Long, size: Long): ByteArray?
+    internal external fun nativeThumbRequest(path: String, mtime: Long, size: Long, priority: Int): Int
+    internal external fun nativeThumbCancel(path: String, mtime: Long, size: Long, belowPriority: Int)
+    internal external fun nativeThumbPut(path: String, mtime: Long, size: Long, orientation: Int, jpeg: ByteArray): Boolean
+    internal external fun nativeThumbVersion(): Int
+    private external fun nativeRenameBatch(fromDir: String?, from: Array<String>, toDir: String?, to: Array<String>, sizes: LongArray?): IntArray?
+
+    private const val DELETE_PROGRESS_INTERVAL_MS = 100L
+    private const val SYNC_PROGRESS_INTERVAL_MS = 100L
+    private const val SYNC_FLAG_VERIFY = 1
+    private const val SYNC_DIFF_INFO_FIELDS = 5
+
+    // Rows stat'ed up front by name/type sorted listings
+    const val LIST_STAT_WINDOW = 200
+
+    /**
+     * Whether listings type files with no known extension by their first bytes. Only rows that
+     * get stat'ed are sniffed: every row for date/size sorts, the stat window otherwise.
+     */
+    @Volatile
+    var sniffUnknownTypes = true
+
+    /** Returned by [listBackground] when a foreground listing took precedence. */
+    const val LIST_PREEMPTED = -4
+
+    const val SEARCH_STATUS_CANCELLED = 1
+    const val SEARCH_STATUS_DEADLINE = 2
+    const val SEARCH_STATUS_CAPPED = 4
+
+    /** Default "best N" for ranked searches. */
+    const val DEFAULT_SEARCH_TOP_K = 2000
+
+    /** Default size of [topFiles] results. */
+    const val DEFAULT_TOP_FILES = 200
+    private const val SEARCH_UPDATE_INTERVAL_MS = 250L
+    private const val SEARCH_RECORD_MAX = 18 + 255
+
+    // Each running search owns a result buffer; a few are kept around for reuse
+    private const val SEARCH_BUFFER_SIZE = 4 * 1024 * 1024
+    private const val MAX_POOLED_SEARCH_BUFFERS = 3
+    private val searchBuffers = ConcurrentLinkedQueue<ByteBuffer>()
+    private val EMPTY_RECORDS: ByteBuffer = ByteBuffer.allocate(0)
+
+    // Compiled native rule sets live for the process, one per distinct PruneRules
+    private val pruneHandles = ConcurrentHashMap<PruneRules, Long>()
+
+    private fun pruneHandle(rules: PruneRules): Long = pruneHandles.computeIfAbsent(rules) {
+        nativePruneCompile(it.excludePrefixes.toTypedArray(), it.excludeDirNames.toTypedArray(), it.maxDepth, it.flags)
+    }
 
-    suspend fun calculateDirectorySize(path: String): Long = withContext(Dispatchers.IO) {
-        nativeCalculateDirectorySize(path)
+    suspend fun calculateDirectorySize(path: String, prune: PruneRules = PruneRules.NONE): Long = withContext(Dispatchers.IO) {
+        nativeCalculateDirectorySize(path, pruneHandle(prune))
     }
 
     suspend fun runBenchmark(path: String) = withContext(Dispatchers.IO) {
         nativeRunBenchmark(path)
     }
 
-    suspend fun list(currentPath: String, sortMode: Int = 0, asc: Boolean = true, filterMask: Int = 0): List<GlaiveItem> = withContext(Dispatchers.IO) {
-        synchronized(bufferLock) {
-            val filledBytes = nativeFillBuffer(currentPath, sharedBuffer, sharedBuffer.capacity(), sortMode, asc, filterMask)
+    suspend fun list(currentPath: String, sortMode: Int = 0, asc: Boolean = true, filterMask: Int = 0): List<GlaiveItem> =
+        ListingPrefetcher.take(currentPath, sortMode, asc, filterMask) ?: withListing(currentPath, sortMode, asc, filterMask) { buffer, filledBytes ->
             if (filledBytes <= 0) {
                 emptyList()
             } else {
                 // Copy to a new buffer to ensure stability (One-Copy)
                 val stableBuffer = ByteBuffer.allocate(filledBytes).order(ByteOrder.LITTLE_ENDIAN)
-                sharedBuffer.position(0)
-                sharedBuffer.limit(filledBytes)
-                stableBuffer.put(sharedBuffer)
+                buffer.position(0)
+                buffer.limit(filledBytes)
+                stableBuffer.put(buffer)
                 stableBuffer.rewind()
                 GlaiveLazyList(stableBuffer, currentPath, filledBytes)
             }
         }
+
+    /**
+     * Lists [path] into the shared record buffer and runs [block] on the buffer and its filled
+     * length while holding it; [block] must not keep a reference. Name and type sorts only stat
+     * [statCount] entries starting at [statFrom] of the sorted order.
+     */
+    suspend fun <T> withListing(
+        path: String,
+        sortMode: Int = 0,
+        asc: Boolean = true,
+        filterMask: Int = 0,
+        statFrom: Int = 0,
+        statCount: Int = LIST_STAT_WINDOW,
+        block: (ByteBuffer, Int) -> T
+    ): T = withContext(Dispatchers.IO) {
+        synchronized(bufferLock) {
+            val filledBytes = nativeFillBuffer(path, sharedBuffer, sharedBuffer.capacity(), sortMode, asc, filterMask, statFrom, statCount, false, sniffUnknownTypes)
+            block(sharedBuffer, filledBytes)
+        }
     }
 
-    suspend fun search(root: String, query: String, filterMask: Int = 0): List<GlaiveItem> = withContext(Dispatchers.IO) {
-        // Signal cancellation to any running search (on another thread)
-        nativeCancelSearch()
+    /**
+     * Lists [path] into the caller's [buffer] at background priority, without the shared buffer.
+     * Returns the filled length, or [LIST_PREEMPTED] as soon as a foreground listing is running.
+     */
+    internal fun listBackground(path: String, buffer: ByteBuffer, sortMode: Int, asc: Boolean, filterMask: Int): Int =
+        nativeFillBuffer(path, buffer, buffer.capacity(), sortMode, asc, filterMask, 0, LIST_STAT_WINDOW, true, sniffUnknownTypes)
 
-        synchronized(bufferLock) {
-            // Reset cancellation flag for this new search
-            nativeResetSearch()
+    /**
+     * Types of the files stored in [dir] under [files] but shown as [names], the way listings
+     * type them: by the extension of the name, and by content when that says nothing.
+     */
+    suspend fun fileTypes(dir: String, files: List<String>, names: List<String>): ByteArray = withContext(Dispatchers.IO) {
+        nativeFileTypes(dir, files.toTypedArray(), names.toTypedArray(), sniffUnknownTypes)
+            ?: ByteArray(files.size) { GlaiveItem.TYPE_FILE.toByte() }
+    }
 
-            val filledBytes = nativeSearch(root, query, sharedBuffer, sharedBuffer.capacity(), filterMask)
-            if (filledBytes <= 0) {
-                emptyList()
+    /**
+     * Best [topK] matches under [root], most relevant first. [onUpdate] receives the best matches
+     * found so far, on a background thread, whenever they change while the walk runs.
+     */
+    suspend fun search(
+        root: String,
+        query: String,
+        filterMask: Int = 0,
+        topK: Int = DEFAULT_SEARCH_TOP_K,
+        onUpdate: ((List<GlaiveItem>) -> Unit)? = null
+    ): List<GlaiveItem> = withContext(Dispatchers.IO) {
+        runSearch(root, query, filterMask, 0, topK, true, 0, PruneRules.SEARCH_DEFAULT, onUpdate).items
+    }
+
+    /**
+     * Runs one search session. Sessions are independent: each has its own cancellation
+     * (the calling coroutine), an optional [timeBudgetMs] and [maxResults] cap, and they
+     * share the native worker pool fairly, so concurrent searches never stop each other.
+     *
+     * A [ranked] session walks shallow and recently modified directories first, scores
+     * matches by name fit, depth and recency, and returns the best [maxResults] best-first,
+     * stopping early once deeper directories can no longer beat them. Unranked sessions
+     * return matches in walk order and stop after [maxResults]. [prune] decides which
+     * directories are never entered.
+     */
+    suspend fun searchSession(
+        root: String,
+        query: String,
+        filterMask: Int = 0,
+        timeBudgetMs: Long = 0,
+        maxResults: Int = 0,
+        ranked: Boolean = false,
+        prune: PruneRules = PruneRules.SEARCH_DEFAULT
+    ): SearchResult = withContext(Dispatchers.IO) {
+        runSearch(root, query, filterMask, timeBudgetMs, maxResults, ranked, 0, prune, null)
+    }
+
+    /**
+     * Storage-wide "recently modified" or "largest files": walks everything under [root] on the
+     * search pool and keeps the [count] newest or biggest files that pass [filterMask], best
+     * first. Empty files never rank as largest. [onUpdate] receives the best files found so far,
+     * on a background thread, whenever they change, so a view can fill in while the walk runs.
+     */
+    suspend fun topFiles(
+        root: String,
+        order: ScanOrder,
+        count: Int = DEFAULT_TOP_FILES,
+        filterMask: Int = 0,
+        timeBudgetMs: Long = 0,
+        prune: PruneRules = PruneRules.SEARCH_DEFAULT,
+        onUpdate: ((List<GlaiveItem>) -> Unit)? = null
+    ): SearchResult = withContext(Dispatchers.IO) {
+        runSearch(root, "", filterMask, timeBudgetMs, count, true, order.nativeOrder, prune, onUpdate)
+    }
+
+    private fun runSearch(
+        root: String,
+        query: String,
+        filterMask: Int,
+        timeBudgetMs: Long,
+        maxResults: Int,
+        ranked: Boolean,
+        scanOrder: Int,
+        prune: PruneRules,
+        onUpdate: ((List<GlaiveItem>) -> Unit)?
+    ): SearchResult {
+        val handle = nativeSearchCreate(timeBudgetMs, maxResults, ranked, scanOrder)
+        if (handle == 0L) return SearchResult(EMPTY_RECORDS, 0, root, SEARCH_STATUS_CANCELLED)
+
+        val buffer = searchBuffers.poll()
+            ?: ByteBuffer.allocateDirect(SEARCH_BUFFER_SIZE).order(ByteOrder.LITTLE_ENDIAN)
+        val onTick = onUpdate?.let { snapshotTicker(handle, root, maxResults, it) }
+        try {
+            val (filledBytes, status) = runNativeJob(
+                cancel = { nativeSearchCancel(handle) },
+                onTick = onTick,
+                tickIntervalMs = SEARCH_UPDATE_INTERVAL_MS
+            ) {
+                nativeSearch(handle, root, query, buffer, buffer.capacity(), filterMask, pruneHandle(prune)) to nativeSearchStatus(handle)
+            }
+            return if (filledBytes <= 0) {
+                SearchResult(EMPTY_RECORDS, 0, root, status)
             } else {
-                // Copy to a new buffer to ensure stability (One-Copy)
-                val stableBuffer = ByteBuffer.allocate(filledBytes).order(ByteOrder.LITTLE_ENDIAN)
-                sharedBuffer.position(0)
-                sharedBuffer.limit(filledBytes)
-                stableBuffer.put(sharedBuffer)
-                stableBuffer.rewind()
-                GlaiveLazyList(stableBuffer, root, filledBytes)
+                SearchResult(copyRecords(buffer, filledBytes), filledBytes, root, status)
+            }
+        } finally {
+            nativeSearchDestroy(handle)
+            buffer.clear()
+            if (searchBuffers.size < MAX_POOLED_SEARCH_BUFFERS) searchBuffers.offer(buffer)
+        }
+    }
+
+    // Polls the top-K heap of a running session and reports it whenever it changed
+    private fun snapshotTicker(handle: Long, root: String, maxResults: Int, onUpdate: (List<GlaiveItem>) -> Unit): () -> Unit {
+        val capacity = (maxResults.coerceAtLeast(1) * SEARCH_RECORD_MAX).coerceAtMost(SEARCH_BUFFER_SIZE)
+        val snapshot = ByteBuffer.allocateDirect(capacity).order(ByteOrder.LITTLE_ENDIAN)
+        var lastVersion = 0
+        return {
+            val version = nativeSearchHitVersion(handle)
+            if (version != lastVersion) {
+                lastVersion = version
+                val filledBytes = nativeSearchSnapshot(handle, snapshot, capacity)
+                if (filledBytes > 0) onUpdate(GlaiveLazyList(copyRecords(snapshot, filledBytes), root, filledBytes))
             }
         }
     }
+
+    // Copy to a new buffer to ensure stability (One-Copy)
+    private fun copyRecords(buffer: ByteBuffer, filledBytes: Int): ByteBuffer {
+        val stableBuffer = ByteBuffer.allocate(filledBytes).order(ByteOrder.LITTLE_ENDIAN)
+        buffer.position(0)
+        buffer.limit(filledBytes)
+        stableBuffer.put(buffer)
+        stableBuffer.rewind()
+        buffer.clear()
+        return stableBuffer
+    }
+
+    /**
+     * Renames every from[i] to to[i] in one native loop. A non-null [fromDir] or [toDir] makes
+     * that side relative to the directory. [sizes] receives each pre-rename size (-1 for
+     * directories). Returns 0 or the errno for every entry.
+     */
+    suspend fun renameBatch(fromDir: String?, from: List<String>, toDir: String?, to: List<String>, sizes: LongArray? = null): IntArray = withContext(Dispatchers.IO) {
+        nativeRenameBatch(fromDir, from.toTypedArray(), toDir, to.toTypedArray(), sizes) ?: IntArray(from.size) { -1 }
+    }
+
+    /**
+     * Recursively deletes [paths] on the native delete engine and returns the paths that
+     * could not be removed. [onProgress] receives the number of removed entries so far.
+     * Cancelling the calling coroutine stops the engine; already removed entries stay gone.
+     */
+    suspend fun delete(paths: List<String>, onProgress: ((Long) -> Unit)? = null): List<String> = withContext(Dispatchers.IO) {
+        val handle = nativeDeleteCreate()
+        if (handle == 0L) return@withContext paths
+
+        try {
+            runNativeJob(
+                cancel = { nativeDeleteCancel(handle) },
+                onTick = onProgress?.let { report -> { report(nativeDeleteProgress(handle)) } },
+                tickIntervalMs = DELETE_PROGRESS_INTERVAL_MS
+            ) {
+                nativeDeleteRun(handle, paths.toTypedArray()).toList()
+            }
+        } finally {
+            nativeDeleteDestroy(handle)
+        }
+    }
+
+    /**
+     * Compares the trees under [left] and [right] by relative path, walking both at once.
+     * With [verifyContent], same-size files whose mtimes differ are compared byte by byte
+     * and left out when identical. [onProgress] receives the number of entries compared.
+     * Throws when either root is not a readable directory.
+     */
+    suspend fun compareTrees(left: String, right: String, verifyContent: Boolean = false, onProgress: ((Long) -> Unit)? = null): List<SyncDiff> = withContext(Dispatchers.IO) {
+        val handle = nativeSyncCreate(if (verifyContent) SYNC_FLAG_VERIFY else 0)
+        if (handle == 0L) throw IllegalStateException("Failed to start compare")
+
+        try {
+            val count = runNativeJob(
+                cancel = { nativeSyncCancel(handle) },
+                onTick = onProgress?.let { report -> { report(nativeSyncProgress(handle)) } },
+                tickIntervalMs = SYNC_PROGRESS_INTERVAL_MS
+            ) {
+                nativeSyncCompare(handle, left, right)
+            }
+            if (count < 0) throw IOException("Cannot compare $left and $right (errno ${-count})")
+            val paths = nativeSyncDiffPaths(handle)
+            val info = nativeSyncDiffInfo(handle)
+            List(paths.size) { i -> SyncDiff.fromNative(paths[i], info, i * SYNC_DIFF_INFO_FIELDS) }
+        } finally {
+            nativeSyncDestroy(handle)
+        }
+    }
+
+    /**
+     * Copies every from[i] (a file or a whole tree) to to[i], keeping modification times, and
+     * returns 0 or the errno for every pair. Files are written next to their target and renamed
+     * into place once complete. [onProgress] receives the number of bytes copied so far.
+     */
+    suspend fun copyTrees(from: List<String>, to: List<String>, onProgress: ((Long) -> Unit)? = null): IntArray = withContext(Dispatchers.IO) {
+        val handle = nativeSyncCreate(0)
+        if (handle == 0L) return@withContext IntArray(from.size) { -1 }
+
+        try {
+            runNativeJob(
+                cancel = { nativeSyncCancel(handle) },
+                onTick = onProgress?.let { report -> { report(nativeSyncProgress(handle)) } },
+                tickIntervalMs = SYNC_PROGRESS_INTERVAL_MS
+            ) {
+                nativeSyncCopy(handle, from.toTypedArray(), to.toTypedArray())
+            } ?: IntArray(from.size) { -1 }
+        } finally {
+            nativeSyncDestroy(handle)
+        }
+    }
+
+    /**
+     * Runs a blocking native [block] on the current thread. A sibling coroutine calls [onTick]
+     * every [tickIntervalMs] and forwards cancellation of the caller to the job via [cancel].
+     * [cancel] also runs once the block has returned, so it must tolerate a finished job.
+     */
+    private suspend fun <T> runNativeJob(
+        cancel: () -> Unit,
+        onTick: (() -> Unit)? = null,
+        tickIntervalMs: Long = 0,
+        block: () -> T
+    ): T = coroutineScope {
+        val watcher = launch {
+            try {
+                if (onTick == null) awaitCancellation()
+                while (true) {
+                    delay(tickIntervalMs)
+                    onTick()
+                }
+            } finally {
+                cancel()
+            }
+        }
+        try {
+            block()
+        } finally {
+            withContext(NonCancellable) { watcher.cancelAndJoin() }
+        }
+    }
 }
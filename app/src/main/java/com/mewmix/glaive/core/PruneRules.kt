@@ -0,0 +1,37 @@
+package com.mewmix.glaive.core
+
+/**
+ * Which directories a native traversal (search or size scan) skips.
+ *
+ * [excludePrefixes] are absolute directory paths whose whole subtree is skipped, [excludeDirNames]
+ * are directory names or `*`/`?` globs matched case-insensitively, and [maxDepth] is the deepest
+ * directory level visited below the root (-1 for no limit). [sameFilesystem] stops at mount points
+ * and [includeHidden] visits dot-names. Rule sets are compiled once in native code and cached.
+ */
+data class PruneRules(
+    val excludePrefixes: List<String> = emptyList(),
+    val excludeDirNames: List<String> = emptyList(),
+    val maxDepth: Int = -1,
+    val sameFilesystem: Boolean = false,
+    val includeHidden: Boolean = false
+) {
+    internal val flags: Int
+        get() = (if (sameFilesystem) FLAG_SAME_FS else 0) or (if (includeHidden) FLAG_INCLUDE_HIDDEN else 0)
+
+    companion object {
+        private const val FLAG_SAME_FS = 1
+        private const val FLAG_INCLUDE_HIDDEN = 2
+
+        private val STORAGE_ROOTS = listOf("/sdcard", "/storage/emulated/0")
+
+        /** Interactive search: skips app-private trees, dependency and cache folders, and hidden entries. */
+        val SEARCH_DEFAULT = PruneRules(
+            excludePrefixes = STORAGE_ROOTS.flatMap { listOf("$it/Android/data", "$it/Android/obb") },
+            excludeDirNames = listOf("node_modules", "__pycache__", "cache", "caches"),
+            sameFilesystem = true
+        )
+
+        /** Everything, hidden entries included; what directory sizes are measured with. */
+        val NONE = PruneRules(includeHidden = true)
+    }
+}
@@ -0,0 +1,278 @@
+package com.mewmix.glaive.core
+
+import com.mewmix.glaive.data.GlaiveItem
+import java.nio.ByteBuffer
+
+/**
+ * Encodes native result records (`[type u8][nameLen u8][name][size i64][time i64]`) straight into
+ * a JSON page, without building GlaiveItems or JSONObjects. Names are copied as raw UTF-8 bytes,
+ * escaping only what JSON requires, so a page costs one output buffer and one String.
+ */
+object RecordJson {
+    const val FIELD_NAME = 1
+    const val FIELD_PATH = 2
+    const val FIELD_TYPE = 4
+    const val FIELD_SIZE = 8
+    const val FIELD_MTIME = 16
+    const val ALL_FIELDS = FIELD_NAME or FIELD_PATH or FIELD_TYPE or FIELD_SIZE or FIELD_MTIME
+
+    private val FIELD_NAMES = mapOf(
+        "name" to FIELD_NAME,
+        "path" to FIELD_PATH,
+        "type" to FIELD_TYPE,
+        "size" to FIELD_SIZE,
+        "mtime" to FIELD_MTIME
+    )
+
+    private val TYPE_NAMES = mapOf(
+        GlaiveItem.TYPE_UNKNOWN to "unknown",
+        GlaiveItem.TYPE_DIR to "dir",
+        GlaiveItem.TYPE_IMG to "image",
+        GlaiveItem.TYPE_VID to "video",
+        GlaiveItem.TYPE_APK to "apk",
+        GlaiveItem.TYPE_DOC to "doc",
+        GlaiveItem.TYPE_FILE to "file",
+        GlaiveItem.TYPE_AUDIO to "audio",
+        GlaiveItem.TYPE_ARCHIVE to "archive",
+        GlaiveItem.TYPE_CODE to "code",
+        GlaiveItem.TYPE_EBOOK to "ebook"
+    )
+
+    // Sort modes understood by nativeFillBuffer
+    private val SORT_MODES = mapOf("name" to 0, "date" to 1, "mtime" to 1, "size" to 2, "type" to 3)
+
+    private val TYPE_NAME_BYTES = TYPE_NAMES.mapValues { it.value.toByteArray(Charsets.US_ASCII) }
+
+    /** Parses a "name,size" style field list; null or blank selects every field. */
+    fun parseFields(spec: String?): Int {
+        if (spec.isNullOrBlank()) return ALL_FIELDS
+        var fields = 0
+        for (token in splitList(spec)) {
+            fields = fields or (FIELD_NAMES[token] ?: throw IllegalArgumentException("Unknown field: $token"))
+        }
+        return fields
+    }
+
+    /** Parses an "image,video" style type list into a native filterMask; 0 = no filter. */
+    fun parseFilterMask(spec: String?): Int {
+        if (spec.isNullOrBlank()) return 0
+        var mask = 0
+        for (token in splitList(spec)) {
+            val type = when (token) {
+                "document", "documents" -> GlaiveItem.TYPE_DOC
+                "directory", "folder" -> GlaiveItem.TYPE_DIR
+                "music" -> GlaiveItem.TYPE_AUDIO
+                "archives" -> GlaiveItem.TYPE_ARCHIVE
+                "book", "books", "ebooks" -> GlaiveItem.TYPE_EBOOK
+                else -> TYPE_NAMES.entries.firstOrNull { it.value == token }?.key
+                    ?: throw IllegalArgumentException("Unknown type filter: $token")
+            }
+            mask = mask or (1 shl type)
+        }
+        return mask
+    }
+
+    /** Maps "name", "date", "size" or "type" to the native sortMode. */
+    fun parseSortMode(spec: String?): Int {
+        if (spec.isNullOrBlank()) return 0
+        return SORT_MODES[spec.trim().lowercase()] ?: throw IllegalArgumentException("Unknown sort: $spec")
+    }
+
+    /**
+     * Encodes records [start, start + limit) of buffer[0, length) as
+     * `{"items":[...],"total":n,"next_cursor":"i"}`. Record names are paths relative to [parent].
+     * `total` is left out when [reportTotal] is false and `next_cursor` is null on the last page.
+     * [cursorPrefix] goes in front of the index in `next_cursor`. [extra] entries are appended
+     * as top-level fields. Times are encoded in milliseconds.
+     */
+    fun encodePage(
+        buffer: ByteBuffer,
+        length: Int,
+        parent: String,
+        start: Int,
+        limit: Int,
+        fields: Int,
+        reportTotal: Boolean = true,
+        cursorPrefix: String = "",
+        extra: Map<String, Any> = emptyMap()
+    ): String {
+        val parentBytes = (if (parent.endsWith("/")) parent else "$parent/").toByteArray(Charsets.UTF_8)
+        val out = JsonBytes(256 + limit.coerceAtMost(4096) * 96)
+
+        out.ascii("{\"items\":[")
+        var pos = 0
+        var index = 0
+        var written = 0
+        while (pos < length) {
+            val nameLen = buffer.get(pos + 1).toInt() and 0xFF
+            if (index >= start && written < limit) {
+                if (written > 0) out.byte(','.code)
+                encodeRecord(buffer, pos, nameLen, parentBytes, fields, out)
+                written++
+            }
+            pos += 18 + nameLen
+            index++
+        }
+        out.byte(']'.code)
+
+        if (reportTotal) {
+            out.ascii(",\"total\":")
+            out.number(index.toLong())
+        }
+        out.ascii(",\"next_cursor\":")
+        val next = start + written
+        if (next < index) {
+            out.byte('"'.code)
+            out.ascii(cursorPrefix)
+            out.number(next.toLong())
+            out.byte('"'.code)
+        } else {
+            out.ascii("null")
+        }
+        for ((key, value) in extra) {
+            out.byte(','.code)
+            out.string(key.toByteArray(Charsets.UTF_8))
+            out.byte(':'.code)
+            when (value) {
+                is Boolean -> out.ascii(value.toString())
+                is Number -> out.number(value.toLong())
+                else -> out.string(value.toString().toByteArray(Charsets.UTF_8))
+            }
+        }
+        out.byte('}'.code)
+        return out.toUtf8String()
+    }
+
+    private fun encodeRecord(buffer: ByteBuffer, pos: Int, nameLen: Int, parentBytes: ByteArray, fields: Int, out: JsonBytes) {
+        val nameStart = pos + 2
+        // Search records carry a relative path; the display name is its last segment
+        var baseStart = nameStart
+        for (i in nameStart until nameStart + nameLen) {
+            if (buffer.get(i) == '/'.code.toByte()) baseStart = i + 1
+        }
+
+        var keys = 0
+        out.byte('{'.code)
+        if (fields and FIELD_NAME != 0) {
+            out.key("name", keys++)
+            out.byte('"'.code)
+            out.escaped(buffer, baseStart, nameStart + nameLen)
+            out.byte('"'.code)
+        }
+        if (fields and FIELD_PATH != 0) {
+            out.key("path", keys++)
+            out.byte('"'.code)
+            out.escaped(parentBytes)
+            out.escaped(buffer, nameStart, nameStart + nameLen)
+            out.byte('"'.code)
+        }
+        if (fields and FIELD_TYPE != 0) {
+            out.key("type", keys++)
+            out.byte('"'.code)
+            out.bytes(TYPE_NAME_BYTES[buffer.get(pos).toInt() and 0xFF] ?: TYPE_NAME_BYTES.getValue(GlaiveItem.TYPE_UNKNOWN))
+            out.byte('"'.code)
+        }
+        if (fields and FIELD_SIZE != 0) {
+            out.key("size", keys++)
+            out.number(buffer.getLong(nameStart + nameLen))
+        }
+        if (fields and FIELD_MTIME != 0) {
+            out.key("mtime", keys++)
+            out.number(buffer.getLong(nameStart + nameLen + 8) * 1000)
+        }
+        out.byte('}'.code)
+    }
+
+    private fun splitList(spec: String): List<String> =
+        spec.split(',').map { it.trim().lowercase() }.filter { it.isNotEmpty() }
+
+    /** Growable UTF-8 output buffer. */
+    private class JsonBytes(initialCapacity: Int) {
+        private var buf = ByteArray(initialCapacity)
+        private var len = 0
+        private val digits = ByteArray(20)
+
+        private fun ensure(extra: Int) {
+            if (len + extra > buf.size) buf = buf.copyOf(maxOf(buf.size * 2, len + extra))
+        }
+
+        fun key(name: String, index: Int) {
+            if (index > 0) byte(','.code)
+            byte('"'.code)
+            ascii(name)
+            ascii("\":")
+        }
+
+        fun byte(b: Int) {
+            ensure(1)
+            buf[len++] = b.toByte()
+        }
+
+        fun bytes(src: ByteArray) {
+            ensure(src.size)
+            System.arraycopy(src, 0, buf, len, src.size)
+            len += src.size
+        }
+
+        fun ascii(s: String) {
+            ensure(s.length)
+            for (c in s) buf[len++] = c.code.toByte()
+        }
+
+        fun number(value: Long) {
+            if (value == Long.MIN_VALUE) {
+                ascii(value.toString())
+                return
+            }
+            var v = value
+            if (v < 0) {
+                byte('-'.code)
+                v = -v
+            }
+            var n = 0
+            do {
+                digits[n++] = ('0'.code + (v % 10).toInt()).toByte()
+                v /= 10
+            } while (v > 0)
+            ensure(n)
+            while (n > 0) buf[len++] = digits[--n]
+        }
+
+        fun string(src: ByteArray) {
+            byte('"'.code)
+            escaped(src)
+            byte('"'.code)
+        }
+
+        fun escaped(src: ByteArray) {
+            for (b in src) escapedByte(b)
+        }
+
+        fun escaped(src: ByteBuffer, from: Int, to: Int) {
+            ensure(to - from)
+            for (i in from until to) escapedByte(src.get(i))
+        }
+
+        private fun escapedByte(b: Byte) {
+            val c = b.toInt() and 0xFF
+            when {
+                c == '"'.code || c == '\\'.code -> {
+                    byte('\\'.code)
+                    byte(c)
+                }
+                c < 0x20 -> {
+                    ascii("\\u00")
+                    byte(HEX[c shr 4].code)
+                    byte(HEX[c and 0xF].code)
+                }
+                else -> byte(c)
+            }
+        }
+
+        fun toUtf8String(): String = String(buf, 0, len, Charsets.UTF_8)
+
+        companion object {
+            private const val HEX = "0123456789abcdef"
+        }
+    }
+}
@@ -1,186 +1,308 @@
 package com.mewmix.glaive.core
 
+import com.mewmix.glaive.data.GlaiveItem
 import java.io.File
 import java.io.FileInputStream
-import java.io.FileOutputStream
 import java.io.ObjectInputStream
-import java.io.ObjectOutputStream
-import java.util.concurrent.ConcurrentHashMap
+import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.SupervisorJob
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
 import kotlinx.coroutines.withContext
 
 /**
  * Manages the Recycle Bin (.glaive_trash folder).
- * Stores metadata in a simple object file to map trash items back to their original paths.
+ * Metadata (original path, size, deletion time) lives in an append-only [TrashJournal], so
+ * trashing or restoring costs one small append and the bin can be listed without touching
+ * the trashed files. Moves in and out of the bin are batched into one native rename loop.
  */
 object RecycleBinManager {
     private const val TRASH_DIR_NAME = ".glaive_trash"
-    private const val INDEX_FILE_NAME = "restore.index"
+    private const val LEGACY_INDEX_FILE_NAME = "restore.index"
+    private const val JOURNAL_FILE_NAME = "restore.journal"
+    // Compact once superseded records outnumber live ones and there are enough to matter
+    private const val COMPACT_MIN_DEAD_RECORDS = 256
 
-    // In-memory cache of the index: Map<TrashFileName, OriginalPath>
-    private val index = ConcurrentHashMap<String, String>()
-    private var isInitialized = false
+    // In-memory view of the journal: TrashFileName -> entry, in trash order. Guarded by [lock].
+    private val index = LinkedHashMap<String, TrashEntry>()
+    private val lock = Mutex()
+    private val backgroundScope = CoroutineScope(SupervisorJob() + Dispatchers.IO)
+    private var journal: TrashJournal? = null
+    private var lastTrashId = 0L
 
     private fun getTrashDir(): File {
         val root = File("/storage/emulated/0") // Hardcoded root as per project convention
         return File(root, TRASH_DIR_NAME)
     }
 
-    private suspend fun ensureInitialized() {
-        if (!isInitialized) {
-            loadIndex()
-            isInitialized = true
-        }
+    private fun isMetadataFile(name: String): Boolean {
+        return name == JOURNAL_FILE_NAME || name == "$JOURNAL_FILE_NAME.tmp" || name == LEGACY_INDEX_FILE_NAME
     }
 
-    private suspend fun loadIndex() = withContext(Dispatchers.IO) {
+    // Callers must hold [lock].
+    private fun ensureInitialized(): TrashJournal {
+        journal?.let { return it }
         val trashDir = getTrashDir()
         if (!trashDir.exists()) trashDir.mkdirs()
 
-        val indexFile = File(trashDir, INDEX_FILE_NAME)
-        if (indexFile.exists()) {
+        val loaded = TrashJournal(File(trashDir, JOURNAL_FILE_NAME))
+        try {
+            if (loaded.exists()) index.putAll(loaded.load()) else migrate(trashDir, loaded)
+        } catch (e: Exception) {
+            DebugLogger.log("Failed to load recycle bin journal", e)
+            // Files are safe; rebuild entries from disk so the bin stays browsable,
+            // accepting the loss of restore paths.
+            index.clear()
+            migrate(trashDir, loaded)
+        }
+        journal = loaded
+        return loaded
+    }
+
+    // One-time import of the old ObjectOutputStream index plus anything untracked on disk.
+    private fun migrate(trashDir: File, target: TrashJournal) {
+        val legacyFile = File(trashDir, LEGACY_INDEX_FILE_NAME)
+        var legacy: Map<String, String> = emptyMap()
+        if (legacyFile.exists()) {
             try {
-                ObjectInputStream(FileInputStream(indexFile)).use { ois ->
+                ObjectInputStream(FileInputStream(legacyFile)).use { ois ->
                     @Suppress("UNCHECKED_CAST")
-                    val loaded = ois.readObject() as Map<String, String>
-                    index.putAll(loaded)
+                    legacy = ois.readObject() as Map<String, String>
                 }
             } catch (e: Exception) {
-                DebugLogger.log("Failed to load recycle bin index", e)
-                // If index is corrupt, we might lose restore paths, but files are safe.
-                // We could rebuild index from filenames if we encoded path in filename,
-                // but for now we accept the loss of restore metadata.
+                DebugLogger.log("Failed to load legacy recycle bin index", e)
             }
         }
+
+        trashDir.listFiles()?.forEach { file ->
+            if (isMetadataFile(file.name)) return@forEach
+            val isDirectory = file.isDirectory
+            index[file.name] = TrashEntry(
+                trashName = file.name,
+                originalPath = legacy[file.name] ?: "",
+                size = if (isDirectory) -1 else file.length(),
+                deletedAt = file.lastModified(),
+                isDirectory = isDirectory
+            )
+        }
+        target.rewrite(index.values)
+        legacyFile.delete()
+        scheduleSizeFill(index.values.filter { it.size < 0 }.map { it.trashName })
     }
 
-    private suspend fun saveIndex() = withContext(Dispatchers.IO) {
-        val trashDir = getTrashDir()
-        if (!trashDir.exists()) trashDir.mkdirs()
+    // Ids strictly increase so names stay unique even for a batch trashed within one millisecond.
+    private fun nextTrashName(name: String): String {
+        var candidate: String
+        do {
+            lastTrashId = maxOf(lastTrashId + 1, System.currentTimeMillis())
+            candidate = "${lastTrashId}_$name"
+        } while (index.containsKey(candidate))
+        return candidate
+    }
 
-        val indexFile = File(trashDir, INDEX_FILE_NAME)
-        try {
-            ObjectOutputStream(FileOutputStream(indexFile)).use { oos ->
-                oos.writeObject(HashMap(index))
+    private fun maybeCompact(current: TrashJournal) {
+        val dead = current.recordCount - index.size
+        if (dead < COMPACT_MIN_DEAD_RECORDS || dead <= index.size) return
+        backgroundScope.launch {
+            lock.withLock {
+                if (current.recordCount - index.size < COMPACT_MIN_DEAD_RECORDS) return@withLock
+                try {
+                    current.rewrite(index.values)
+                } catch (e: Exception) {
+                    DebugLogger.log("Failed to compact recycle bin journal", e)
+                }
             }
-        } catch (e: Exception) {
-            DebugLogger.log("Failed to save recycle bin index", e)
         }
     }
 
-    suspend fun moveToTrash(file: File): Boolean = withContext(Dispatchers.IO) {
-        ensureInitialized()
-        DebugLogger.logSuspend("Moving ${file.path} to Recycle Bin") {
-            try {
-                val trashDir = getTrashDir()
-                if (!trashDir.exists()) trashDir.mkdirs()
-
-                // Unique name: timestamp_filename
-                val timestamp = System.currentTimeMillis()
-                val trashName = "${timestamp}_${file.name}"
-                val trashFile = File(trashDir, trashName)
-
-                if (file.renameTo(trashFile)) {
-                    index[trashName] = file.absolutePath
-                    saveIndex()
-                    true
-                } else {
-                    // Fallback to copy-delete
-                     if (FileOperations.copy(file, trashDir)) {
-                         val copiedFile = File(trashDir, file.name)
-                         // We need to rename the copied file to match our trashName scheme
-                         if (copiedFile.renameTo(trashFile)) {
-                            FileOperations.delete(file)
-                            index[trashName] = file.absolutePath
-                            saveIndex()
-                            true
-                         } else {
-                             // Failed to rename inside trash, cleanup
-                             copiedFile.delete()
-                             false
-                         }
-                     } else {
-                         false
-                     }
+    // Trashed directories are measured after the move so trashing never waits on a tree walk.
+    private fun scheduleSizeFill(trashNames: List<String>) {
+        if (trashNames.isEmpty()) return
+        backgroundScope.launch {
+            val trashDir = getTrashDir()
+            val sizes = trashNames.associateWith { NativeCore.calculateDirectorySize(File(trashDir, it).path) }
+            lock.withLock {
+                val live = sizes.filterKeys { index.containsKey(it) }
+                live.forEach { (name, size) -> index[name] = index.getValue(name).copy(size = size) }
+                try {
+                    journal?.appendSizes(live)
+                } catch (e: Exception) {
+                    DebugLogger.log("Failed to record recycle bin sizes", e)
                 }
-            } catch (e: Exception) {
-                DebugLogger.log("Error moving to trash", e)
-                false
             }
         }
     }
 
-    suspend fun restore(trashFile: File): Boolean = withContext(Dispatchers.IO) {
-        ensureInitialized()
-        DebugLogger.logSuspend("Restoring ${trashFile.name}") {
-            try {
-                val originalPath = index[trashFile.name] ?: return@logSuspend false
-                val originalFile = File(originalPath)
-
-                // Ensure parent exists
-                originalFile.parentFile?.mkdirs()
-
-                // Check collision
-                val finalDest = if (originalFile.exists()) {
-                    // Conflict: rename restored file
-                    File(originalFile.parent, "restored_${originalFile.name}")
-                } else {
-                    originalFile
-                }
+    suspend fun moveToTrash(file: File): Boolean = moveToTrash(listOf(file)).isEmpty()
 
-                if (trashFile.renameTo(finalDest)) {
-                    index.remove(trashFile.name)
-                    saveIndex()
-                    true
-                } else {
-                    // Fallback copy
-                    if (FileOperations.copy(trashFile, finalDest.parentFile!!)) {
-                         // copy puts it as trashFile.name, rename it
-                         val temp = File(finalDest.parentFile, trashFile.name)
-                         temp.renameTo(finalDest)
-
-                         trashFile.delete()
-                         index.remove(trashFile.name)
-                         saveIndex()
-                         true
+    /** Moves [files] into the bin and returns the ones that could not be moved. */
+    suspend fun moveToTrash(files: List<File>): List<File> = withContext(Dispatchers.IO) {
+        DebugLogger.logSuspend("Moving ${files.size} items to Recycle Bin") {
+            lock.withLock {
+                val current = ensureInitialized()
+                val trashDir = getTrashDir()
+                val names = files.map { nextTrashName(it.name) }
+                val sizes = LongArray(files.size)
+                val errors = NativeCore.renameBatch(null, files.map { it.absolutePath }, trashDir.path, names, sizes)
+
+                val now = System.currentTimeMillis()
+                val added = ArrayList<TrashEntry>(files.size)
+                val failed = ArrayList<File>()
+                files.forEachIndexed { i, file ->
+                    if (errors[i] == 0) {
+                        added += TrashEntry(names[i], file.absolutePath, sizes[i], now, sizes[i] < 0)
                     } else {
-                        false
+                        val isDirectory = file.isDirectory
+                        val size = if (isDirectory) -1L else file.length()
+                        if (copyIntoTrash(file, trashDir, names[i])) {
+                            added += TrashEntry(names[i], file.absolutePath, size, now, isDirectory)
+                        } else {
+                            failed += file
+                        }
                     }
                 }
-            } catch (e: Exception) {
-                DebugLogger.log("Error restoring file", e)
-                false
+
+                try {
+                    current.appendAdded(added)
+                } catch (e: Exception) {
+                    DebugLogger.log("Failed to record trashed items", e)
+                }
+                added.forEach { index[it.trashName] = it }
+                maybeCompact(current)
+                scheduleSizeFill(added.filter { it.size < 0 }.map { it.trashName })
+                failed
             }
         }
     }
 
-    suspend fun deletePermanently(trashFile: File): Boolean = withContext(Dispatchers.IO) {
-        ensureInitialized()
-        DebugLogger.logSuspend("Permanently deleting ${trashFile.name}") {
-            val result = FileOperations.delete(trashFile)
-            if (result || !trashFile.exists()) {
-                index.remove(trashFile.name)
-                saveIndex()
-                true
-            } else {
-                false
+    // Fallback to copy-delete when rename is impossible (e.g. across volumes)
+    private suspend fun copyIntoTrash(file: File, trashDir: File, trashName: String): Boolean {
+        if (!FileOperations.copy(file, trashDir)) return false
+        val copiedFile = File(trashDir, file.name)
+        if (!copiedFile.renameTo(File(trashDir, trashName))) {
+            // Failed to rename inside trash, cleanup
+            FileOperations.delete(copiedFile)
+            return false
+        }
+        FileOperations.delete(file)
+        return true
+    }
+
+    suspend fun restore(trashFile: File): Boolean = restore(listOf(trashFile)).isEmpty()
+
+    /** Moves [trashFiles] back to their original paths and returns the ones that could not be restored. */
+    suspend fun restore(trashFiles: List<File>): List<File> = withContext(Dispatchers.IO) {
+        DebugLogger.logSuspend("Restoring ${trashFiles.size} items") {
+            lock.withLock {
+                val current = ensureInitialized()
+                val trashPath = getTrashPath()
+                val failed = ArrayList<File>()
+                val targets = ArrayList<File>(trashFiles.size)
+                trashFiles.forEach { file ->
+                    val known = file.parent == trashPath && index[file.name]?.originalPath?.isNotEmpty() == true
+                    if (known) targets += file else failed += file
+                }
+
+                val claimed = HashSet<String>()
+                val destinations = targets.map { file ->
+                    val originalFile = File(index.getValue(file.name).originalPath)
+                    // Ensure parent exists
+                    originalFile.parentFile?.mkdirs()
+                    // Every destination is claimed, fallbacks included, so no two items of the batch share one
+                    freeDestination(originalFile, claimed).also { claimed += it.path }
+                }
+                // Never replaces an existing file; a destination taken meanwhile fails with EEXIST
+                val errors = NativeCore.renameBatch(trashPath, targets.map { it.name }, null, destinations.map { it.path })
+
+                val restored = ArrayList<String>(targets.size)
+                targets.forEachIndexed { i, file ->
+                    if (errors[i] == 0 || copyOutOfTrash(file, destinations[i])) restored += file.name else failed += file
+                }
+
+                try {
+                    current.appendRemoved(restored)
+                } catch (e: Exception) {
+                    DebugLogger.log("Failed to record restored items", e)
+                }
+                restored.forEach { index.remove(it) }
+                maybeCompact(current)
+                failed
             }
         }
     }
 
+    /** [original], or the first of `restored_<name>`, `restored_1_<name>`, ... neither on disk nor in [claimed]. */
+    private fun freeDestination(original: File, claimed: Set<String>): File {
+        var candidate = original
+        var n = 0
+        while (candidate.exists() || candidate.path in claimed) {
+            val prefix = if (n == 0) "restored_" else "restored_${n}_"
+            candidate = File(original.parent, prefix + original.name)
+            n++
+        }
+        return candidate
+    }
+
+    // The trash item is only deleted once the copy is in place at finalDest
+    private suspend fun copyOutOfTrash(trashFile: File, finalDest: File): Boolean {
+        val parent = finalDest.parentFile ?: return false
+        // copy puts it as trashFile.name; neither that nor finalDest may replace anything
+        val staged = File(parent, trashFile.name)
+        if (finalDest.exists() || staged.exists()) return false
+        if (!FileOperations.copy(trashFile, parent)) {
+            FileOperations.delete(staged)
+            return false
+        }
+        if (NativeCore.renameBatch(null, listOf(staged.path), null, listOf(finalDest.path))[0] != 0 || !finalDest.exists()) {
+            FileOperations.delete(staged)
+            return false
+        }
+        FileOperations.delete(trashFile)
+        return true
+    }
+
+    suspend fun deletePermanently(trashFile: File): Boolean = deletePermanently(listOf(trashFile)).isEmpty()
+
+    /** Deletes [trashFiles] for good and returns the ones that are still on disk. */
+    suspend fun deletePermanently(trashFiles: List<File>): List<File> = withContext(Dispatchers.IO) {
+        DebugLogger.logSuspend("Permanently deleting ${trashFiles.size} items") {
+            val failedPaths = FileOperations.deleteAll(trashFiles)
+            val failed = if (failedPaths.isEmpty()) emptyList() else trashFiles.filter { it.exists() }
+            lock.withLock {
+                val current = ensureInitialized()
+                val trashPath = getTrashPath()
+                val removed = trashFiles.filter { it.parent == trashPath && it !in failed && index.containsKey(it.name) }
+                    .map { it.name }
+                try {
+                    current.appendRemoved(removed)
+                } catch (e: Exception) {
+                    DebugLogger.log("Failed to record deleted items", e)
+                }
+                removed.forEach { index.remove(it) }
+                maybeCompact(current)
+            }
+            failed
+        }
+    }
+
     suspend fun emptyBin(): Boolean = withContext(Dispatchers.IO) {
-        ensureInitialized()
         DebugLogger.logSuspend("Emptying Recycle Bin") {
             try {
-                val trashDir = getTrashDir()
-                trashDir.listFiles()?.forEach { file ->
-                    if (file.name != INDEX_FILE_NAME) {
-                        FileOperations.delete(file)
+                lock.withLock {
+                    val current = ensureInitialized()
+                    val trashDir = getTrashDir()
+                    val items = trashDir.listFiles()?.filter { !isMetadataFile(it.name) } ?: emptyList()
+                    val failed = FileOperations.deleteAll(items)
+                    if (failed.isEmpty()) {
+                        index.clear()
+                    } else {
+                        index.keys.retainAll { File(trashDir, it).exists() }
                     }
+                    current.rewrite(index.values)
+                    failed.isEmpty()
                 }
-                index.clear()
-                saveIndex()
-                true
             } catch (e: Exception) {
                 DebugLogger.log("Error emptying bin", e)
                 false
@@ -188,16 +310,51 @@ object RecycleBinManager {
         }
     }
 
+    /** Bin contents, newest first, straight from the journal. */
+    suspend fun listEntries(): List<TrashEntry> = withContext(Dispatchers.IO) {
+        lock.withLock {
+            ensureInitialized()
+            index.values.sortedByDescending { it.deletedAt }
+        }
+    }
+
+    /** Total size of the bin from the journal; directories still being measured count as 0. */
+    suspend fun totalSize(): Long = listEntries().sumOf { maxOf(it.size, 0L) }
+
+    /**
+     * Items for the browser. The bin itself is listed from the journal under the original
+     * names; folders inside trashed directories are listed natively like any other folder.
+     */
+    suspend fun listItems(path: String): List<GlaiveItem> {
+        val trashDir = getTrashDir()
+        if (File(path) != trashDir) return NativeCore.list(path)
+        val entries = listEntries()
+        val names = entries.map { if (it.originalPath.isNotEmpty()) File(it.originalPath).name else it.trashName }
+        // Typed by the original name, like the listing they were deleted from
+        val types = NativeCore.fileTypes(trashDir.path, entries.map { it.trashName }, names)
+        return entries.mapIndexed { i, entry ->
+            GlaiveItem(
+                name = names[i],
+                path = File(trashDir, entry.trashName).path,
+                type = if (entry.isDirectory) GlaiveItem.TYPE_DIR else types[i].toInt(),
+                size = maxOf(entry.size, 0L),
+                mtime = entry.deletedAt
+            )
+        }
+    }
+
     fun isTrashItem(path: String): Boolean {
-        return path.contains("/${TRASH_DIR_NAME}/")
+        return path.contains("/${TRASH_DIR_NAME}/") || path.endsWith("/$TRASH_DIR_NAME")
     }
 
     fun getTrashPath(): String {
         return getTrashDir().absolutePath
     }
 
-    suspend fun getOriginalPath(trashFile: File): String? {
-        ensureInitialized()
-        return index[trashFile.name]
+    suspend fun getOriginalPath(trashFile: File): String? = withContext(Dispatchers.IO) {
+        lock.withLock {
+            ensureInitialized()
+            index[trashFile.name]?.originalPath?.takeIf { it.isNotEmpty() }
+        }
     }
 }
@@ -0,0 +1,153 @@
+package com.mewmix.glaive.core
+
+import java.io.File
+import java.io.FileNotFoundException
+import java.io.IOException
+
+/**
+ * Ranged reads of arbitrarily large text files. Files are read natively with pread, so one
+ * truncated while open just reads short, and line numbers are resolved through a sparse
+ * line-offset index that only grows as far as a request needs, so seeking to line 500,000 of a
+ * large log scans it once and later seeks start from a checkpoint. The last few files stay
+ * open, index included, as long as their size and mtime don't change.
+ */
+object TextReader {
+    private const val MAX_OPEN_FILES = 4
+
+    /**
+     * What to read. [tailLines] wins over a line range, and a line range ([startLine] and
+     * [endLine], 1-based and inclusive) wins over the byte range [offset]/[length].
+     */
+    data class Request(
+        val offset: Long = 0,
+        val length: Long? = null,
+        val startLine: Long? = null,
+        val endLine: Long? = null,
+        val tailLines: Long? = null
+    )
+
+    /** A resolved byte range of a file of [fileSize] bytes; [startLine] is set for line reads. */
+    data class Range(val offset: Long, val length: Long, val fileSize: Long, val startLine: Long? = null)
+
+    /** Bytes read for a request. When [truncated], the range continues at `range.offset + bytes.size`. */
+    class Chunk(val range: Range, val bytes: ByteArray, val truncated: Boolean)
+
+    private class Handle(val native: Long, val length: Long, val lastModified: Long) {
+        var refs = 0
+        var retired = false
+    }
+
+    private val handles = LinkedHashMap<String, Handle>(MAX_OPEN_FILES, 0.75f, true)
+
+    /** Reads at most [maxBytes] of the requested range, cut back to a line or UTF-8 boundary. */
+    fun read(path: String, request: Request, maxBytes: Int): Chunk = withFile(path) { handle ->
+        val range = resolve(handle, request)
+        val truncated = range.length > maxBytes
+        var bytes = NativeCore.nativeTextRead(handle.native, range.offset, minOf(range.length, maxBytes.toLong()).toInt())
+            ?: throw IOException("Failed to read $path")
+        if (truncated) bytes = bytes.copyOf(cutPoint(bytes, lineMode = range.startLine != null))
+        Chunk(range, bytes, truncated)
+    }
+
+    /** Streams the requested range into [fd] and returns the bytes written. */
+    fun copyTo(path: String, request: Request, fd: Int): Long = withFile(path) { handle ->
+        val range = resolve(handle, request)
+        val written = NativeCore.nativeTextCopyTo(handle.native, range.offset, range.length, fd)
+        if (written < 0) throw IOException("Failed to stream $path (errno ${-written})")
+        written
+    }
+
+    private fun resolve(handle: Handle, request: Request): Range {
+        val size = NativeCore.nativeTextSize(handle.native)
+        request.tailLines?.let { lines ->
+            val start = NativeCore.nativeTextTailOffset(handle.native, lines)
+            return Range(start, size - start, size)
+        }
+        if (request.startLine != null || request.endLine != null) {
+            val first = (request.startLine ?: 1).coerceAtLeast(1)
+            val start = NativeCore.nativeTextLineOffset(handle.native, first - 1)
+            if (start < 0) return Range(size, 0, size, first)
+            // 0-based line endLine is the one right after the last requested line
+            val end = request.endLine?.let { NativeCore.nativeTextLineOffset(handle.native, it) }
+                ?.takeIf { it >= 0 } ?: size
+            return Range(start, (end - start).coerceAtLeast(0), size, first)
+        }
+        val start = request.offset.coerceIn(0, size)
+        val length = (request.length ?: (size - start)).coerceIn(0, size - start)
+        return Range(start, length, size)
+    }
+
+    // Keeps whole lines in line mode when possible, and never splits a UTF-8 sequence
+    private fun cutPoint(bytes: ByteArray, lineMode: Boolean): Int {
+        if (lineMode) {
+            val lastNewline = bytes.lastIndexOf('\n'.code.toByte())
+            if (lastNewline >= 0) return lastNewline + 1
+        }
+        var end = bytes.size
+        var back = 0
+        while (end > 0 && back < 3 && (bytes[end - 1].toInt() and 0xC0) == 0x80) {
+            end--
+            back++
+        }
+        // end - 1 is now a lead byte (or ASCII); drop it if its sequence is incomplete
+        if (end > 0) {
+            val lead = bytes[end - 1].toInt() and 0xFF
+            val needed = when {
+                lead >= 0xF0 -> 4
+                lead >= 0xE0 -> 3
+                lead >= 0xC0 -> 2
+                else -> 1
+            }
+            if (needed > back + 1) return end - 1
+        }
+        return bytes.size
+    }
+
+    private inline fun <T> withFile(path: String, block: (Handle) -> T): T {
+        val handle = acquire(path)
+        try {
+            return block(handle)
+        } finally {
+            release(handle)
+        }
+    }
+
+    private fun acquire(path: String): Handle {
+        val file = File(path)
+        val length = file.length()
+        val lastModified = file.lastModified()
+        synchronized(handles) {
+            val cached = handles[path]
+            if (cached != null && cached.length == length && cached.lastModified == lastModified) {
+                cached.refs++
+                return cached
+            }
+            handles.remove(path)?.let { retire(it) }
+
+            val native = NativeCore.nativeTextOpen(path)
+            if (native == 0L) throw FileNotFoundException("Cannot open $path")
+            val handle = Handle(native, length, lastModified)
+            handle.refs = 1
+            handles[path] = handle
+            if (handles.size > MAX_OPEN_FILES) {
+                val eldest = handles.entries.iterator()
+                retire(eldest.next().value)
+                eldest.remove()
+            }
+            return handle
+        }
+    }
+
+    private fun release(handle: Handle) {
+        synchronized(handles) {
+            handle.refs--
+            if (handle.retired && handle.refs == 0) NativeCore.nativeTextClose(handle.native)
+        }
+    }
+
+    // Lock held. Closes now, or when the last reader is done.
+    private fun retire(handle: Handle) {
+        handle.retired = true
+        if (handle.refs == 0) NativeCore.nativeTextClose(handle.native)
+    }
+}
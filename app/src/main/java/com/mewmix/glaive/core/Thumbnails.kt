@@ -0,0 +1,244 @@
+package com.mewmix.glaive.core
+
+import android.content.Context
+import android.graphics.Bitmap
+import android.graphics.BitmapFactory
+import android.graphics.Matrix
+import android.media.MediaMetadataRetriever
+import android.util.LruCache
+import com.mewmix.glaive.data.GlaiveItem
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.awaitCancellation
+import kotlinx.coroutines.delay
+import kotlinx.coroutines.sync.Semaphore
+import kotlinx.coroutines.sync.withPermit
+import kotlinx.coroutines.withContext
+import java.io.ByteArrayOutputStream
+import java.io.File
+import java.util.Collections
+import java.util.concurrent.atomic.AtomicInteger
+
+/**
+ * Row thumbnails for images and videos (THUMBNAILS in glaive_core.c). JPEGs use the thumbnail
+ * embedded in their Exif header, which the search pool workers read from the first 64KB of the
+ * file without decoding the image; anything else is downscaled once by the platform decoders.
+ * Both end up as small JPEGs in an mmap'd cache file keyed by path, mtime and size, so coming
+ * back to a folder, even after a restart, never touches the full images again. Decoded bitmaps
+ * stay in memory for scrolling back and forth.
+ *
+ * Requests are served highest priority first. Rows on screen sit in a band above every
+ * [prefetch]; within each band, [onVisibleRowsChanged] starts a new generation that goes ahead
+ * of everything queued before. Rows still waiting ask again as generations pass, so they keep up.
+ */
+object Thumbnails {
+    private const val CACHE_FILE = "thumbnails.bin"
+    private const val MEMORY_CACHE_BYTES = 24 * 1024 * 1024
+    private const val TARGET_SIZE_PX = 192
+    private const val JPEG_QUALITY = 80
+    private const val POLL_INTERVAL_MS = 24L
+    private const val MAX_FAILED = 1024
+    private const val MAX_STATED_KEYS = 4096
+
+    // Requests of rows on screen rank above every prefetch, whatever their generations
+    private const val VISIBLE_BAND = 1 shl 30
+
+    // Cache entries: THUMB_FORMAT_* in glaive_core.c, Exif orientation, 2 reserved bytes, JPEG
+    private const val FORMAT_JPEG = 1
+    private const val ENTRY_HEADER_BYTES = 4
+
+    /** The file behind a row, as the cache keys it. */
+    private class Source(val path: String, val type: Int, val mtime: Long, val size: Long) {
+        val key = "$path|$mtime|$size"
+    }
+
+    @Volatile
+    private var cacheOpen = false
+    private val generation = AtomicInteger(1)
+
+    private val memory = object : LruCache<String, Bitmap>(MEMORY_CACHE_BYTES) {
+        override fun sizeOf(key: String, value: Bitmap): Int = value.byteCount
+    }
+
+    // Last key seen for rows listed without mtime and size, by path
+    private val statedKeys = LruCache<String, String>(MAX_STATED_KEYS)
+
+    // Files the platform could not decode either, so rows don't retry them on every bind
+    private val failed = Collections.synchronizedSet(LinkedHashSet<String>())
+
+    // Full-size decodes are heavy; a couple at a time keeps the extraction queue moving
+    private val downscalePermits = Semaphore(2)
+
+    fun init(context: Context) {
+        cacheOpen = NativeCore.nativeThumbOpen(File(context.cacheDir, CACHE_FILE).path)
+    }
+
+    fun supports(item: GlaiveItem): Boolean =
+        item.type == GlaiveItem.TYPE_IMG || item.type == GlaiveItem.TYPE_VID
+
+    /**
+     * The thumbnail of [item] if it is already decoded in memory. For rows listed without mtime
+     * and size this is the last one seen for the path; [load] checks the file again.
+     */
+    fun cached(item: GlaiveItem): Bitmap? {
+        val key = if (isUnstated(item)) statedKeys.get(item.path) else keyOf(item)
+        return key?.let { memory.get(it) }
+    }
+
+    /** Call whenever the rows on screen change. */
+    fun onVisibleRowsChanged() {
+        generation.incrementAndGet()
+    }
+
+    /**
+     * Queues [items] that are about to scroll into view, behind the rows on screen, and keeps
+     * them queued until cancelled. Cancelling drops whichever no row has asked for since, so
+     * a fling does not leave the queue full of rows it went past.
+     */
+    suspend fun prefetch(items: List<GlaiveItem>) {
+        if (!cacheOpen) return
+        val queued = ArrayList<Source>()
+        try {
+            withContext(Dispatchers.IO) {
+                val priority = generation.get()
+                for (item in items) {
+                    if (!supports(item)) continue
+                    val source = sourceOf(item)
+                    if (memory.get(source.key) != null) continue
+                    if (NativeCore.nativeThumbRequest(source.path, source.mtime, source.size, priority) == 0) queued.add(source)
+                }
+            }
+            awaitCancellation()
+        } finally {
+            for (source in queued) NativeCore.nativeThumbCancel(source.path, source.mtime, source.size, VISIBLE_BAND)
+        }
+    }
+
+    /**
+     * The thumbnail of [item], waiting for its turn in the queue; null when there is none.
+     * Cancelling the caller, e.g. when its row scrolls away, drops the queued request.
+     */
+    suspend fun load(item: GlaiveItem): Bitmap? = withContext(Dispatchers.IO) {
+        if (!supports(item)) return@withContext null
+        val source = sourceOf(item)
+        if (isUnstated(item)) statedKeys.put(source.path, source.key)
+        memory.get(source.key)?.let { return@withContext it }
+        if (source.key in failed) return@withContext null
+
+        val entry = if (cacheOpen) {
+            // Null when not taken: the queue is full of rows that are more urgent
+            cachedEntry(source) ?: return@withContext null
+        } else {
+            null
+        }
+        val bitmap = if (entry != null && entry[0].toInt() == FORMAT_JPEG) {
+            decodeEntry(entry)
+        } else {
+            downscalePermits.withPermit { downscale(source, entry?.get(1)?.toInt() ?: 0) }
+                .also { if (it == null) markFailed(source.key) }
+        }
+        if (bitmap != null) memory.put(source.key, bitmap)
+        bitmap
+    }
+
+    private suspend fun cachedEntry(source: Source): ByteArray? {
+        var entry: ByteArray? = null
+        try {
+            while (true) {
+                val seen = NativeCore.nativeThumbVersion()
+                entry = NativeCore.nativeThumbGet(source.path, source.mtime, source.size)
+                if (entry != null) return entry
+                // Asking again each round moves the row up to the current generation, and queues
+                // it again if a full queue gave it up for more urgent rows
+                val queued = NativeCore.nativeThumbRequest(source.path, source.mtime, source.size, VISIBLE_BAND + generation.get())
+                if (queued < 0) return null
+                if (queued == 0) {
+                    while (NativeCore.nativeThumbVersion() == seen) delay(POLL_INTERVAL_MS)
+                }
+            }
+        } finally {
+            if (entry == null) NativeCore.nativeThumbCancel(source.path, source.mtime, source.size, Int.MAX_VALUE)
+        }
+    }
+
+    private fun decodeEntry(entry: ByteArray): Bitmap? {
+        val options = BitmapFactory.Options().apply { inPreferredConfig = Bitmap.Config.RGB_565 }
+        val bitmap = BitmapFactory.decodeByteArray(entry, ENTRY_HEADER_BYTES, entry.size - ENTRY_HEADER_BYTES, options)
+            ?: return null
+        return oriented(bitmap, entry[1].toInt())
+    }
+
+    /** Decodes [source] at about [TARGET_SIZE_PX] and caches the result as a JPEG. */
+    private fun downscale(source: Source, orientation: Int): Bitmap? {
+        val bitmap = try {
+            if (source.type == GlaiveItem.TYPE_VID) videoFrame(source.path) else sampledImage(source.path)
+        } catch (e: Exception) {
+            null
+        } ?: return null
+
+        if (cacheOpen) {
+            val jpeg = ByteArrayOutputStream()
+            if (bitmap.compress(Bitmap.CompressFormat.JPEG, JPEG_QUALITY, jpeg)) {
+                NativeCore.nativeThumbPut(source.path, source.mtime, source.size, orientation, jpeg.toByteArray())
+            }
+        }
+        return oriented(bitmap, orientation)
+    }
+
+    private fun sampledImage(path: String): Bitmap? {
+        val bounds = BitmapFactory.Options().apply { inJustDecodeBounds = true }
+        BitmapFactory.decodeFile(path, bounds)
+        if (bounds.outWidth <= 0 || bounds.outHeight <= 0) return null
+        var sample = 1
+        while (minOf(bounds.outWidth, bounds.outHeight) / (sample * 2) >= TARGET_SIZE_PX) sample *= 2
+        val options = BitmapFactory.Options().apply {
+            inSampleSize = sample
+            inPreferredConfig = Bitmap.Config.RGB_565
+        }
+        return BitmapFactory.decodeFile(path, options)
+    }
+
+    private fun videoFrame(path: String): Bitmap? {
+        val retriever = MediaMetadataRetriever()
+        return try {
+            retriever.setDataSource(path)
+            retriever.getScaledFrameAtTime(-1, MediaMetadataRetriever.OPTION_CLOSEST_SYNC, TARGET_SIZE_PX, TARGET_SIZE_PX)
+        } finally {
+            retriever.release()
+        }
+    }
+
+    private fun oriented(bitmap: Bitmap, orientation: Int): Bitmap {
+        val matrix = Matrix()
+        when (orientation) {
+            2 -> matrix.setScale(-1f, 1f)
+            3 -> matrix.setRotate(180f)
+            4 -> matrix.setScale(1f, -1f)
+            5 -> matrix.apply { setRotate(90f); postScale(-1f, 1f) }
+            6 -> matrix.setRotate(90f)
+            7 -> matrix.apply { setRotate(-90f); postScale(-1f, 1f) }
+            8 -> matrix.setRotate(-90f)
+            else -> return bitmap
+        }
+        return Bitmap.createBitmap(bitmap, 0, 0, bitmap.width, bitmap.height, matrix, true)
+    }
+
+    private fun markFailed(key: String) {
+        synchronized(failed) {
+            failed.add(key)
+            if (failed.size > MAX_FAILED) failed.remove(failed.first())
+        }
+    }
+
+    private fun keyOf(item: GlaiveItem): String = "${item.path}|${item.mtime}|${item.size}"
+
+    // Name and type sorted listings only stat the rows around the visible window
+    private fun isUnstated(item: GlaiveItem): Boolean = item.mtime == 0L && item.size == 0L
+
+    /** Blocking: stats rows the listing did not, so an edited file misses its old thumbnail. */
+    private fun sourceOf(item: GlaiveItem): Source {
+        if (!isUnstated(item)) return Source(item.path, item.type, item.mtime, item.size)
+        val file = File(item.path)
+        // Seconds, like listing records
+        return Source(item.path, item.type, file.lastModified() / 1000, file.length())
+    }
+}
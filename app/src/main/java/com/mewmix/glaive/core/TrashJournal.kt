@@ -0,0 +1,153 @@
+package com.mewmix.glaive.core
+
+import java.io.File
+import java.io.FileOutputStream
+import java.io.IOException
+import java.io.RandomAccessFile
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/** One item in the Recycle Bin. [size] is -1 while a trashed directory has not been measured yet. */
+data class TrashEntry(
+    val trashName: String,
+    val originalPath: String,
+    val size: Long,
+    val deletedAt: Long,
+    val isDirectory: Boolean
+)
+
+/**
+ * Append-only binary journal backing the Recycle Bin index.
+ *
+ * The file starts with [MAGIC], followed by little-endian records:
+ * `op:u8 flags:u8 nameLen:u16 pathLen:u16 size:i64 time:i64 name[nameLen] path[pathLen]`.
+ * Trash and restore only append their own records; [rewrite] compacts the file down to one
+ * ADD record per live entry. A torn record at the tail (crash mid-append), or a file too short
+ * to hold the magic, is cut off by [load] at the last whole record. Records with an op this
+ * version does not know are skipped.
+ */
+class TrashJournal(private val file: File) {
+
+    /** Records currently in the file, including ones superseded by later records. */
+    var recordCount = 0
+        private set
+
+    fun exists(): Boolean = file.exists()
+
+    fun load(): LinkedHashMap<String, TrashEntry> {
+        val entries = LinkedHashMap<String, TrashEntry>()
+        recordCount = 0
+        if (!file.exists()) return entries
+
+        val bytes = file.readBytes()
+        if (bytes.size < MAGIC.size) {
+            // Torn first append: nothing was recorded yet
+            DebugLogger.log("Recycle bin journal ${file.path} is ${bytes.size} bytes, starting empty")
+            RandomAccessFile(file, "rw").use { it.setLength(0) }
+            return entries
+        }
+        if (!bytes.copyOfRange(0, MAGIC.size).contentEquals(MAGIC)) {
+            throw IOException("Not a recycle bin journal: ${file.path}")
+        }
+
+        val buf = ByteBuffer.wrap(bytes).order(ByteOrder.LITTLE_ENDIAN)
+        buf.position(MAGIC.size)
+        var validEnd = MAGIC.size
+        while (buf.remaining() >= HEADER_SIZE) {
+            val op = buf.get().toInt()
+            val flags = buf.get().toInt()
+            val nameLen = buf.short.toInt() and 0xFFFF
+            val pathLen = buf.short.toInt() and 0xFFFF
+            val size = buf.long
+            val time = buf.long
+            if (buf.remaining() < nameLen + pathLen) break
+
+            val name = String(bytes, buf.position(), nameLen, Charsets.UTF_8)
+            val path = String(bytes, buf.position() + nameLen, pathLen, Charsets.UTF_8)
+            buf.position(buf.position() + nameLen + pathLen)
+
+            when (op) {
+                OP_ADD -> entries[name] = TrashEntry(name, path, size, time, (flags and FLAG_DIR.toInt()) != 0)
+                OP_REMOVE -> entries.remove(name)
+                OP_SIZE -> entries[name]?.let { entries[name] = it.copy(size = size) }
+                else -> DebugLogger.log("Skipping unknown recycle bin journal op $op at $validEnd in ${file.path}")
+            }
+            recordCount++
+            validEnd = buf.position()
+        }
+
+        if (validEnd < bytes.size) {
+            DebugLogger.log("Cutting torn recycle bin journal ${file.path} from ${bytes.size} to $validEnd bytes")
+            RandomAccessFile(file, "rw").use { it.setLength(validEnd.toLong()) }
+        }
+        return entries
+    }
+
+    fun appendAdded(entries: Collection<TrashEntry>) {
+        append(entries.map { encode(OP_ADD, it.trashName, it.originalPath, it.size, it.deletedAt, it.isDirectory) })
+    }
+
+    fun appendRemoved(trashNames: Collection<String>) {
+        append(trashNames.map { encode(OP_REMOVE, it, "", 0, 0, false) })
+    }
+
+    fun appendSizes(sizes: Map<String, Long>) {
+        append(sizes.map { (name, size) -> encode(OP_SIZE, name, "", size, 0, false) })
+    }
+
+    /** Replaces the journal with a snapshot of [entries], atomically via a temp file. */
+    fun rewrite(entries: Collection<TrashEntry>) {
+        val records = entries.map { encode(OP_ADD, it.trashName, it.originalPath, it.size, it.deletedAt, it.isDirectory) }
+        val tmp = File(file.parentFile, "${file.name}.tmp")
+        FileOutputStream(tmp).use { out ->
+            out.write(concat(MAGIC, records))
+            out.fd.sync()
+        }
+        if (!tmp.renameTo(file)) {
+            tmp.delete()
+            throw IOException("Failed to replace ${file.path}")
+        }
+        recordCount = records.size
+    }
+
+    // One write per batch, so trashing n files costs O(n) bytes, not O(bin size)
+    private fun append(records: List<ByteArray>) {
+        if (records.isEmpty()) return
+        val header = if (file.exists() && file.length() > 0) ByteArray(0) else MAGIC
+        FileOutputStream(file, true).use { it.write(concat(header, records)) }
+        recordCount += records.size
+    }
+
+    private fun concat(header: ByteArray, records: List<ByteArray>): ByteArray {
+        val out = ByteBuffer.allocate(header.size + records.sumOf { it.size })
+        out.put(header)
+        records.forEach { out.put(it) }
+        return out.array()
+    }
+
+    private fun encode(op: Int, name: String, path: String, size: Long, time: Long, isDirectory: Boolean): ByteArray {
+        val nameBytes = name.toByteArray(Charsets.UTF_8)
+        val pathBytes = path.toByteArray(Charsets.UTF_8)
+        val flags: Byte = if (isDirectory) FLAG_DIR else 0
+        return ByteBuffer.allocate(HEADER_SIZE + nameBytes.size + pathBytes.size)
+            .order(ByteOrder.LITTLE_ENDIAN)
+            .put(op.toByte())
+            .put(flags)
+            .putShort(nameBytes.size.toShort())
+            .putShort(pathBytes.size.toShort())
+            .putLong(size)
+            .putLong(time)
+            .put(nameBytes)
+            .put(pathBytes)
+            .array()
+    }
+
+    companion object {
+        private val MAGIC = "GLVTRSH1".toByteArray(Charsets.US_ASCII)
+        private const val HEADER_SIZE = 22
+        private const val OP_ADD = 1
+        private const val OP_REMOVE = 2
+        private const val OP_SIZE = 3
+        private const val FLAG_DIR: Byte = 1
+    }
+}
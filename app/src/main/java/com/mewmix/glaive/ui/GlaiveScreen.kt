@@ -21,6 +21,7 @@ import androidx.compose.animation.slideOutHorizontally
 import androidx.compose.animation.slideOutVertically
 import androidx.compose.animation.togetherWith
 import androidx.compose.foundation.ExperimentalFoundationApi
+import androidx.compose.foundation.Image
 import androidx.compose.foundation.background
 import androidx.compose.foundation.border
 import androidx.compose.foundation.clickable
@@ -62,6 +63,7 @@ import androidx.compose.material.icons.filled.Archive
 import androidx.compose.material.icons.filled.GridView
 import androidx.compose.material.icons.filled.MoreVert
 import androidx.compose.material.icons.filled.Settings
+import androidx.compose.material.icons.filled.Refresh
 import androidx.compose.material3.*
 import androidx.compose.runtime.*
 import androidx.compose.ui.Alignment
@@ -82,6 +84,7 @@ import androidx.compose.ui.focus.FocusRequester
 import androidx.compose.ui.focus.focusRequester
 import androidx.compose.ui.graphics.Brush
 import androidx.compose.ui.graphics.Color
+import androidx.compose.ui.graphics.asImageBitmap
 import androidx.compose.ui.graphics.vector.ImageVector
 import androidx.compose.ui.hapticfeedback.HapticFeedbackType
 import androidx.compose.ui.input.pointer.pointerInput
@@ -89,6 +92,7 @@ import androidx.compose.ui.layout.ContentScale
 import androidx.compose.ui.platform.LocalContext
 import androidx.compose.ui.platform.LocalDensity
 import androidx.compose.ui.platform.LocalHapticFeedback
+import androidx.compose.ui.platform.LocalLifecycleOwner
 import androidx.compose.ui.platform.LocalSoftwareKeyboardController
 import androidx.compose.ui.text.TextStyle
 import androidx.compose.ui.text.font.FontWeight
@@ -100,25 +104,35 @@ import androidx.compose.foundation.lazy.grid.GridCells
 import androidx.compose.foundation.lazy.grid.LazyVerticalGrid
 import androidx.compose.foundation.lazy.grid.LazyGridScope
 import androidx.compose.foundation.lazy.grid.items
+import androidx.compose.foundation.lazy.grid.rememberLazyGridState
 import androidx.compose.ui.unit.sp
 import androidx.core.content.FileProvider
-import coil.compose.AsyncImage
+import androidx.lifecycle.Lifecycle
+import androidx.lifecycle.LifecycleEventObserver
 import com.mewmix.glaive.core.DebugLogger
 import com.mewmix.glaive.core.FileOperations
 import com.mewmix.glaive.core.NativeCore
 import com.mewmix.glaive.core.FavoritesManager
+import com.mewmix.glaive.core.FolderSync
+import com.mewmix.glaive.core.ListingPrefetcher
+import com.mewmix.glaive.core.ListingSnapshots
 import com.mewmix.glaive.core.RecycleBinManager
+import com.mewmix.glaive.core.ScanOrder
+import com.mewmix.glaive.core.Thumbnails
 import com.mewmix.glaive.data.GlaiveItem
 import com.mewmix.glaive.core.ArchiveUtils
 import kotlinx.coroutines.CoroutineScope
 
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.delay
+import kotlinx.coroutines.flow.collectLatest
+import kotlinx.coroutines.flow.distinctUntilChanged
 import kotlinx.coroutines.launch
 import android.content.ClipData
 import android.view.View
 import kotlinx.coroutines.withContext
 import java.io.File
+import java.io.IOException
 import java.util.Locale
 import kotlin.system.measureTimeMillis
 
@@ -126,6 +140,14 @@ enum class SortMode { NAME, DATE, SIZE, TYPE }
 
 const val ROOT_PATH = "/storage/emulated/0"
 
+// Visible rows must stay put this long before their directories are prefetched
+private const val VISIBLE_DIRECTORIES_SETTLE_MS = 250L
+private const val THUMBNAIL_PREFETCH_ROWS = 24
+
+// Header tabs backed by storage-wide NativeCore.topFiles scans
+private const val TAB_RECENT = 2
+private const val TAB_LARGEST = 3
+
 val INEFF_EXTENSIONS = setOf(
     "mp4", "mkv", "avi", "mov", "webm",
     "mp3", "aac", "flac", "ogg",
@@ -137,6 +159,16 @@ val INEFF_EXTENSIONS = setOf(
 @Composable
 fun GlaiveScreen() {
     val context = LocalContext.current
+    val lifecycleOwner = LocalLifecycleOwner.current
+
+    // The listings on screen when the app goes to the background are the ones worth restoring
+    DisposableEffect(lifecycleOwner) {
+        val observer = LifecycleEventObserver { _, event ->
+            if (event == Lifecycle.Event.ON_PAUSE) ListingSnapshots.saveRendered(context)
+        }
+        lifecycleOwner.lifecycle.addObserver(observer)
+        onDispose { lifecycleOwner.lifecycle.removeObserver(observer) }
+    }
     
     // Theme State
     var themeConfig by remember { mutableStateOf(ThemeManager.loadTheme(context)) }
@@ -162,7 +194,7 @@ fun GlaiveScreen() {
 
         // New State
         var isGridView by remember { mutableStateOf(false) }
-        var currentTab by remember { mutableStateOf(0) } // 0 = Browse, 1 = Recents
+        var currentTab by remember { mutableStateOf(0) } // 0 = Browse, 1 = Favorites, 2 = Recent, 3 = Largest
         var secondaryCurrentTab by remember { mutableStateOf(0) }
         var activePane by remember { mutableStateOf(0) }
         var clipboardItems by remember { mutableStateOf<List<File>>(emptyList()) }
@@ -361,6 +393,7 @@ fun GlaiveScreen() {
                         }
                     }
                 }
+                ListingPrefetcher.noteVisit(path)
                 setPanePath(paneIndex, path)
                 setPaneSearchQuery(paneIndex, "")
                 setPaneSearchActive(paneIndex, false)
@@ -381,19 +414,14 @@ fun GlaiveScreen() {
                 try {
                     if (currentTab == 1) {
                         rawList = FavoritesManager.getFavorites(context)
+                    } else if (currentTab == TAB_RECENT || currentTab == TAB_LARGEST) {
+                        // Storage-wide scan; the best files so far show up while it runs
+                        val order = if (currentTab == TAB_RECENT) ScanOrder.RECENT else ScanOrder.LARGEST
+                        rawList = emptyList()
+                        rawList = NativeCore.topFiles(currentPath, order, filterMask = getFilterMask(activeFilters)) { rawList = it }.items
                     } else if (RecycleBinManager.isTrashItem(currentPath)) {
-                        // Load Trash Items
-                         val trashDir = File(currentPath)
-                         val files = trashDir.listFiles() ?: emptyArray()
-                         rawList = files.filter { it.name != "restore.index" }.map { file ->
-                             GlaiveItem(
-                                 name = file.name,
-                                 path = file.absolutePath,
-                                 type = if (file.isDirectory) GlaiveItem.TYPE_DIR else GlaiveItem.TYPE_FILE,
-                                 size = file.length(),
-                                 mtime = file.lastModified()
-                             )
-                         }
+                         // Load Trash Items
+                         rawList = RecycleBinManager.listItems(currentPath)
                     } else {
                         if (searchQuery.isEmpty()) {
                             val archiveRoot = FileOperations.getArchiveRoot(currentPath)
@@ -402,12 +430,10 @@ fun GlaiveScreen() {
                                 val cleanInternal = if (internalPath.startsWith("/")) internalPath.substring(1) else internalPath
                                 rawList = FileOperations.listArchive(archiveRoot, cleanInternal)
                             } else {
-                                rawList = NativeCore.list(
-                                    currentPath,
-                                    getSortModeInt(sortMode),
-                                    sortAscending,
-                                    getFilterMask(activeFilters)
-                                )
+                                val mode = getSortModeInt(sortMode)
+                                val mask = getFilterMask(activeFilters)
+                                // Cold start draws the saved listing while the directory is relisted
+                                ListingSnapshots.list(context, 0, currentPath, mode, sortAscending, mask, cold = rawList.isEmpty()) { rawList = it }
                             }
                         } else {
                             val archiveRoot = FileOperations.getArchiveRoot(currentPath)
@@ -418,7 +444,8 @@ fun GlaiveScreen() {
                                 rawList = items.filter { it.name.contains(searchQuery, ignoreCase = true) }
                             } else {
                                 delay(150)
-                                rawList = NativeCore.search(currentPath, searchQuery, getFilterMask(activeFilters))
+                                // The best matches so far show up while the walk runs
+                                rawList = NativeCore.search(currentPath, searchQuery, getFilterMask(activeFilters)) { rawList = it }
                             }
                         }
                     }
@@ -435,19 +462,14 @@ fun GlaiveScreen() {
                 try {
                     if (secondaryCurrentTab == 1) {
                         secondaryRawList = FavoritesManager.getFavorites(context)
+                    } else if (secondaryCurrentTab == TAB_RECENT || secondaryCurrentTab == TAB_LARGEST) {
+                        // Storage-wide scan; the best files so far show up while it runs
+                        val order = if (secondaryCurrentTab == TAB_RECENT) ScanOrder.RECENT else ScanOrder.LARGEST
+                        secondaryRawList = emptyList()
+                        secondaryRawList = NativeCore.topFiles(secondaryPath, order, filterMask = getFilterMask(activeFilters)) { secondaryRawList = it }.items
                     } else if (RecycleBinManager.isTrashItem(secondaryPath)) {
-                         // Load Trash Items
-                         val trashDir = File(secondaryPath)
-                         val files = trashDir.listFiles() ?: emptyArray()
-                         secondaryRawList = files.filter { it.name != "restore.index" }.map { file ->
-                             GlaiveItem(
-                                 name = file.name,
-                                 path = file.absolutePath,
-                                 type = if (file.isDirectory) GlaiveItem.TYPE_DIR else GlaiveItem.TYPE_FILE,
-                                 size = file.length(),
-                                 mtime = file.lastModified()
-                             )
-                         }
+                          // Load Trash Items
+                         secondaryRawList = RecycleBinManager.listItems(secondaryPath)
                     } else {
                         if (secondarySearchQuery.isEmpty()) {
                             val archiveRoot = FileOperations.getArchiveRoot(secondaryPath)
@@ -456,12 +478,10 @@ fun GlaiveScreen() {
                                 val cleanInternal = if (internalPath.startsWith("/")) internalPath.substring(1) else internalPath
                                 secondaryRawList = FileOperations.listArchive(archiveRoot, cleanInternal)
                             } else {
-                                secondaryRawList = NativeCore.list(
-                                    secondaryPath,
-                                    getSortModeInt(sortMode),
-                                    sortAscending,
-                                    getFilterMask(activeFilters)
-                                )
+                                val mode = getSortModeInt(sortMode)
+                                val mask = getFilterMask(activeFilters)
+                                // Cold start draws the saved listing while the directory is relisted
+                                ListingSnapshots.list(context, 1, secondaryPath, mode, sortAscending, mask, cold = secondaryRawList.isEmpty()) { secondaryRawList = it }
                             }
                         } else {
                             val archiveRoot = FileOperations.getArchiveRoot(secondaryPath)
@@ -472,7 +492,8 @@ fun GlaiveScreen() {
                                 secondaryRawList = items.filter { it.name.contains(secondarySearchQuery, ignoreCase = true) }
                             } else {
                                 delay(150)
-                                secondaryRawList = NativeCore.search(secondaryPath, secondarySearchQuery, getFilterMask(activeFilters))
+                                // The best matches so far show up while the walk runs
+                                secondaryRawList = NativeCore.search(secondaryPath, secondarySearchQuery, getFilterMask(activeFilters)) { secondaryRawList = it }
                             }
                         }
                     }
@@ -579,7 +600,7 @@ fun GlaiveScreen() {
                         selectedPaths + item.path
                     }
                 } else if (item.type == GlaiveItem.TYPE_DIR || File(item.path).isDirectory || FileOperations.isArchive(item.path)) {
-                    if (paneCurrentTab(paneIndex) == 1) {
+                    if (paneCurrentTab(paneIndex) != 0) {
                         setPaneCurrentTab(paneIndex, 0)
                     }
                     navigateTo(paneIndex, item.path)
@@ -596,6 +617,9 @@ fun GlaiveScreen() {
                 contextMenuPane = paneIndex
                 contextMenuTarget = item
             }
+            val handleVisibleDirectories: (List<String>) -> Unit = { paths ->
+                ListingPrefetcher.prefetch(paths, getSortModeInt(sortMode), sortAscending, getFilterMask(activeFilters))
+            }
 
             Column(modifier = Modifier.fillMaxSize()) {
 
@@ -666,6 +690,7 @@ fun GlaiveScreen() {
                                     canMaximize = splitScopeEnabled && maximizedPane == -1,
                                     isSearchMode = paneIsSearchActive(0) && paneSearchQuery(0).isNotEmpty(),
                                     activePath = panePath(0),
+                                    onVisibleDirectories = handleVisibleDirectories,
                                     onDrop = { event -> handleDrop(event, 0) }
                                 )
                             }
@@ -714,6 +739,7 @@ fun GlaiveScreen() {
                                     canMaximize = splitScopeEnabled && maximizedPane == -1,
                                     isSearchMode = paneIsSearchActive(1) && paneSearchQuery(1).isNotEmpty(),
                                     activePath = panePath(1),
+                                    onVisibleDirectories = handleVisibleDirectories,
                                     onDrop = { event -> handleDrop(event, 1) }
                                 )
                             }
@@ -738,6 +764,7 @@ fun GlaiveScreen() {
                         canMaximize = false,
                         isSearchMode = paneIsSearchActive(activePane) && paneSearchQuery(activePane).isNotEmpty(),
                         activePath = panePath(activePane),
+                        onVisibleDirectories = handleVisibleDirectories,
                         onDrop = { event -> handleDrop(event, activePane) }
                     )
                 }
@@ -844,23 +871,40 @@ fun GlaiveScreen() {
                          performAsyncOperation("Restoring ${file.name}...") {
                              RecycleBinManager.restore(file)
                              // Refresh
-                             if (contextMenuPane == 0) {
-                                 // Force refresh
-                                 val trashDir = File(panePath(0))
-                                 val files = trashDir.listFiles() ?: emptyArray()
-                                 rawList = files.filter { it.name != "restore.index" }.map { f ->
-                                     GlaiveItem(f.name, f.absolutePath, if (f.isDirectory) GlaiveItem.TYPE_DIR else GlaiveItem.TYPE_FILE, f.length(), f.lastModified())
-                                 }
-                             } else {
-                                 val trashDir = File(panePath(1))
-                                 val files = trashDir.listFiles() ?: emptyArray()
-                                 secondaryRawList = files.filter { it.name != "restore.index" }.map { f ->
-                                     GlaiveItem(f.name, f.absolutePath, if (f.isDirectory) GlaiveItem.TYPE_DIR else GlaiveItem.TYPE_FILE, f.length(), f.lastModified())
-                                 }
-                             }
+                             val updated = RecycleBinManager.listItems(panePath(contextMenuPane))
+                             if (contextMenuPane == 0) rawList = updated else secondaryRawList = updated
                              contextMenuTarget = null
                          }
                     },
+                    onSyncToOtherPane = if (splitScopeEnabled && contextMenuTarget!!.type == GlaiveItem.TYPE_DIR) {
+                        {
+                            val source = contextMenuTarget!!
+                            val otherPane = 1 - contextMenuPane
+                            val target = File(panePath(otherPane), source.name).path
+                            contextMenuTarget = null
+                            if (target == source.path || target.startsWith(source.path + "/")) {
+                                Toast.makeText(context, "Cannot sync a folder into itself", Toast.LENGTH_SHORT).show()
+                            } else {
+                                // Copies what is new or newer in the source; nothing is deleted
+                                performAsyncOperation("Syncing ${source.name}...") {
+                                    val summary = try {
+                                        withContext(Dispatchers.IO) { File(target).mkdirs() }
+                                        val diffs = FolderSync.compare(source.path, target)
+                                        val plan = FolderSync.plan(source.path, target, diffs, FolderSync.Mode.UPDATE)
+                                        val result = FolderSync.execute(plan)
+                                        if (plan.isEmpty) "already up to date" else "${result.copied} copied, ${result.failures.size} failed"
+                                    } catch (e: IOException) {
+                                        "sync failed: ${e.message}"
+                                    } catch (e: IllegalStateException) {
+                                        "sync failed: ${e.message}"
+                                    }
+                                    val updated = NativeCore.list(panePath(otherPane))
+                                    if (otherPane == 0) rawList = updated else secondaryRawList = updated
+                                    Toast.makeText(context, "${source.name}: $summary", Toast.LENGTH_SHORT).show()
+                                }
+                            }
+                        }
+                    } else null,
                     onEdit = {
                         editorFile = File(contextMenuTarget!!.path)
                         showEditor = true
@@ -1011,21 +1055,10 @@ fun GlaiveScreen() {
                     onRestore = {
                         val files = selectedPaths.map { File(it) }
                         performAsyncOperation("Restoring ${files.size} items...") {
-                            files.forEach { RecycleBinManager.restore(it) }
+                            RecycleBinManager.restore(files)
                             // Refresh
-                            if (activePane == 0) {
-                                val trashDir = File(panePath(0))
-                                val f = trashDir.listFiles() ?: emptyArray()
-                                rawList = f.filter { it.name != "restore.index" }.map { f ->
-                                     GlaiveItem(f.name, f.absolutePath, if (f.isDirectory) GlaiveItem.TYPE_DIR else GlaiveItem.TYPE_FILE, f.length(), f.lastModified())
-                                 }
-                            } else {
-                                val trashDir = File(panePath(1))
-                                val f = trashDir.listFiles() ?: emptyArray()
-                                secondaryRawList = f.filter { it.name != "restore.index" }.map { f ->
-                                     GlaiveItem(f.name, f.absolutePath, if (f.isDirectory) GlaiveItem.TYPE_DIR else GlaiveItem.TYPE_FILE, f.length(), f.lastModified())
-                                 }
-                            }
+                            val updated = RecycleBinManager.listItems(panePath(activePane))
+                            if (activePane == 0) rawList = updated else secondaryRawList = updated
                             selectedPaths = emptySet()
                             showMultiSelectionMenu = false
                         }
@@ -1179,22 +1212,20 @@ fun GlaiveScreen() {
                                 // Standard Filesystem
                                 if (RecycleBinManager.isTrashItem(firstPath)) {
                                     // Already in trash -> Delete Forever
-                                    paths.forEach { RecycleBinManager.deletePermanently(File(it)) }
+                                    RecycleBinManager.deletePermanently(paths.map { File(it) })
                                 } else {
                                     if (permanent) {
-                                        paths.forEach { FileOperations.delete(File(it)) }
+                                        FileOperations.deleteAll(paths.map { File(it) }) { removed ->
+                                            blockingMessage = "Deleting forever... $removed removed"
+                                        }
                                     } else {
-                                        paths.forEach { RecycleBinManager.moveToTrash(File(it)) }
+                                        RecycleBinManager.moveToTrash(paths.map { File(it) })
                                     }
                                 }
 
                                 // Refresh
                                 if (RecycleBinManager.isTrashItem(panePath(pane))) {
-                                     val trashDir = File(panePath(pane))
-                                     val f = trashDir.listFiles() ?: emptyArray()
-                                     val updated = f.filter { it.name != "restore.index" }.map { f ->
-                                         GlaiveItem(f.name, f.absolutePath, if (f.isDirectory) GlaiveItem.TYPE_DIR else GlaiveItem.TYPE_FILE, f.length(), f.lastModified())
-                                     }
+                                     val updated = RecycleBinManager.listItems(panePath(pane))
                                      if (pane == 0) rawList = updated else secondaryRawList = updated
                                 } else {
                                     val updated = NativeCore.list(panePath(pane))
@@ -1288,6 +1319,8 @@ fun GlaiveHeader(
             ) {
                 TabItem("BROWSE", currentTab == 0) { onTabChange(0) }
                 TabItem("FAVORITES", currentTab == 1) { onTabChange(1) }
+                TabItem("RECENT", currentTab == TAB_RECENT) { onTabChange(TAB_RECENT) }
+                TabItem("LARGEST", currentTab == TAB_LARGEST) { onTabChange(TAB_LARGEST) }
             }
 
             // Minimal Stats
@@ -1527,6 +1560,7 @@ fun PaneBrowser(
     canMaximize: Boolean = false,
     isSearchMode: Boolean = false,
     activePath: String = "",
+    onVisibleDirectories: (List<String>) -> Unit = {},
     onDrop: (DragAndDropEvent) -> Unit
 ) {
     val theme = LocalGlaiveTheme.current
@@ -1536,7 +1570,40 @@ fun PaneBrowser(
     val uniqueList = remember(displayedList) { 
         displayedList.distinctBy { it.path } 
     }
+
+    // Report the directories on screen once scrolling settles, for listing prefetch
+    val listState = rememberLazyListState()
+    val gridState = rememberLazyGridState()
+    LaunchedEffect(uniqueList, isGridView, isSearchMode) {
+        if (isSearchMode) return@LaunchedEffect
+        snapshotFlow {
+            val visible = if (isGridView) {
+                gridState.layoutInfo.visibleItemsInfo.map { it.index }
+            } else {
+                listState.layoutInfo.visibleItemsInfo.map { it.index }
+            }
+            visible.mapNotNull { uniqueList.getOrNull(it) }
+                .filter { it.type == GlaiveItem.TYPE_DIR }
+                .map { it.path }
+        }.distinctUntilChanged().collectLatest { paths ->
+            delay(VISIBLE_DIRECTORIES_SETTLE_MS)
+            if (paths.isNotEmpty()) onVisibleDirectories(paths)
+        }
+    }
     
+    // Thumbnails: rows on screen first, then the ones just below
+    LaunchedEffect(uniqueList, isGridView) {
+        snapshotFlow {
+            val visible = if (isGridView) gridState.layoutInfo.visibleItemsInfo else listState.layoutInfo.visibleItemsInfo
+            (visible.firstOrNull()?.index ?: 0) to (visible.lastOrNull()?.index ?: -1)
+        }.distinctUntilChanged().collectLatest { (_, last) ->
+            Thumbnails.onVisibleRowsChanged()
+            val ahead = uniqueList.subList(minOf(last + 1, uniqueList.size), minOf(last + 1 + THUMBNAIL_PREFETCH_ROWS, uniqueList.size))
+            // Suspends until the rows move again; collectLatest then drops what was not reached
+            Thumbnails.prefetch(ahead)
+        }
+    }
+
     LaunchedEffect(showMaximizeButton) {
         if (showMaximizeButton) {
             delay(3000)
@@ -1687,6 +1754,7 @@ fun PaneBrowser(
         } else if (isGridView) {
             LazyVerticalGrid(
                 columns = GridCells.Adaptive(minSize = 100.dp),
+                state = gridState,
                 modifier = Modifier.fillMaxSize(),
                 contentPadding = PaddingValues(bottom = 140.dp, top = 8.dp, start = 16.dp, end = 16.dp),
                 verticalArrangement = Arrangement.spacedBy(12.dp),
@@ -1725,6 +1793,7 @@ fun PaneBrowser(
             }
         } else {
             LazyColumn(
+                state = listState,
                 modifier = Modifier.fillMaxSize(),
                 contentPadding = PaddingValues(bottom = 140.dp, top = 8.dp, start = 16.dp, end = 16.dp),
                 verticalArrangement = Arrangement.spacedBy(12.dp)
@@ -1828,10 +1897,12 @@ fun FileCard(
             if (isSelected) {
                 Icon(imageVector = Icons.Default.Check, contentDescription = null, tint = theme.colors.accent)
             } else {
-                Text(
-                    text = getTypeIcon(item.type),
-                    fontSize = 18.sp
-                )
+                ItemThumbnail(item, Modifier.fillMaxSize().clip(RoundedCornerShape(4.dp))) {
+                    Text(
+                        text = getTypeIcon(item.type),
+                        fontSize = 18.sp
+                    )
+                }
             }
         }
 
@@ -2169,15 +2240,10 @@ fun FileGridItem(
         ) {
             if (isSelected) {
                 Icon(imageVector =Icons.Default.Check, null, tint = theme.colors.accent)
-            } else if (item.type == GlaiveItem.TYPE_IMG) {
-                AsyncImage(
-                    model = File(item.path),
-                    contentDescription = item.name,
-                    contentScale = ContentScale.Crop,
-                    modifier = Modifier.fillMaxSize()
-                )
             } else {
-                Text(getTypeIcon(item.type), fontSize = 20.sp)
+                ItemThumbnail(item, Modifier.fillMaxSize()) {
+                    Text(getTypeIcon(item.type), fontSize = 20.sp)
+                }
             }
         }
         Spacer(modifier = Modifier.height(6.dp))
@@ -2203,7 +2269,8 @@ fun ContextMenuSheet(
     isFavorite: Boolean,
     onOpenFileLocation: () -> Unit,
     isTrashItem: Boolean = false,
-    onRestore: () -> Unit = {}
+    onRestore: () -> Unit = {},
+    onSyncToOtherPane: (() -> Unit)? = null
 ) {
     val theme = LocalGlaiveTheme.current
     val context = LocalContext.current
@@ -2227,6 +2294,9 @@ fun ContextMenuSheet(
                 if (FileOperations.isArchive(item.path)) {
                      ContextMenuItem("Extract Here", Icons.Default.Archive, onExtract)
                 }
+                if (onSyncToOtherPane != null) {
+                    ContextMenuItem("Sync to Other Pane", Icons.Default.Refresh, onSyncToOtherPane)
+                }
                 ContextMenuItem("Copy Path", Icons.Default.ContentPaste, {
                     val clipboard = context.getSystemService(Context.CLIPBOARD_SERVICE) as android.content.ClipboardManager
                     val clip = android.content.ClipData.newPlainText("Path", item.path)
@@ -2388,8 +2458,11 @@ fun FilterBar(
     ) {
         item { FilterChip("Images", GlaiveItem.TYPE_IMG, activeFilters, onFilterToggle) }
         item { FilterChip("Videos", GlaiveItem.TYPE_VID, activeFilters, onFilterToggle) }
-        item { FilterChip("Audio", 0, activeFilters, onFilterToggle, enabled = false) } // Placeholder
+        item { FilterChip("Audio", GlaiveItem.TYPE_AUDIO, activeFilters, onFilterToggle) }
         item { FilterChip("Docs", GlaiveItem.TYPE_DOC, activeFilters, onFilterToggle) }
+        item { FilterChip("Ebooks", GlaiveItem.TYPE_EBOOK, activeFilters, onFilterToggle) }
+        item { FilterChip("Archives", GlaiveItem.TYPE_ARCHIVE, activeFilters, onFilterToggle) }
+        item { FilterChip("Code", GlaiveItem.TYPE_CODE, activeFilters, onFilterToggle) }
         item { FilterChip("APKs", GlaiveItem.TYPE_APK, activeFilters, onFilterToggle) }
     }
 }
@@ -2569,16 +2642,48 @@ fun getTypeColor(type: Int): Color {
         GlaiveItem.TYPE_IMG -> Color(0xFF2979FF)
         GlaiveItem.TYPE_VID -> theme.colors.error
         GlaiveItem.TYPE_APK -> Color(0xFFB2FF59)
+        GlaiveItem.TYPE_AUDIO -> Color(0xFFE040FB)
+        GlaiveItem.TYPE_ARCHIVE -> Color(0xFFFFAB40)
+        GlaiveItem.TYPE_CODE -> Color(0xFF64FFDA)
+        GlaiveItem.TYPE_EBOOK -> Color(0xFFFFD740)
         else -> Color.Gray
     }
 }
 
+/** The cached thumbnail of an image or video row, [fallback] until it is ready or when there is none. */
+@Composable
+fun ItemThumbnail(item: GlaiveItem, modifier: Modifier = Modifier, fallback: @Composable () -> Unit) {
+    if (!Thumbnails.supports(item)) {
+        fallback()
+        return
+    }
+    // load() also catches rows whose file changed behind a listing without mtime and size
+    val thumbnail by produceState(Thumbnails.cached(item), item.path, item.mtime, item.size) {
+        value = Thumbnails.load(item)
+    }
+    val bitmap = thumbnail
+    if (bitmap != null) {
+        Image(
+            bitmap = bitmap.asImageBitmap(),
+            contentDescription = item.name,
+            contentScale = ContentScale.Crop,
+            modifier = modifier
+        )
+    } else {
+        fallback()
+    }
+}
+
 fun getTypeIcon(type: Int): String = when (type) {
     GlaiveItem.TYPE_DIR -> "📁"
     GlaiveItem.TYPE_IMG -> "🖼️"
     GlaiveItem.TYPE_VID -> "🎬"
     GlaiveItem.TYPE_APK -> "🤖"
     GlaiveItem.TYPE_DOC -> "📄"
+    GlaiveItem.TYPE_AUDIO -> "🎵"
+    GlaiveItem.TYPE_ARCHIVE -> "📦"
+    GlaiveItem.TYPE_CODE -> "🧾"
+    GlaiveItem.TYPE_EBOOK -> "📚"
     else -> "📝"
 }
 
@@ -2676,7 +2781,10 @@ private fun mimeFor(item: GlaiveItem): String = when (item.type) {
     GlaiveItem.TYPE_IMG -> "image/*"
     GlaiveItem.TYPE_VID -> "video/*"
     GlaiveItem.TYPE_APK -> "application/vnd.android.package-archive"
-    GlaiveItem.TYPE_DOC -> "application/pdf"
+    // These groups span many formats (md, csv, docx, zip, 7z, epub, ...); the extension decides
+    GlaiveItem.TYPE_DOC, GlaiveItem.TYPE_ARCHIVE, GlaiveItem.TYPE_EBOOK -> getSmartMimeType(item.path)
+    GlaiveItem.TYPE_AUDIO -> "audio/*"
+    GlaiveItem.TYPE_CODE -> "text/plain"
     else -> "*/*"
 }
 
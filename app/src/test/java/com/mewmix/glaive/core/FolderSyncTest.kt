@@ -0,0 +1,50 @@
+package com.mewmix.glaive.core
+
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertTrue
+import org.junit.Test
+
+class FolderSyncTest {
+
+    private fun diff(path: String, kind: Int, leftSize: Long = 10, rightSize: Long = 10) =
+        SyncDiff(path, kind, false, false, leftSize, 0, rightSize, 0)
+
+    private val diffs = listOf(
+        diff("new.jpg", SyncDiff.ONLY_LEFT, rightSize = -1),
+        diff("gone.jpg", SyncDiff.ONLY_RIGHT, leftSize = -1),
+        diff("edited.txt", SyncDiff.NEWER_LEFT, leftSize = 5),
+        diff("backup-edit.txt", SyncDiff.NEWER_RIGHT),
+        diff("odd.bin", SyncDiff.SIZE_DIFFERS),
+        diff("shape", SyncDiff.TYPE_DIFFERS)
+    )
+
+    @Test
+    fun testUpdateCopiesLeftOnly() {
+        val plan = FolderSync.plan("/L", "/R/", diffs, FolderSync.Mode.UPDATE)
+        assertEquals(
+            listOf("/L/new.jpg" to "/R/new.jpg", "/L/edited.txt" to "/R/edited.txt", "/L/odd.bin" to "/R/odd.bin"),
+            plan.copies
+        )
+        assertTrue(plan.deletes.isEmpty())
+        assertEquals(listOf("shape"), plan.conflicts.map { it.path })
+        assertEquals(25L, plan.copyBytes)
+    }
+
+    @Test
+    fun testMirrorDeletesBeforeReplacing() {
+        val plan = FolderSync.plan("/L", "/R", diffs, FolderSync.Mode.MIRROR)
+        assertEquals(listOf("/R/gone.jpg", "/R/shape"), plan.deletes)
+        assertEquals(5, plan.copies.size)
+        assertTrue(plan.copies.all { it.first.startsWith("/L/") })
+        assertTrue(plan.conflicts.isEmpty())
+    }
+
+    @Test
+    fun testTwoWayCopiesNewerSide() {
+        val plan = FolderSync.plan("/L", "/R", diffs, FolderSync.Mode.TWO_WAY)
+        assertTrue("/R/gone.jpg" to "/L/gone.jpg" in plan.copies)
+        assertTrue("/R/backup-edit.txt" to "/L/backup-edit.txt" in plan.copies)
+        assertTrue(plan.deletes.isEmpty())
+        assertEquals(listOf("odd.bin", "shape"), plan.conflicts.map { it.path })
+    }
+}
@@ -0,0 +1,63 @@
+package com.mewmix.glaive.core
+
+import com.mewmix.glaive.data.GlaiveItem
+import org.junit.Assert.assertEquals
+import org.junit.Test
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+class RecordJsonTest {
+
+    private fun records(vararg entries: Triple<Int, String, Long>): ByteBuffer {
+        val out = ByteBuffer.allocate(4096).order(ByteOrder.LITTLE_ENDIAN)
+        for ((type, name, size) in entries) {
+            val bytes = name.toByteArray(Charsets.UTF_8)
+            out.put(type.toByte()).put(bytes.size.toByte()).put(bytes).putLong(size).putLong(1_700_000_000L)
+        }
+        out.flip()
+        return out
+    }
+
+    @Test
+    fun testPagesAndCursor() {
+        val buffer = records(
+            Triple(GlaiveItem.TYPE_DIR, "a", 4096L),
+            Triple(GlaiveItem.TYPE_IMG, "b.jpg", 10L),
+            Triple(GlaiveItem.TYPE_DOC, "c.pdf", 20L)
+        )
+        val fields = RecordJson.parseFields("name,size")
+
+        val first = RecordJson.encodePage(buffer, buffer.limit(), "/sdcard", 0, 2, fields)
+        assertEquals("""{"items":[{"name":"a","size":4096},{"name":"b.jpg","size":10}],"total":3,"next_cursor":"2"}""", first)
+
+        val last = RecordJson.encodePage(buffer, buffer.limit(), "/sdcard", 2, 2, fields)
+        assertEquals("""{"items":[{"name":"c.pdf","size":20}],"total":3,"next_cursor":null}""", last)
+
+        val tokened = RecordJson.encodePage(buffer, buffer.limit(), "/sdcard", 1, 1, fields, cursorPrefix = "ab12:")
+        assertEquals("""{"items":[{"name":"b.jpg","size":10}],"total":3,"next_cursor":"ab12:2"}""", tokened)
+    }
+
+    @Test
+    fun testRelativePathsEscapingAndExtras() {
+        val buffer = records(Triple(GlaiveItem.TYPE_FILE, "dir/q\"uote\\Ü.txt", 1L))
+        val json = RecordJson.encodePage(
+            buffer, buffer.limit(), "/root/", 0, 10, RecordJson.ALL_FIELDS,
+            reportTotal = false,
+            extra = mapOf("complete" to true)
+        )
+        assertEquals(
+            """{"items":[{"name":"q\"uote\\Ü.txt","path":"/root/dir/q\"uote\\Ü.txt","type":"file","size":1,"mtime":1700000000000}],""" +
+                """"next_cursor":null,"complete":true}""",
+            json
+        )
+    }
+
+    @Test
+    fun testParameterMapping() {
+        assertEquals((1 shl GlaiveItem.TYPE_IMG) or (1 shl GlaiveItem.TYPE_DOC), RecordJson.parseFilterMask("image, document"))
+        assertEquals((1 shl GlaiveItem.TYPE_AUDIO) or (1 shl GlaiveItem.TYPE_EBOOK), RecordJson.parseFilterMask("audio,books"))
+        assertEquals(0, RecordJson.parseFilterMask(""))
+        assertEquals(2, RecordJson.parseSortMode("Size"))
+        assertEquals(RecordJson.ALL_FIELDS, RecordJson.parseFields(null))
+    }
+}
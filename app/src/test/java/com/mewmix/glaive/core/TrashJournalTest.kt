@@ -0,0 +1,93 @@
+package com.mewmix.glaive.core
+
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertTrue
+import org.junit.Rule
+import org.junit.Test
+import org.junit.rules.TemporaryFolder
+import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+class TrashJournalTest {
+    @get:Rule
+    val tempFolder = TemporaryFolder()
+
+    @Test
+    fun testReplayAddRemoveAndSize() {
+        val file = File(tempFolder.root, "restore.journal")
+        val journal = TrashJournal(file)
+        journal.appendAdded(listOf(
+            TrashEntry("1_a.txt", "/sdcard/a.txt", 11, 1000, false),
+            TrashEntry("2_dir", "/sdcard/Ü/dir", -1, 2000, true)
+        ))
+        journal.appendRemoved(listOf("1_a.txt"))
+        journal.appendSizes(mapOf("2_dir" to 4096L))
+
+        val reloaded = TrashJournal(file)
+        val entries = reloaded.load()
+        assertEquals("Should replay to 1 entry", 1, entries.size)
+        assertEquals(TrashEntry("2_dir", "/sdcard/Ü/dir", 4096, 2000, true), entries["2_dir"])
+        assertEquals("All records counted", 4, reloaded.recordCount)
+    }
+
+    @Test
+    fun testTornTailIsTruncated() {
+        val file = File(tempFolder.root, "restore.journal")
+        val journal = TrashJournal(file)
+        journal.appendAdded(listOf(TrashEntry("1_a.txt", "/sdcard/a.txt", 11, 1000, false)))
+        val validLength = file.length()
+        file.appendBytes(byteArrayOf(1, 0, 5))
+
+        val entries = TrashJournal(file).load()
+        assertEquals(1, entries.size)
+        assertEquals("Torn record should be cut off", validLength, file.length())
+    }
+
+    @Test
+    fun testShortFileIsEmptyJournal() {
+        val file = File(tempFolder.root, "restore.journal")
+        file.writeBytes("GLV".toByteArray(Charsets.US_ASCII))
+
+        val journal = TrashJournal(file)
+        assertTrue(journal.load().isEmpty())
+        assertEquals("Torn magic should be cut off", 0L, file.length())
+
+        journal.appendAdded(listOf(TrashEntry("1_a.txt", "/sdcard/a.txt", 11, 1000, false)))
+        assertEquals(1, TrashJournal(file).load().size)
+    }
+
+    @Test
+    fun testUnknownOpIsSkipped() {
+        val file = File(tempFolder.root, "restore.journal")
+        val journal = TrashJournal(file)
+        journal.appendAdded(listOf(TrashEntry("1_a.txt", "/sdcard/a.txt", 11, 1000, false)))
+        // op 9, one-byte name, no path
+        val unknown = ByteBuffer.allocate(23).order(ByteOrder.LITTLE_ENDIAN)
+            .put(9.toByte()).put(0.toByte()).putShort(1).putShort(0).putLong(0).putLong(0).put('x'.code.toByte())
+        file.appendBytes(unknown.array())
+        journal.appendAdded(listOf(TrashEntry("2_b.txt", "/sdcard/b.txt", 22, 2000, false)))
+        val length = file.length()
+
+        val entries = TrashJournal(file).load()
+        assertEquals("Records after the unknown one should survive", setOf("1_a.txt", "2_b.txt"), entries.keys)
+        assertEquals(length, file.length())
+    }
+
+    @Test
+    fun testRewriteCompacts() {
+        val file = File(tempFolder.root, "restore.journal")
+        val journal = TrashJournal(file)
+        for (i in 0 until 10) {
+            journal.appendAdded(listOf(TrashEntry("${i}_f", "/sdcard/f$i", i.toLong(), i.toLong(), false)))
+        }
+        journal.appendRemoved((0 until 9).map { "${it}_f" })
+        val live = journal.load()
+        val before = file.length()
+
+        journal.rewrite(live.values)
+        assertTrue("Compacted file should shrink", file.length() < before)
+        assertEquals(1, journal.recordCount)
+        assertEquals(live, TrashJournal(file).load())
+    }
+}